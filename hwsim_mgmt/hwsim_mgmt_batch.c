@@ -0,0 +1,406 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#include <netlink/netlink.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "hwsim_mgmt_batch.h"
+#include "hwsim_mgmt_radio.h"
+#include "hwsim_mgmt_pool.h"
+#include "hwsim_mgmt_stats.h"
+
+#define BATCH_DELIM " \t\r\n"
+
+static unsigned long batch_failed;
+static bool batch_json;
+static op_stats batch_stats;
+
+// radios created by a transactional batch, deleted again on rollback
+static struct {
+    bool enabled;
+    pthread_mutex_t lock;
+    uint32_t *ids;
+    size_t count;
+    size_t cap;
+    unsigned long deleted;
+    unsigned long gone;
+    unsigned long failed;
+} batch_txn = {false, PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, 0, 0, 0};
+
+// radio list of lookup, fetched at the first lookup and kept current with the batch's own results
+static struct {
+    pthread_mutex_t lock;
+    radio_index index;
+    bool loaded;
+} batch_names = {PTHREAD_MUTEX_INITIALIZER, {NULL, 0, 0, NULL, 0, NULL, 0}, false};
+
+const char *op_name(enum op_mode mode) {
+    switch (mode) {
+        case HWSIM_OP_CREATE:
+            return "create";
+        case HWSIM_OP_DELETE_BY_ID:
+            return "delid";
+        case HWSIM_OP_DELETE_BY_NAME:
+            return "delname";
+        case HWSIM_OP_SET_RSSI:
+            return "setrssi";
+        case HWSIM_OP_LIST:
+            return "list";
+        case HWSIM_OP_LOOKUP:
+            return "lookup";
+        case HWSIM_OP_SET_PROPS:
+            return "set";
+        case HWSIM_OP_RENAME:
+            return "rename";
+        default:
+            return "invalid";
+    }
+}
+
+int parse_create_option(char *token, hwsim_args *op) {
+    char *value = strchr(token, '=');
+    if (value) {
+        *value++ = '\0';
+    }
+    if (!strcmp(token, "novif") && !value) {
+        op->c_no_vif = true;
+    } else if (!strcmp(token, "chanctx") && !value) {
+        op->c_use_chanctx = true;
+    } else if (!strcmp(token, "destroyonclose") && !value) {
+        op->c_destroy_on_close = true;
+    } else if (!strcmp(token, "name") && value) {
+        op->c_hwname = value;
+    } else if (!strcmp(token, "channels") && value) {
+        return parse_uint32(value, &op->c_channels);
+    } else if (!strcmp(token, "alphareg") && value) {
+        op->c_reg_alpha2 = value;
+    } else if (!strcmp(token, "customreg") && value) {
+        return parse_uint32(value, &op->c_reg_custom_reg);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int parse_tx_info(char *list, hwsim_props *props) {
+    char *saveptr = NULL;
+    char *rate;
+    props->tx_info_count = 0;
+    for (rate = strtok_r(list, ",", &saveptr); rate; rate = strtok_r(NULL, ",", &saveptr)) {
+        char *count = strchr(rate, ':');
+        char *endptr;
+        long idx;
+        uint32_t num;
+        if (!count || props->tx_info_count == HWSIM_TX_MAX_RATES) {
+            return -1;
+        }
+        *count++ = '\0';
+        idx = strtol(rate, &endptr, 10);
+        if (!*rate || *endptr || idx < INT8_MIN || idx > INT8_MAX || parse_uint32(count, &num) || num > UINT8_MAX) {
+            return -1;
+        }
+        props->tx_info[props->tx_info_count].idx = (int8_t) idx;
+        props->tx_info[props->tx_info_count].count = (uint8_t) num;
+        props->tx_info_count++;
+    }
+    props->set |= HWSIM_PROP_TX_INFO;
+    return 0;
+}
+
+int parse_props_option(char *token, hwsim_props *props) {
+    char *value = strchr(token, '=');
+    if (!value) {
+        return -1;
+    }
+    *value++ = '\0';
+    if (!strcmp(token, "signal")) {
+        props->set |= HWSIM_PROP_SIGNAL;
+        return parse_rssi(value, &props->signal);
+    } else if (!strcmp(token, "freq")) {
+        props->set |= HWSIM_PROP_FREQ;
+        return parse_uint32(value, &props->freq);
+    } else if (!strcmp(token, "txinfo")) {
+        return parse_tx_info(value, props);
+    }
+    return -1;
+}
+
+static int parse_set_line(char **saveptr, hwsim_args *op, hwsim_props *props) {
+    char *token;
+    op->mode = HWSIM_OP_SET_PROPS;
+    op->props = props;
+    while ((token = strtok_r(NULL, BATCH_DELIM, saveptr))) {
+        if (!strncmp(token, "id=", 3)) {
+            // every id= starts the properties of the next radio
+            if (op->props_count == HWSIM_PROPS_MAX) {
+                return -1;
+            }
+            memset(&props[op->props_count], 0, sizeof(hwsim_props));
+            if (parse_uint32(token + 3, &props[op->props_count].radio_id)) {
+                return -1;
+            }
+            op->props_count++;
+        } else if (!op->props_count || parse_props_option(token, &props[op->props_count - 1])) {
+            return -1;
+        }
+    }
+    return op->props_count ? 0 : -1;
+}
+
+int parse_batch_line(char *line, hwsim_args *op, hwsim_props *props) {
+    char *saveptr = NULL;
+    char *token;
+    memset(op, 0, sizeof(*op));
+    op->mode = HWSIM_OP_NONE;
+
+    char *cmd = strtok_r(line, BATCH_DELIM, &saveptr);
+    if (!cmd || cmd[0] == '#') {
+        return 0;
+    }
+    if (!strcmp(cmd, "create")) {
+        op->mode = HWSIM_OP_CREATE;
+        while ((token = strtok_r(NULL, BATCH_DELIM, &saveptr))) {
+            if (parse_create_option(token, op)) {
+                return -1;
+            }
+        }
+        return 0;
+    } else if (!strcmp(cmd, "delid")) {
+        op->mode = HWSIM_OP_DELETE_BY_ID;
+        token = strtok_r(NULL, BATCH_DELIM, &saveptr);
+        if (!token || parse_uint32(token, &op->del_radio_id)) {
+            return -1;
+        }
+    } else if (!strcmp(cmd, "delname")) {
+        op->mode = HWSIM_OP_DELETE_BY_NAME;
+        op->del_radio_name = strtok_r(NULL, BATCH_DELIM, &saveptr);
+        if (!op->del_radio_name) {
+            return -1;
+        }
+    } else if (!strcmp(cmd, "lookup")) {
+        op->mode = HWSIM_OP_LOOKUP;
+        op->lookup_name = strtok_r(NULL, BATCH_DELIM, &saveptr);
+        if (!op->lookup_name) {
+            return -1;
+        }
+    } else if (!strcmp(cmd, "setrssi")) {
+        op->mode = HWSIM_OP_SET_RSSI;
+        token = strtok_r(NULL, BATCH_DELIM, &saveptr);
+        if (!token || parse_uint32(token, &op->rssi_radio)) {
+            return -1;
+        }
+        token = strtok_r(NULL, BATCH_DELIM, &saveptr);
+        if (!token || parse_rssi(token, &op->rssi_dbm)) {
+            return -1;
+        }
+    } else if (!strcmp(cmd, "set")) {
+        return parse_set_line(&saveptr, op, props);
+    } else {
+        return -1;
+    }
+    return strtok_r(NULL, BATCH_DELIM, &saveptr) ? -1 : 0;
+}
+
+static void txn_record(uint32_t radio_id) {
+    pthread_mutex_lock(&batch_txn.lock);
+    if (batch_txn.count == batch_txn.cap) {
+        size_t cap = batch_txn.cap ? batch_txn.cap * 2 : 64;
+        uint32_t *ids = realloc(batch_txn.ids, cap * sizeof(uint32_t));
+        if (!ids) {
+            pthread_mutex_unlock(&batch_txn.lock);
+            fprintf(stderr, "Error recording radio %u, it will not be rolled back\n", radio_id);
+            return;
+        }
+        batch_txn.ids = ids;
+        batch_txn.cap = cap;
+    }
+    batch_txn.ids[batch_txn.count++] = radio_id;
+    pthread_mutex_unlock(&batch_txn.lock);
+}
+
+/*
+ * Applies a completed create or delete to the lookup list, like the
+ * daemon's index without notifications. Radios whose name is picked by
+ * the kernel or did not fit into the request make the next lookup fetch
+ * the list again.
+ */
+static void update_names(const hwsim_request *req) {
+    const hwsim_radio *found;
+    hwsim_radio radio;
+    if (req->error < 0) {
+        return;
+    }
+    pthread_mutex_lock(&batch_names.lock);
+    if (!batch_names.loaded) {
+        pthread_mutex_unlock(&batch_names.lock);
+        return;
+    }
+    if (req->mode == HWSIM_OP_CREATE) {
+        memset(&radio, 0, sizeof(radio));
+        radio.id = (uint32_t) req->radio_id;
+        memcpy(radio.name, req->name, sizeof(radio.name) - 1);
+        radio.channels = req->op.c_channels;
+        radio.use_chanctx = req->op.c_use_chanctx;
+        radio.destroy_on_close = req->op.c_destroy_on_close;
+        if (!req->name[0] || !req->resendable || put_radio(&batch_names.index, &radio)) {
+            batch_names.loaded = false;
+        }
+    } else if (req->mode == HWSIM_OP_DELETE_BY_ID) {
+        remove_radio(&batch_names.index, (uint32_t) req->target_id);
+    } else if (req->mode == HWSIM_OP_DELETE_BY_NAME) {
+        if (!req->resendable) {
+            batch_names.loaded = false;
+        } else if ((found = find_radio_by_name(&batch_names.index, req->name))) {
+            remove_radio(&batch_names.index, found->id);
+        }
+    }
+    pthread_mutex_unlock(&batch_names.lock);
+}
+
+static void batch_request_done(const hwsim_request *req, void *arg) {
+    unsigned long line_no = (unsigned long) (uintptr_t) arg;
+    if (batch_txn.enabled && req->mode == HWSIM_OP_CREATE && req->error >= 0) {
+        txn_record((uint32_t) req->radio_id);
+    }
+    update_names(req);
+    record_request(&batch_stats, req);
+    if (req->error < 0) {
+        __atomic_fetch_add(&batch_failed, 1, __ATOMIC_RELAXED);
+    }
+    if (batch_json) {
+        print_request_json(stdout, line_no, req);
+    } else if (req->error < 0) {
+        printf("%lu %s err %d %s\n", line_no, op_name(req->mode), req->error, strerror(abs(req->error)));
+    } else {
+        printf("%lu %s ok %d\n", line_no, op_name(req->mode), req->radio_id);
+    }
+}
+
+/*
+ * Answers once the lines before it completed, so it sees their creates
+ * and deletes.
+ */
+static void batch_lookup(hwsim_pool *pool, unsigned long line_no, const char *name) {
+    const hwsim_radio *radio;
+    int ret;
+    wait_for_pool(pool);
+    // nothing is in flight, the lock only orders with the event threads' last updates
+    pthread_mutex_lock(&batch_names.lock);
+    if (!batch_names.loaded) {
+        if ((ret = load_radio_index(&pool->engines[0], &batch_names.index))) {
+            pthread_mutex_unlock(&batch_names.lock);
+            printf("%lu %s err %d %s\n", line_no, op_name(HWSIM_OP_LOOKUP), ret, strerror(abs(ret)));
+            __atomic_fetch_add(&batch_failed, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        batch_names.loaded = true;
+    }
+    radio = find_radio_by_name(&batch_names.index, name);
+    ret = radio ? (int) radio->id : -ENODEV;
+    pthread_mutex_unlock(&batch_names.lock);
+    if (ret < 0) {
+        printf("%lu %s err %d %s\n", line_no, op_name(HWSIM_OP_LOOKUP), ret, strerror(-ret));
+        __atomic_fetch_add(&batch_failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    printf("%lu %s ok %d\n", line_no, op_name(HWSIM_OP_LOOKUP), ret);
+}
+
+static void rollback_done(const hwsim_request *req, void *arg) {
+    UNUSED(arg);
+    // a radio the batch deleted itself is already gone
+    if (req->error == -ENODEV) {
+        __atomic_fetch_add(&batch_txn.gone, 1, __ATOMIC_RELAXED);
+    } else if (req->error < 0) {
+        __atomic_fetch_add(&batch_txn.failed, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&batch_txn.deleted, 1, __ATOMIC_RELAXED);
+    }
+    if (batch_json) {
+        printf("{\"rollback\":%d,\"error\":%d}\n", req->target_id, req->error);
+    } else if (req->error < 0) {
+        printf("rollback %d err %d %s\n", req->target_id, req->error, strerror(abs(req->error)));
+    } else {
+        printf("rollback %d ok\n", req->target_id);
+    }
+}
+
+/*
+ * Deletes every radio the batch created, pipelined over the whole pool.
+ */
+static void rollback(hwsim_pool *pool) {
+    hwsim_args op;
+    size_t i;
+
+    memset(&op, 0, sizeof(op));
+    op.mode = HWSIM_OP_DELETE_BY_ID;
+    for (i = 0; i < batch_txn.count; i++) {
+        op.del_radio_id = batch_txn.ids[i];
+        if (submit_request_wait(pool_engine(pool, &op), &op, rollback_done, NULL)) {
+            __atomic_fetch_add(&batch_txn.failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+    wait_for_pool(pool);
+    fprintf(stderr, "Rolled back %zu created radios: %lu deleted, %lu already gone, %lu failed\n",
+            batch_txn.count, batch_txn.deleted, batch_txn.gone, batch_txn.failed);
+}
+
+int run_batch(hwsim_pool *pool, FILE *in, bool json, uint32_t max_failures) {
+    char *line = NULL;
+    size_t line_cap = 0;
+    unsigned long line_no = 0;
+    hwsim_args op;
+    hwsim_props props[HWSIM_PROPS_MAX];
+
+    batch_failed = 0;
+    batch_json = json;
+    batch_txn.enabled = max_failures > 0;
+    batch_txn.count = 0;
+    batch_txn.deleted = 0;
+    batch_txn.gone = 0;
+    batch_txn.failed = 0;
+    init_op_stats(&batch_stats);
+    init_radio_index(&batch_names.index);
+    batch_names.loaded = false;
+    while (getline(&line, &line_cap, in) != -1) {
+        if (batch_txn.enabled && __atomic_load_n(&batch_failed, __ATOMIC_RELAXED) >= max_failures) {
+            break;
+        }
+        line_no++;
+        if (parse_batch_line(line, &op, props)) {
+            printf("%lu %s err %d %s\n", line_no, op_name(HWSIM_OP_NONE), -EINVAL, strerror(EINVAL));
+            __atomic_fetch_add(&batch_failed, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (op.mode == HWSIM_OP_NONE) {
+            continue;
+        }
+        if (op.mode == HWSIM_OP_LOOKUP) {
+            batch_lookup(pool, line_no, op.lookup_name);
+            continue;
+        }
+        if (submit_request_wait(pool_engine(pool, &op), &op, batch_request_done, (void *) (uintptr_t) line_no)) {
+            printf("%lu %s err %d %s\n", line_no, op_name(op.mode), -EIO, strerror(EIO));
+            __atomic_fetch_add(&batch_failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+    free(line);
+    wait_for_pool(pool);
+    if (batch_txn.enabled && batch_failed >= max_failures) {
+        // radios created by requests still in flight at the failure are recorded by now
+        fprintf(stderr, "Aborting after line %lu with %lu failed operations\n", line_no, batch_failed);
+        rollback(pool);
+    }
+    free(batch_txn.ids);
+    batch_txn.ids = NULL;
+    batch_txn.cap = 0;
+    // keep stdout parseable: the text summary goes to stderr
+    print_op_stats(&batch_stats, json ? stdout : stderr, json);
+    report_pool_overruns(pool, stderr);
+    free_op_stats(&batch_stats);
+    free_radio_index(&batch_names.index);
+    return batch_failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,59 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_BATCH_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_BATCH_H
+
+#include <stdio.h>
+#include "hwsim_mgmt_cli.h"
+#include "hwsim_mgmt_pool.h"
+
+const char *op_name(enum op_mode mode);
+
+/*
+ * Parses one "key=value" or flag token of a create line into op.
+ */
+int parse_create_option(char *token, hwsim_args *op);
+
+/*
+ * Parses "IDX:COUNT[,IDX:COUNT...]" into the TX info of props.
+ */
+int parse_tx_info(char *list, hwsim_props *props);
+
+/*
+ * Parses one "signal=DBM", "freq=MHZ" or "txinfo=LIST" token into props.
+ */
+int parse_props_option(char *token, hwsim_props *props);
+
+/*
+ * Batch lines have the form
+ *   create [name=NAME] [channels=NUM] [novif] [chanctx] [alphareg=STR] [customreg=REG] [destroyonclose]
+ *   delid ID
+ *   delname NAME
+ *   setrssi ID DBM
+ *   set id=ID [signal=DBM] [freq=MHZ] [txinfo=IDX:COUNT,...] [id=ID ...]
+ *   lookup NAME
+ * set updates the properties following each id= of up to HWSIM_PROPS_MAX
+ * radios in one request, whose entries are stored in props.
+ * lookup answers with the radio id from a radio dump taken at the first
+ * lookup, without a netlink round trip for later lookups.
+ * Empty lines and lines starting with '#' are ignored.
+ * String values point into line, which is modified in place.
+ */
+int parse_batch_line(char *line, hwsim_args *op, hwsim_props *props);
+
+/*
+ * Runs all operations from in, spread over the sockets of pool with up
+ * to window requests in flight on each. Replies are dispatched by the
+ * event threads, which print one result line per operation as they
+ * arrive (a JSON object with timings if json is set). A latency
+ * histogram per operation follows on stderr, or as a final JSON line.
+ * With max_failures > 0 the batch is a transaction: once that many
+ * operations failed no further lines are read, and every radio the batch
+ * created is deleted again ("rollback" result lines).
+ */
+int run_batch(hwsim_pool *pool, FILE *in, bool json, uint32_t max_failures);
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_BATCH_H
@@ -0,0 +1,164 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hwsim_mgmt_bench.h"
+
+#define BENCH_NAME_MAX 32
+
+typedef struct {
+    struct timespec start;
+    // from the send to the reply
+    uint64_t latency_ns;
+    // from the submit until the request got a window slot and was sent
+    uint64_t queued_ns;
+    int radio_id;
+    int error;
+} bench_op;
+
+typedef struct {
+    const char *name;
+    enum op_mode mode;
+    bool pipelined;
+} bench_phase;
+
+static const bench_phase phases[] = {
+        {"create",  HWSIM_OP_CREATE,       true},
+        {"setrssi", HWSIM_OP_SET_RSSI,     true},
+        {"rtt",     HWSIM_OP_SET_RSSI,     false},
+        {"delid",   HWSIM_OP_DELETE_BY_ID, true}
+};
+
+static uint64_t elapsed_ns(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) (now.tv_sec - start->tv_sec) * 1000000000ull + now.tv_nsec - start->tv_nsec;
+}
+
+static void bench_request_done(const hwsim_request *req, void *arg) {
+    bench_op *op = arg;
+    op->latency_ns = timespec_diff_ns(&req->submitted, &req->replied);
+    op->queued_ns = timespec_diff_ns(&op->start, &req->submitted);
+    op->radio_id = req->radio_id;
+    op->error = req->error;
+}
+
+static int compare_latency(const void *a, const void *b) {
+    uint64_t la = *(const uint64_t *) a;
+    uint64_t lb = *(const uint64_t *) b;
+    return (la > lb) - (la < lb);
+}
+
+static uint64_t percentile(uint64_t *values, uint32_t count, double p) {
+    qsort(values, count, sizeof(uint64_t), compare_latency);
+    return values[(uint32_t) (count * p)];
+}
+
+/*
+ * Prints the phase and returns its failed operations, plus one if its
+ * p99 service time exceeds max_p99_us.
+ */
+static unsigned long report_phase(const bench_phase *phase, const bench_op *ops, uint64_t *latencies,
+                                  uint32_t count, uint64_t total_ns, uint32_t max_p99_us) {
+    unsigned long failed = 0;
+    uint64_t p50, p99, queued_p99;
+    uint32_t i;
+    for (i = 0; i < count; i++) {
+        latencies[i] = ops[i].queued_ns;
+        failed += ops[i].error < 0;
+    }
+    queued_p99 = percentile(latencies, count, 0.99);
+    for (i = 0; i < count; i++) {
+        latencies[i] = ops[i].latency_ns;
+    }
+    p50 = percentile(latencies, count, 0.5);
+    p99 = percentile(latencies, count, 0.99);
+    printf("%-8s %10u %12.1f %10.1f %10.1f %12.1f %8lu\n", phase->name, count,
+           total_ns ? count * 1e9 / total_ns : 0.0, p50 / 1e3, p99 / 1e3, queued_p99 / 1e3, failed);
+    if (max_p99_us && p99 > (uint64_t) max_p99_us * 1000) {
+        fprintf(stderr, "%s: p99 of %.1f us exceeds %u us\n", phase->name, p99 / 1e3, max_p99_us);
+        failed++;
+    }
+    return failed;
+}
+
+/*
+ * Returns the error of the create an op of a later phase addresses if
+ * that failed, the op is skipped then. 0 otherwise.
+ */
+static int fill_op(const bench_phase *phase, hwsim_args *args, const bench_op *created, uint32_t i,
+                   char *name) {
+    const bench_op *target = &created[phase->pipelined ? i : 0];
+    memset(args, 0, sizeof(*args));
+    args->mode = phase->mode;
+    switch (phase->mode) {
+        case HWSIM_OP_CREATE:
+            snprintf(name, BENCH_NAME_MAX, "bench%u", i);
+            args->c_hwname = name;
+            return 0;
+        case HWSIM_OP_SET_RSSI:
+            args->rssi_radio = (uint32_t) target->radio_id;
+            args->rssi_dbm = -30 - (int32_t) (i % 60);
+            break;
+        case HWSIM_OP_DELETE_BY_ID:
+            args->del_radio_id = (uint32_t) target->radio_id;
+            break;
+        default:
+            return 0;
+    }
+    return target->error < 0 ? target->error : 0;
+}
+
+int run_bench(hwsim_pool *pool, uint32_t ops, uint32_t max_p99_us) {
+    size_t phase_count = sizeof(phases) / sizeof(phases[0]);
+    bench_op *results = calloc(phase_count * ops, sizeof(bench_op));
+    uint64_t *latencies = malloc(ops * sizeof(uint64_t));
+    char name[BENCH_NAME_MAX];
+    unsigned long failed = 0;
+    hwsim_args args;
+    size_t p;
+    uint32_t i;
+
+    if (ops == 0 || !results || !latencies) {
+        free(results);
+        free(latencies);
+        return EXIT_FAILURE;
+    }
+    printf("%-8s %10s %12s %10s %10s %12s %8s\n", "phase", "ops", "ops/s", "p50 us", "p99 us", "queue p99 us",
+           "failed");
+    for (p = 0; p < phase_count; p++) {
+        const bench_phase *phase = &phases[p];
+        bench_op *phase_ops = &results[p * ops];
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < ops; i++) {
+            // never address a radio the benchmark did not create
+            if ((phase_ops[i].error = fill_op(phase, &args, results, i, name))) {
+                phase_ops[i].radio_id = -1;
+                continue;
+            }
+            hwsim_engine *engine = pool_engine(pool, &args);
+            clock_gettime(CLOCK_MONOTONIC, &phase_ops[i].start);
+            if (submit_request_wait(engine, &args, bench_request_done, &phase_ops[i])) {
+                phase_ops[i].radio_id = -1;
+                phase_ops[i].error = -EIO;
+                continue;
+            }
+            if (!phase->pipelined) {
+                wait_for_event(engine);
+            }
+        }
+        wait_for_pool(pool);
+        failed += report_phase(phase, phase_ops, latencies, ops, elapsed_ns(&start), max_p99_us);
+    }
+    report_pool_overruns(pool, stderr);
+    free(results);
+    free(latencies);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
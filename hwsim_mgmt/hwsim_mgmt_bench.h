@@ -0,0 +1,22 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_BENCH_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_BENCH_H
+
+#include "hwsim_mgmt_pool.h"
+
+/*
+ * Creates ops radios, sets their RSSI, sets the RSSI of one radio ops
+ * times with a single request in flight (rtt) and deletes the radios
+ * again. All other phases are pipelined over pool like batch mode.
+ * Prints ops/s, the p50/p99 service time (send to reply) and the p99
+ * time spent waiting for a window slot per phase, and fails if a phase's
+ * p99 service time exceeds max_p99_us (0 = no limit). Meant to be run
+ * against the mock backend for offline numbers.
+ */
+int run_bench(hwsim_pool *pool, uint32_t ops, uint32_t max_p99_us);
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_BENCH_H
@@ -8,17 +8,101 @@
 #include <stdarg.h>
 #include "hwsim_mgmt_cli.h"
 #include "hwsim_mgmt_event.h"
+#include "hwsim_mgmt_batch.h"
+#include "hwsim_mgmt_daemon.h"
+#include "hwsim_mgmt_rssi.h"
+#include "hwsim_mgmt_replay.h"
+#include "hwsim_mgmt_topology.h"
+#include "hwsim_mgmt_bench.h"
+#include "hwsim_mgmt_scale.h"
+#include "hwsim_mgmt_teardown.h"
+#include "hwsim_mgmt_medium.h"
+#include "hwsim_mgmt_playback.h"
+#include "hwsim_mgmt_watch.h"
+#include "hwsim_mgmt_stats.h"
+#include "hwsim_mgmt_radio.h"
+#include <fcntl.h>
+#include <unistd.h>
 
 const char *argp_program_version = "mac80211_hwsim_mgmt v0.1";
 const char *argp_program_bug_address = "<patrick.grosse@uni-muenster.de>";
 static char *program_executable = "hwsim_mgmt";
 static const char doc[] = "Management tool for mac80211_hwsim kernel module";
+enum long_opt {
+    OPT_TIMEOUT_MS = 0x100,
+    OPT_TICK_MS,
+    OPT_MOCK,
+    OPT_MOCK_LATENCY_US,
+    OPT_MOCK_FAIL_EVERY,
+    OPT_MOCK_ERRNO,
+    OPT_FREQ,
+    OPT_TX_INFO,
+    OPT_FAMILY_CACHE,
+    OPT_TRANSACTION,
+    OPT_MAX_FAILURES,
+    OPT_PREWARM,
+    OPT_PREWARM_LOW,
+    OPT_DELETE_ALL,
+    OPT_DELETE_MATCHING,
+    OPT_DELETE_SESSION,
+    OPT_REGEX,
+    OPT_SESSION,
+    OPT_PCAP,
+    OPT_RCVBUF,
+    OPT_SNDBUF,
+    OPT_JOURNAL,
+    OPT_FAST,
+    OPT_STEP,
+    OPT_INFLIGHT,
+    OPT_KERNEL_STATS,
+    OPT_BENCH_MAX_P99_US
+};
 static struct argp_option options[] = {
-        {0,           0,   0,      0, "Modes: [-c [OPTION...]|-d|-x]",             1},
+        {0,           0,   0,      0, "Modes: [-c [OPTION...]|-d|-x|-k|-l|-b|-D|-S|-R|-J|-A|-B|-G|-W|-P|-M|--delete-*]", 1},
         {"create",    'c', 0,      0, "Create a new radio",                        1},
         {"delid",     'd', "ID",   0, "Delete an existing radio by its id",        1},
         {"delname",   'x', "NAME", 0, "Delete an existing radio by its name",      1},
-        {"setrssi",   'k', "NUM",  0, "Set RSSI to specific radio",                1},
+        {"setrssi",   'k', "ID",   0, "Set RSSI (dBm argument) and properties of radio ID", 1},
+        {"list",      'l', 0,      0, "List existing radios",                      1},
+        {"batch",     'b', "FILE", 0, "Run operations from FILE (- for stdin)",    1},
+        {"daemon",    'D', "PATH", 0, "Serve batch lines on UNIX socket PATH",     1},
+        {"rssi-stream", 'S', "FILE", 0, "Stream RSSI updates from FILE (- for stdin)", 1},
+        {"replay",    'R', "FILE", 0, "Replay a binary RSSI matrix FILE",          1},
+        {"replay-journal", 'J', "FILE", 0, "Run the operations journaled in FILE again", 1},
+        {"apply",     'A', "FILE", 0, "Reconcile radios with topology FILE (- for stdin)", 1},
+        {"bench",     'B', "NUM",  0, "Benchmark NUM operations per phase",        1},
+        {"scale",     'G', "NUM",  0, "Profile create latency up to NUM new radios", 1},
+        {"watch",     'W', 0,      0, "Print radios as they are created and deleted", 1},
+        {"probe",     'P', 0,      0, "Show what the kernel's MAC80211_HWSIM family supports", 1},
+        {"medium",    'M', "FILE", 0, "Relay frames between radios per link FILE (- for stdin)", 1},
+        {"delete-all", OPT_DELETE_ALL, 0, 0, "Delete every radio",                   1},
+        {"delete-matching", OPT_DELETE_MATCHING, "PATTERN", 0, "Delete radios whose name matches PATTERN", 1},
+        {"delete-session", OPT_DELETE_SESSION, "TAG", 0, "Delete radios named TAG-*", 1},
+        {0,           0,   0,      0, "Set options:",                              3},
+        {"freq",      OPT_FREQ, "MHZ", 0, "Set the frequency (HWSIM_ATTR_FREQ)",     3},
+        {"txinfo",    OPT_TX_INFO, "IDX:COUNT,...", 0, "Set up to 4 TX rates (HWSIM_ATTR_TX_INFO)", 3},
+        {0,           0,   0,      0, "Delete options:",                           6},
+        {"regex",     OPT_REGEX, 0, 0, "PATTERN is an extended regex instead of a glob", 6},
+        {0,           0,   0,      0, "Medium options:",                           7},
+        {"pcap",      OPT_PCAP, "FILE", 0, "Capture relayed frames to pcap FILE",  7},
+        {0,           0,   0,      0, "Journal options:",                          8},
+        {"journal",   OPT_JOURNAL, "FILE", 0, "Record every create, delete and set to FILE", 8},
+        {"fast",      OPT_FAST, 0,   0, "Replay the journal as fast as possible",    8},
+        {0,           0,   0,      0, "Scale options:",                            9},
+        {"step",      OPT_STEP, "NUM", 0, "Report every NUM radios (default NUM/20)", 9},
+        {"inflight",  OPT_INFLIGHT, "NUM", 0, "Creates in flight while profiling (default 1)", 9},
+        {"kernel-stats", OPT_KERNEL_STATS, 0, 0, "Sample kernel slab memory from /proc/meminfo", 9},
+        {0,           0,   0,      0, "Bench options:",                            10},
+        {"max-p99-us", OPT_BENCH_MAX_P99_US, "US", 0, "Fail if a phase's p99 service time exceeds US", 10},
+        {0,           0,   0,      0, "Batch options:",                            4},
+        {"window",    'w', "NUM",  0, "Max. requests in flight (default 64)",      4},
+        {"sockets",   'p', "NUM",  0, "Spread requests over NUM sockets (default 1)", 4},
+        {"transaction", OPT_TRANSACTION, 0, 0, "Roll back created radios on the first failure", 4},
+        {"max-failures", OPT_MAX_FAILURES, "NUM", 0, "Roll back after NUM failures (implies --transaction)", 4},
+        {"tick-ms",   OPT_TICK_MS, "MS", 0, "RSSI stream coalescing tick (default 10)", 4},
+        {"session",   OPT_SESSION, 0, 0, "Daemon radios are deleted when the daemon exits", 4},
+        {"prewarm",   OPT_PREWARM, "NUM", 0, "Daemon keeps NUM spare novif radios for creates", 4},
+        {"prewarm-low", OPT_PREWARM_LOW, "NUM", 0, "Refill spares at NUM left (default half)", 4},
         {0,           0,   0,      0, "Create options:",                           2},
         {"name",      'n', "NAME", 0, "The requested name (may not be available)", 2},
         {"channels",  'o', "NUM",  0, "Number of concurrent channels",             2},
@@ -26,10 +110,21 @@ static struct argp_option options[] = {
         {"chanctx",   't', 0,      0, "Use chantx (flag)",                         2},
         {"alphareg",  'a', "STR",  0, "reg_alpha2 hint",                           2},
         {"customreg", 'r', "REG",  0, "reg_domain ID int",                         2},
+        {0,           0,   0,      0, "Mock backend:",                             5},
+        {"mock",      OPT_MOCK, 0, 0, "Run against an in-process mac80211_hwsim mock", 5},
+        {"mock-latency-us", OPT_MOCK_LATENCY_US, "US", 0, "Delay of each mock reply",   5},
+        {"mock-fail-every", OPT_MOCK_FAIL_EVERY, "NUM", 0, "Fail every NUM-th mock request", 5},
+        {"mock-errno", OPT_MOCK_ERRNO, "ERRNO", 0, "Error of failed mock requests (default ENODEV)", 5},
         {0,           0,   0,      0, "General:",                                  -1},
+        {"json",      'j', 0,      0, "Print results as JSON (lines)",             -1},
+        {"family-cache", OPT_FAMILY_CACHE, "FILE", OPTION_ARG_OPTIONAL,
+                "Reuse the family id from FILE (default " HWSIM_DEFAULT_FAMILY_CACHE ")", -1},
+        {"timeout-ms", OPT_TIMEOUT_MS, "MS", 0, "Request deadline, 0 = none (default 2000)", -1},
+        {"rcvbuf",    OPT_RCVBUF, "BYTES", 0, "Netlink socket receive buffer size",  -1},
+        {"sndbuf",    OPT_SNDBUF, "BYTES", 0, "Netlink socket send buffer size",     -1},
         {0,           0,   0,      0, 0,                                           0}
 };
-static const char *msg_duplicate_mode = "Exactly one parameter out of -c, -d, -x is required\n";
+static const char *msg_duplicate_mode = "Exactly one parameter out of -c, -d, -x, -k, -l, -b, -D, -S, -R, -J, -A, -B, -G, -W, -P, -M, --delete-* is required\n";
 
 static hwsim_cli_ctx ctx;
 
@@ -41,14 +136,47 @@ static void argp_err_and_usage(const char *err_msg, ...) {
     exit(EXIT_SUCCESS);
 }
 
-uint32_t cli_get_uint32(const char opt, const char *arg) {
+int parse_uint32(const char *arg, uint32_t *out) {
     char *endptr = NULL;
+    errno = 0;
     unsigned long ul = strtoul(arg, &endptr, 10);
     unsigned long parsed_len = endptr - arg;
-    if (strlen(arg) != parsed_len || (ul == ULONG_MAX && errno == ERANGE) || ul > UINT32_MAX) {
-        argp_err_and_usage("-%c requires a positive integer attribute (max 32 bit)\n", opt);
+    if (!*arg || strlen(arg) != parsed_len || (ul == ULONG_MAX && errno == ERANGE) || ul > UINT32_MAX) {
+        return -1;
+    }
+    *out = (uint32_t) ul;
+    return 0;
+}
+
+int parse_rssi(const char *arg, int32_t *out) {
+    char *endptr = NULL;
+    errno = 0;
+    long l = strtol(arg, &endptr, 10);
+    if (!*arg || *endptr || errno == ERANGE || l < HWSIM_RSSI_MIN || l > -HWSIM_RSSI_MIN) {
+        return -1;
     }
-    return (uint32_t) ul;
+    // positive values are attenuations, as taken by earlier versions
+    *out = (int32_t) (l > 0 ? -l : l);
+    return 0;
+}
+
+// long name of the option with key, short letters are shared by several options
+static const char *option_name(int key) {
+    const struct argp_option *opt;
+    for (opt = options; opt->name || opt->doc; opt++) {
+        if (opt->key == key && opt->name) {
+            return opt->name;
+        }
+    }
+    return "?";
+}
+
+uint32_t cli_get_uint32(int key, const char *arg) {
+    uint32_t val;
+    if (parse_uint32(arg, &val)) {
+        argp_err_and_usage("--%s requires a positive integer attribute (max 32 bit)\n", option_name(key));
+    }
+    return val;
 }
 
 error_t hwsim_parse_argp(int key, char *arg, struct argp_state *state) {
@@ -59,7 +187,7 @@ error_t hwsim_parse_argp(int key, char *arg, struct argp_state *state) {
                 argp_err_and_usage(msg_duplicate_mode);
             }
             arguments->mode = HWSIM_OP_DELETE_BY_ID;
-            arguments->del_radio_id = cli_get_uint32('d', arg);
+            arguments->del_radio_id = cli_get_uint32(key, arg);
             break;
         case 'x':
             if (arguments->mode != HWSIM_OP_NONE) {
@@ -72,20 +200,200 @@ error_t hwsim_parse_argp(int key, char *arg, struct argp_state *state) {
             if (arguments->mode != HWSIM_OP_NONE) {
                 argp_err_and_usage(msg_duplicate_mode);
             }
-            arguments->rssi_radio = cli_get_uint32('d', arg);
+            arguments->rssi_radio = cli_get_uint32(key, arg);
             arguments->mode = HWSIM_OP_SET_RSSI;
             break;
+        case 'b':
+            if (arguments->mode != HWSIM_OP_NONE) {
+                argp_err_and_usage(msg_duplicate_mode);
+            }
+            arguments->batch_file = arg;
+            arguments->mode = HWSIM_OP_BATCH;
+            break;
+        case 'D':
+            if (arguments->mode != HWSIM_OP_NONE) {
+                argp_err_and_usage(msg_duplicate_mode);
+            }
+            arguments->daemon_socket = arg;
+            arguments->mode = HWSIM_OP_DAEMON;
+            break;
+        case 'l':
+            if (arguments->mode != HWSIM_OP_NONE) {
+                argp_err_and_usage(msg_duplicate_mode);
+            }
+            arguments->mode = HWSIM_OP_LIST;
+            break;
+        case 'j':
+            arguments->json = true;
+            break;
+        case 'S':
+            if (arguments->mode != HWSIM_OP_NONE) {
+                argp_err_and_usage(msg_duplicate_mode);
+            }
+            arguments->rssi_stream = arg;
+            arguments->mode = HWSIM_OP_RSSI_STREAM;
+            break;
+        case 'R':
+            if (arguments->mode != HWSIM_OP_NONE) {
+                argp_err_and_usage(msg_duplicate_mode);
+            }
+            arguments->replay_file = arg;
+            arguments->mode = HWSIM_OP_REPLAY;
+            break;
+        case 'J':
+            if (arguments->mode != HWSIM_OP_NONE) {
+                argp_err_and_usage(msg_duplicate_mode);
+            }
+            arguments->journal_replay = arg;
+            arguments->mode = HWSIM_OP_JOURNAL_REPLAY;
+            break;
+        case 'A':
+            if (arguments->mode != HWSIM_OP_NONE) {
+                argp_err_and_usage(msg_duplicate_mode);
+            }
+            arguments->topology_file = arg;
+            arguments->mode = HWSIM_OP_APPLY;
+            break;
+        case 'B':
+            if (arguments->mode != HWSIM_OP_NONE) {
+                argp_err_and_usage(msg_duplicate_mode);
+            }
+            arguments->bench_ops = cli_get_uint32(key, arg);
+            arguments->mode = HWSIM_OP_BENCH;
+            break;
+        case 'G':
+            if (arguments->mode != HWSIM_OP_NONE) {
+                argp_err_and_usage(msg_duplicate_mode);
+            }
+            arguments->scale_radios = cli_get_uint32(key, arg);
+            arguments->mode = HWSIM_OP_SCALE;
+            break;
+        case 'W':
+            if (arguments->mode != HWSIM_OP_NONE) {
+                argp_err_and_usage(msg_duplicate_mode);
+            }
+            arguments->mode = HWSIM_OP_WATCH;
+            break;
+        case 'P':
+            if (arguments->mode != HWSIM_OP_NONE) {
+                argp_err_and_usage(msg_duplicate_mode);
+            }
+            arguments->mode = HWSIM_OP_PROBE;
+            break;
+        case 'M':
+            if (arguments->mode != HWSIM_OP_NONE) {
+                argp_err_and_usage(msg_duplicate_mode);
+            }
+            arguments->medium_file = arg;
+            arguments->mode = HWSIM_OP_MEDIUM;
+            break;
+        case OPT_DELETE_ALL:
+        case OPT_DELETE_MATCHING:
+        case OPT_DELETE_SESSION:
+            if (arguments->mode != HWSIM_OP_NONE) {
+                argp_err_and_usage(msg_duplicate_mode);
+            }
+            arguments->teardown_pattern = arg;
+            arguments->teardown_session = key == OPT_DELETE_SESSION;
+            arguments->mode = HWSIM_OP_TEARDOWN;
+            break;
+        case OPT_REGEX:
+            arguments->teardown_regex = true;
+            break;
+        case OPT_PCAP:
+            arguments->pcap_file = arg;
+            break;
+        case OPT_JOURNAL:
+            arguments->journal_file = arg;
+            break;
+        case OPT_FAST:
+            arguments->journal_fast = true;
+            break;
+        case OPT_STEP:
+            arguments->scale_step = cli_get_uint32(key, arg);
+            break;
+        case OPT_INFLIGHT:
+            arguments->scale_inflight = cli_get_uint32(key, arg);
+            break;
+        case OPT_KERNEL_STATS:
+            arguments->scale_kernel = true;
+            break;
+        case OPT_BENCH_MAX_P99_US:
+            arguments->bench_max_p99_us = cli_get_uint32(key, arg);
+            break;
         case 'c':
             if (arguments->mode != HWSIM_OP_NONE) {
                 argp_err_and_usage(msg_duplicate_mode);
             }
             arguments->mode = HWSIM_OP_CREATE;
             break;
+        case 'w':
+            arguments->window = cli_get_uint32(key, arg);
+            break;
+        case 'p':
+            arguments->sockets = cli_get_uint32(key, arg);
+            break;
+        case OPT_TRANSACTION:
+            if (!arguments->max_failures) {
+                arguments->max_failures = 1;
+            }
+            break;
+        case OPT_MAX_FAILURES:
+            arguments->max_failures = cli_get_uint32(key, arg);
+            if (!arguments->max_failures) {
+                argp_err_and_usage("--max-failures requires at least 1\n");
+            }
+            break;
+        case OPT_SESSION:
+            arguments->session = true;
+            break;
+        case OPT_PREWARM:
+            arguments->prewarm = cli_get_uint32(key, arg);
+            break;
+        case OPT_PREWARM_LOW:
+            arguments->prewarm_low = cli_get_uint32(key, arg);
+            break;
+        case OPT_TIMEOUT_MS:
+            arguments->timeout_ms = cli_get_uint32(key, arg);
+            break;
+        case OPT_TICK_MS:
+            arguments->tick_ms = cli_get_uint32(key, arg);
+            break;
+        case OPT_FREQ:
+            arguments->s_props.freq = cli_get_uint32(key, arg);
+            arguments->s_props.set |= HWSIM_PROP_FREQ;
+            break;
+        case OPT_TX_INFO:
+            if (parse_tx_info(arg, &arguments->s_props)) {
+                argp_err_and_usage("--txinfo requires up to %d IDX:COUNT pairs\n", HWSIM_TX_MAX_RATES);
+            }
+            break;
+        case OPT_FAMILY_CACHE:
+            arguments->family_cache = arg ? arg : HWSIM_DEFAULT_FAMILY_CACHE;
+            break;
+        case OPT_RCVBUF:
+            arguments->rcvbuf = cli_get_uint32(key, arg);
+            break;
+        case OPT_SNDBUF:
+            arguments->sndbuf = cli_get_uint32(key, arg);
+            break;
+        case OPT_MOCK:
+            arguments->mock = true;
+            break;
+        case OPT_MOCK_LATENCY_US:
+            arguments->mock_latency_us = cli_get_uint32(key, arg);
+            break;
+        case OPT_MOCK_FAIL_EVERY:
+            arguments->mock_fail_every = cli_get_uint32(key, arg);
+            break;
+        case OPT_MOCK_ERRNO:
+            arguments->mock_errno = cli_get_uint32(key, arg);
+            break;
         case 'n':
             arguments->c_hwname = arg;
             break;
         case 'o':
-            arguments->c_channels = cli_get_uint32('o', arg);
+            arguments->c_channels = cli_get_uint32(key, arg);
             break;
         case 'v':
             arguments->c_no_vif = true;
@@ -97,12 +405,25 @@ error_t hwsim_parse_argp(int key, char *arg, struct argp_state *state) {
             arguments->c_reg_alpha2 = arg;
             break;
         case 'r':
-            arguments->c_reg_custom_reg = cli_get_uint32('r', arg);
+            arguments->c_reg_custom_reg = cli_get_uint32(key, arg);
             break;
         case 'h':
             argp_help(&ctx.hwsim_argp, stdout, ARGP_HELP_STD_HELP, program_executable);
             exit(EXIT_SUCCESS);
         case ARGP_KEY_ARG:
+            if (arguments->mode == HWSIM_OP_SET_RSSI && !(arguments->s_props.set & HWSIM_PROP_SIGNAL)) {
+                if (parse_rssi(arg, &arguments->rssi_dbm)) {
+                    argp_err_and_usage("-k requires an RSSI between %d and 0 dBm\n", HWSIM_RSSI_MIN);
+                }
+                arguments->s_props.set |= HWSIM_PROP_SIGNAL;
+                return 0;
+            }
+            argp_usage(state);
+            return 0;
+        case ARGP_KEY_END:
+            if (arguments->mode == HWSIM_OP_SET_RSSI && !arguments->s_props.set) {
+                argp_err_and_usage("-k requires an RSSI, --freq or --txinfo\n");
+            }
             return 0;
         default:
             return ARGP_ERR_UNKNOWN;
@@ -110,70 +431,178 @@ error_t hwsim_parse_argp(int key, char *arg, struct argp_state *state) {
     return 0;
 }
 
+static int initNetlink() {
+    if (init_netlink(&ctx.nl_ctx, &ctx.config)) {
+        fprintf(stderr, "Error initializing netlink context: %s\n", ctx.nl_ctx.error);
+        return -1;
+    }
+    return 0;
+}
+
+static int initEngine(const hwsim_args *args) {
+    int ret;
+    if ((ret = init_engine(&ctx.engine, &ctx.nl_ctx, args->window, args->timeout_ms))) {
+        fprintf(stderr, "Error initializing engine: %s\n", strerror(-ret));
+        return -1;
+    }
+    return 0;
+}
+
+static int initPool(const hwsim_args *args) {
+    if (init_pool(&ctx.pool, &ctx.config, args->sockets, args->window, args->timeout_ms)) {
+        fprintf(stderr, "%s\n", ctx.pool.error);
+        return -1;
+    }
+    return 0;
+}
+
+static int registerCallbacks() {
+    int ret;
+    if ((ret = register_callbacks(&ctx.engine))) {
+        fprintf(stderr, "Error registering events: %s\n", strerror(-ret));
+        return -1;
+    }
+    return 0;
+}
+
 static int prepareCommand() {
-    if (init_netlink(&ctx.nl_ctx)) {
-        fprintf(stderr, "Error initializing netlink context!\n");
+    int ret;
+    if (initNetlink() || initEngine(&ctx.args)) {
         return -1;
     }
-    if (register_event(&ctx)) {
-        fprintf(stderr, "Error registering events!\n");
+    if ((ret = register_event(&ctx.engine))) {
+        fprintf(stderr, "Error registering events: %s\n", strerror(-ret));
         return -1;
     }
     return 0;
 }
 
-int handleCreate(const hwsim_args *args) {
+static int submitCommand(const hwsim_args *args) {
     int ret;
     if ((ret = prepareCommand())) {
         return ret;
     };
-    if ((ret = create_radio(&ctx.nl_ctx, args->c_channels, args->c_no_vif, args->c_hwname, args->c_use_chanctx,
-                            args->c_reg_alpha2,
-                            args->c_reg_custom_reg))) {
+    if ((ret = submit_request(&ctx.engine, args, notify_request_done, NULL))) {
         return ret;
     }
-    return wait_for_event();
+    wait_for_event(&ctx.engine);
+    return ctx.status;
+}
+
+int handleCreate(const hwsim_args *args) {
+    return submitCommand(args);
 }
 
 int handleDeleteById(const hwsim_args *args) {
-    int ret;
-    if ((ret = prepareCommand())) {
-        return ret;
-    };
     printf("Deleting radio with id '%d'...\n", args->del_radio_id);
-    if ((ret = delete_radio_by_id(&ctx.nl_ctx, args->del_radio_id))) {
-        return ret;
-    }
-    return wait_for_event();
+    return submitCommand(args);
 }
 
 int handleDeleteByName(const hwsim_args *args) {
-    int ret;
-    if ((ret = prepareCommand())) {
-        return ret;
-    };
     printf("Deleting radio with name '%s'...\n", args->del_radio_name);
-    if ((ret = delete_radio_by_name(&ctx.nl_ctx, args->del_radio_name))) {
-        return ret;
+    return submitCommand(args);
+}
+
+int handleSetRSSI(const hwsim_args *args) {
+    hwsim_args op = *args;
+    hwsim_props props = args->s_props;
+    if (props.set == HWSIM_PROP_SIGNAL) {
+        return submitCommand(&op);
     }
-    return wait_for_event();
+    // frequency and TX info go out in the same message as the signal
+    props.radio_id = args->rssi_radio;
+    props.signal = args->rssi_dbm;
+    op.mode = HWSIM_OP_SET_PROPS;
+    op.props = &props;
+    op.props_count = 1;
+    return submitCommand(&op);
 }
 
-int handleSetRSSI(const hwsim_args *args, char *rssi) {
+int handleBatch(const hwsim_args *args) {
     int ret;
-    if ((ret = prepareCommand())) {
-        return ret;
-    };
+    FILE *in = stdin;
+    if (strcmp(args->batch_file, "-") != 0) {
+        in = fopen(args->batch_file, "r");
+        if (!in) {
+            fprintf(stderr, "Cannot open batch file '%s': %s\n", args->batch_file, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+    if (initPool(args)) {
+        return EXIT_FAILURE;
+    }
+    ret = run_batch(&ctx.pool, in, args->json, args->max_failures);
+    free_pool(&ctx.pool);
+    if (in != stdin) {
+        fclose(in);
+    }
+    return ret;
+}
 
-    if ((ret = set_rssi(&ctx.nl_ctx, args->rssi_radio, cli_get_uint32('d', rssi)))) {
-        return ret;
+int handleDaemon(const hwsim_args *args) {
+    if (initNetlink()) {
+        return EXIT_FAILURE;
+    }
+    // spares are renamed through nl80211; resolved while the socket still blocks
+    if (args->prewarm && resolve_nl80211(&ctx.nl_ctx)) {
+        fprintf(stderr, "%s\n", ctx.nl_ctx.error);
+        return EXIT_FAILURE;
+    }
+    // replies are dispatched by the daemon's own event loop
+    if (initEngine(args) || registerCallbacks()) {
+        return EXIT_FAILURE;
+    }
+    return run_daemon(&ctx.engine, args->daemon_socket, args->session,
+                      args->prewarm_low == UINT32_MAX ? args->prewarm / 2 : args->prewarm_low, args->prewarm);
+}
+
+int handleRSSIStream(const hwsim_args *args) {
+    int ret;
+    int fd = STDIN_FILENO;
+    if (strcmp(args->rssi_stream, "-") != 0) {
+        fd = open(args->rssi_stream, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "Cannot open RSSI stream '%s': %s\n", args->rssi_stream, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+    if (prepareCommand()) {
+        return EXIT_FAILURE;
+    }
+    ret = run_rssi_stream(&ctx.engine, fd, args->tick_ms);
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    return ret;
+}
+
+int handleReplay(const hwsim_args *args) {
+    if (prepareCommand()) {
+        return EXIT_FAILURE;
     }
-    return wait_for_event();
+    return run_rssi_replay(&ctx.engine, args->replay_file);
+}
+
+int handleList(const hwsim_args *args) {
+    radio_index index;
+    int ret;
+    if (prepareCommand()) {
+        return EXIT_FAILURE;
+    }
+    init_radio_index(&index);
+    if ((ret = load_radio_index(&ctx.engine, &index))) {
+        print_list_error(stderr, ret);
+        free_radio_index(&index);
+        return EXIT_FAILURE;
+    }
+    print_radios(&index, stdout, args->json);
+    free_radio_index(&index);
+    return EXIT_SUCCESS;
 }
 
 void notify_device_creation(int id) {
     printf("Created device with ID %d\n", id);
-    exit(EXIT_SUCCESS);
+    ctx.status = EXIT_SUCCESS;
 }
 
 void notify_device_deletion() {
@@ -182,47 +611,364 @@ void notify_device_deletion() {
     } else {
         printf("Successfully deleted device with name '%s'\n", ctx.args.del_radio_name);
     }
-    exit(EXIT_SUCCESS);
+    ctx.status = EXIT_SUCCESS;
 }
 
 void notify_device_setRSSI() {
     if (ctx.args.mode == HWSIM_OP_SET_RSSI) {
         printf("new SSID defined to interface %d\n", ctx.args.rssi_radio);
     }
-    exit(EXIT_SUCCESS);
+    ctx.status = EXIT_SUCCESS;
+}
+
+void notify_device_error(int err) {
+    if (err == -ETIMEDOUT) {
+        fprintf(stderr, "Did not receive netlink event after %u ms\n", ctx.args.timeout_ms);
+    } else if (ctx.args.mode == HWSIM_OP_CREATE) {
+        fprintf(stderr, "Unknown error on device creation with errid %d\nstrerror: %s\n", err, strerror(abs(err)));
+    } else if (err == -ENODEV) {
+        fprintf(stderr, "Device not found\n");
+    } else if (ctx.args.mode == HWSIM_OP_SET_RSSI) {
+        fprintf(stderr, "Unknown error while setting RSSI with errid %d\nstrerror: %s\n", err, strerror(abs(err)));
+    } else {
+        fprintf(stderr, "Unknown error on device deletion with errid %d\nstrerror: %s\n", err, strerror(abs(err)));
+    }
+    ctx.status = EXIT_FAILURE;
+}
+
+void notify_request_done(const hwsim_request *req, void *arg) {
+    UNUSED(arg);
+    if (ctx.args.json) {
+        print_request_json(stdout, 0, req);
+        ctx.status = req->error < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    } else if (req->error < 0) {
+        notify_device_error(req->error);
+    } else if (req->mode == HWSIM_OP_CREATE) {
+        notify_device_creation(req->radio_id);
+    } else if (req->mode == HWSIM_OP_DELETE_BY_ID || req->mode == HWSIM_OP_DELETE_BY_NAME) {
+        notify_device_deletion();
+    } else if (req->mode == HWSIM_OP_SET_RSSI || req->mode == HWSIM_OP_SET_PROPS) {
+        notify_device_setRSSI();
+    }
+}
+
+int handleApply(const hwsim_args *args) {
+    int ret;
+    FILE *in = stdin;
+    if (strcmp(args->topology_file, "-") != 0) {
+        in = fopen(args->topology_file, "r");
+        if (!in) {
+            fprintf(stderr, "Cannot open topology file '%s': %s\n", args->topology_file, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+    if (prepareCommand()) {
+        return EXIT_FAILURE;
+    }
+    ret = apply_topology(&ctx.engine, in);
+    if (in != stdin) {
+        fclose(in);
+    }
+    return ret;
+}
+
+int handleBench(const hwsim_args *args) {
+    int ret;
+    if (initPool(args)) {
+        return EXIT_FAILURE;
+    }
+    ret = run_bench(&ctx.pool, args->bench_ops, args->bench_max_p99_us);
+    free_pool(&ctx.pool);
+    return ret;
+}
+
+int handleScale(const hwsim_args *args) {
+    int ret;
+    if (initPool(args)) {
+        return EXIT_FAILURE;
+    }
+    ret = run_scale(&ctx.pool, args);
+    free_pool(&ctx.pool);
+    return ret;
+}
+
+int handleMedium(const hwsim_args *args) {
+    int ret;
+    FILE *in = stdin;
+    if (strcmp(args->medium_file, "-") != 0) {
+        in = fopen(args->medium_file, "r");
+        if (!in) {
+            fprintf(stderr, "Cannot open link file '%s': %s\n", args->medium_file, strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+    // frames are received directly from the socket, not through an engine
+    if (initNetlink()) {
+        ret = EXIT_FAILURE;
+    } else {
+        ret = run_medium(&ctx.nl_ctx, in, args->pcap_file);
+    }
+    free_netlink(&ctx.nl_ctx);
+    if (in != stdin) {
+        fclose(in);
+    }
+    return ret;
+}
+
+int handleJournalReplay(const hwsim_args *args) {
+    // replies are dispatched by the replay's own event loop
+    if (initNetlink() || initEngine(args) || registerCallbacks()) {
+        return EXIT_FAILURE;
+    }
+    return run_journal_replay(&ctx.engine, args->journal_replay, args->journal_fast, args->json);
+}
+
+int handleTeardown(const hwsim_args *args) {
+    enum teardown_match match = TEARDOWN_ALL;
+    int ret;
+    if (args->teardown_session) {
+        match = TEARDOWN_SESSION;
+    } else if (args->teardown_pattern) {
+        match = args->teardown_regex ? TEARDOWN_REGEX : TEARDOWN_GLOB;
+    }
+    if (initPool(args)) {
+        return EXIT_FAILURE;
+    }
+    ret = run_teardown(&ctx.pool, match, args->teardown_pattern, args->json);
+    free_pool(&ctx.pool);
+    return ret;
+}
+
+static void print_radio_event(uint8_t cmd, const hwsim_radio *radio, void *arg) {
+    const hwsim_args *args = arg;
+    const char *event = cmd == HWSIM_CMD_NEW_RADIO ? "new" : "del";
+    if (args->json) {
+        printf("{\"event\":\"%s\",\"radio\":", event);
+        print_radio_json(radio, stdout);
+        printf("}\n");
+    } else {
+        printf("%s %u %s\n", event, radio->id, radio->name);
+    }
+    fflush(stdout);
+}
+
+int handleWatch(const hwsim_args *args) {
+    radio_watch watch;
+    int ret;
+    if (prepareCommand()) {
+        return EXIT_FAILURE;
+    }
+    if ((ret = start_radio_watch(&watch, &ctx.engine, print_radio_event, (void *) args))) {
+        print_list_error(stderr, ret);
+        return EXIT_FAILURE;
+    }
+    if (!watch.live) {
+        stop_radio_watch(&watch);
+        return EXIT_FAILURE;
+    }
+    pthread_mutex_lock(&watch.lock);
+    print_radios(&watch.index, stdout, args->json);
+    fflush(stdout);
+    pthread_mutex_unlock(&watch.lock);
+    // events are printed by the event thread until the process is killed
+    for (;;) {
+        pause();
+    }
+}
+
+static const char *const cmd_names[] = {
+        "unspec", "register", "frame", "tx_info_frame", "new_radio", "del_radio", "get_radio"
+};
+
+static const struct {
+    uint32_t attr;
+    const char *name;
+} probed_attrs[] = {
+        {HWSIM_ATTR_USE_CHANCTX,               "use_chanctx"},
+        {HWSIM_ATTR_DESTROY_RADIO_ON_CLOSE,    "destroy_radio_on_close"},
+        {HWSIM_ATTR_RADIO_NAME,                "radio_name"},
+        {HWSIM_ATTR_NO_VIF,                    "no_vif"},
+        {HWSIM_ATTR_FREQ,                      "freq"}
+};
+
+static void print_family(const hwsim_family *family, bool json) {
+    const char *sep = "";
+    uint32_t cmd;
+    size_t i;
+
+    printf(json ? "{\"family\":\"%s\",\"id\":%u,\"version\":%u,\"maxattr\":%u,\"commands\":["
+                : "family %s id %u version %u maxattr %u\ncommands:", HWSIM_FAMILY_NAME, family->id,
+           family->version, family->maxattr);
+    for (cmd = 0; cmd < 64; cmd++) {
+        if (!(family->cmds & (1ull << cmd))) {
+            continue;
+        }
+        if (cmd < sizeof(cmd_names) / sizeof(cmd_names[0])) {
+            printf(json ? "%s\"%s\"" : "%s %s", sep, cmd_names[cmd]);
+        } else {
+            printf(json ? "%s%u" : "%s %u", sep, cmd);
+        }
+        sep = json ? "," : "";
+    }
+    printf(json ? "],\"config_group\":%u,\"attributes\":{" : "\nconfig group: %u\nattributes:",
+           family->config_group);
+    for (i = 0; i < sizeof(probed_attrs) / sizeof(probed_attrs[0]); i++) {
+        bool supported = probed_attrs[i].attr <= family->maxattr;
+        printf(json ? "%s\"%s\":%s" : "%s %s=%s", i && json ? "," : "", probed_attrs[i].name,
+               supported ? (json ? "true" : "yes") : (json ? "false" : "no"));
+    }
+    // the Set RSSI patch reuses HWSIM_CMD_GET_RADIO, the controller does not announce it
+    printf(json ? "}}\n" : "\nset rssi: not announced by the kernel\n");
+}
+
+int handleProbe(const hwsim_args *args) {
+    if (args->family_cache) {
+        // resolve again and store the fresh result
+        unlink(args->family_cache);
+    }
+    if (initNetlink()) {
+        return EXIT_FAILURE;
+    }
+    print_family(&ctx.nl_ctx.family, args->json);
+    free_netlink(&ctx.nl_ctx);
+    return EXIT_SUCCESS;
+}
+
+static int startMock(const hwsim_args *args) {
+    hwsim_mock_config config = {args->mock_latency_us, args->mock_fail_every, (int) args->mock_errno};
+    if (start_mock(&ctx.mock, &config)) {
+        return -1;
+    }
+    ctx.config.mock_port = ctx.mock.port;
+    return 0;
+}
+
+static int runMode(const hwsim_args *args) {
+    switch (args->mode) {
+        case HWSIM_OP_CREATE:
+            return handleCreate(args);
+        case HWSIM_OP_DELETE_BY_ID:
+            return handleDeleteById(args);
+        case HWSIM_OP_DELETE_BY_NAME:
+            return handleDeleteByName(args);
+        case HWSIM_OP_SET_RSSI:
+            return handleSetRSSI(args);
+        case HWSIM_OP_BATCH:
+            return handleBatch(args);
+        case HWSIM_OP_DAEMON:
+            return handleDaemon(args);
+        case HWSIM_OP_RSSI_STREAM:
+            return handleRSSIStream(args);
+        case HWSIM_OP_PROBE:
+            return handleProbe(args);
+        case HWSIM_OP_REPLAY:
+            return handleReplay(args);
+        case HWSIM_OP_LIST:
+            return handleList(args);
+        case HWSIM_OP_APPLY:
+            return handleApply(args);
+        case HWSIM_OP_BENCH:
+            return handleBench(args);
+        case HWSIM_OP_SCALE:
+            return handleScale(args);
+        case HWSIM_OP_WATCH:
+            return handleWatch(args);
+        case HWSIM_OP_TEARDOWN:
+            return handleTeardown(args);
+        case HWSIM_OP_MEDIUM:
+            return handleMedium(args);
+        case HWSIM_OP_JOURNAL_REPLAY:
+            return handleJournalReplay(args);
+        case HWSIM_OP_NONE:
+        case HWSIM_OP_LOOKUP:
+        case HWSIM_OP_SET_PROPS:
+        case HWSIM_OP_RENAME:
+            argp_err_and_usage(msg_duplicate_mode);
+            break;
+    }
+    return EXIT_FAILURE;
 }
 
 int main(int argc, char **argv) {
+    int ret;
     hwsim_args args = {
             .mode = HWSIM_OP_NONE,
             .c_hwname = NULL,
             .c_channels = 0,
             .c_no_vif = false,
             .c_use_chanctx = false,
+            .c_destroy_on_close = false,
             .c_reg_alpha2 = NULL,
             .c_reg_custom_reg = 0,
             .del_radio_id = 0,
             .del_radio_name = NULL,
-            .rssi_radio = 0
+            .rssi_radio = 0,
+            .rssi_dbm = 0,
+            .props = NULL,
+            .props_count = 0,
+            .batch_file = NULL,
+            .daemon_socket = NULL,
+            .rssi_stream = NULL,
+            .topology_file = NULL,
+            .replay_file = NULL,
+            .medium_file = NULL,
+            .pcap_file = NULL,
+            .journal_file = NULL,
+            .journal_replay = NULL,
+            .journal_fast = false,
+            .bench_ops = 0,
+            .bench_max_p99_us = 0,
+            .scale_radios = 0,
+            .scale_step = 0,
+            .scale_inflight = 1,
+            .scale_kernel = false,
+            .tick_ms = HWSIM_DEFAULT_TICK_MS,
+            .json = false,
+            .window = HWSIM_DEFAULT_WINDOW,
+            .sockets = 1,
+            .max_failures = 0,
+            .session = false,
+            .prewarm = 0,
+            .teardown_pattern = NULL,
+            .teardown_regex = false,
+            .teardown_session = false,
+            .prewarm_low = UINT32_MAX,
+            .timeout_ms = HWSIM_DEFAULT_TIMEOUT_MS,
+            .family_cache = NULL,
+            .rcvbuf = 0,
+            .sndbuf = 0,
+            .mock = false,
+            .mock_latency_us = 0,
+            .mock_fail_every = 0,
+            .mock_errno = ENODEV
     };
 
     ctx.args = args;
+    ctx.status = EXIT_FAILURE;
     struct argp hwsim_argp = {options, hwsim_parse_argp, 0, doc, 0, 0, 0};
     ctx.hwsim_argp = hwsim_argp;
 
     argp_parse(&hwsim_argp, argc, argv, 0, 0, &ctx.args);
-    switch (ctx.args.mode) {
-        case HWSIM_OP_CREATE:
-            return handleCreate(&ctx.args);
-        case HWSIM_OP_DELETE_BY_ID:
-            return handleDeleteById(&ctx.args);
-        case HWSIM_OP_DELETE_BY_NAME:
-            return handleDeleteByName(&ctx.args);
-        case HWSIM_OP_SET_RSSI:
-            return handleSetRSSI(&ctx.args, argv[3]);
-        case HWSIM_OP_NONE:
-            argp_err_and_usage(msg_duplicate_mode);
-            break;
+    ctx.config.family_cache = ctx.args.family_cache;
+    ctx.config.rcvbuf = ctx.args.rcvbuf;
+    ctx.config.sndbuf = ctx.args.sndbuf;
+    if (ctx.args.mock && startMock(&ctx.args)) {
+        return EXIT_FAILURE;
     }
-    return EXIT_FAILURE;
+    if (ctx.args.journal_file) {
+        if ((ret = open_journal(&ctx.journal, ctx.args.journal_file))) {
+            fprintf(stderr, "Cannot create journal '%s': %s\n", ctx.args.journal_file, strerror(-ret));
+            return EXIT_FAILURE;
+        }
+        ctx.config.journal = &ctx.journal;
+    }
+    ret = runMode(&ctx.args);
+    if (ctx.args.journal_file) {
+        int error = close_journal(&ctx.journal);
+        if (error) {
+            fprintf(stderr, "Error writing journal '%s': %s\n", ctx.args.journal_file, strerror(-error));
+            ret = EXIT_FAILURE;
+        }
+    }
+    return ret;
 }
@@ -9,41 +9,64 @@
 #include <stdbool.h>
 #include <argp.h>
 #include "hwsim_mgmt_func.h"
-
-enum op_mode {
-    HWSIM_OP_NONE,
-    HWSIM_OP_CREATE,
-    HWSIM_OP_DELETE_BY_ID,
-    HWSIM_OP_DELETE_BY_NAME,
-    HWSIM_OP_SET_RSSI
-};
-
-typedef struct {
-    enum op_mode mode;
-    char *c_hwname;
-    uint32_t c_channels;
-    bool c_no_vif;
-    bool c_use_chanctx;
-    char *c_reg_alpha2;
-    uint32_t c_reg_custom_reg;
-    uint32_t del_radio_id;
-    char *del_radio_name;
-    uint32_t rssi_radio;
-} hwsim_args;
+#include "hwsim_mgmt_event.h"
+#include "hwsim_mgmt_pool.h"
+#include "hwsim_mgmt_mock.h"
+#include "hwsim_mgmt_journal.h"
 
 typedef struct {
     struct argp hwsim_argp;
     hwsim_args args;
+    hwsim_config config;
     netlink_ctx nl_ctx;
+    hwsim_engine engine;
+    hwsim_pool pool;
+    hwsim_mock mock;
+    hwsim_journal journal;
+    int status;
 } hwsim_cli_ctx;
 
+int parse_uint32(const char *arg, uint32_t *out);
+
+/*
+ * Parses an RSSI in dBm (HWSIM_RSSI_MIN..0). Positive values are taken as
+ * attenuation and negated, so "60" and "-60" are the same.
+ */
+int parse_rssi(const char *arg, int32_t *out);
+
 int handleCreate(const hwsim_args *args);
 
 int handleDeleteById(const hwsim_args *args);
 
 int handleDeleteByName(const hwsim_args *args);
 
-int handleSetRSSI(const hwsim_args *args, char *rssi);
+int handleSetRSSI(const hwsim_args *args);
+
+int handleBatch(const hwsim_args *args);
+
+int handleDaemon(const hwsim_args *args);
+
+int handleRSSIStream(const hwsim_args *args);
+
+int handleReplay(const hwsim_args *args);
+
+int handleList(const hwsim_args *args);
+
+int handleApply(const hwsim_args *args);
+
+int handleBench(const hwsim_args *args);
+
+int handleScale(const hwsim_args *args);
+
+int handleWatch(const hwsim_args *args);
+
+int handleProbe(const hwsim_args *args);
+
+int handleTeardown(const hwsim_args *args);
+
+int handleMedium(const hwsim_args *args);
+
+int handleJournalReplay(const hwsim_args *args);
 
 void notify_device_creation(int id);
 
@@ -51,4 +74,8 @@ void notify_device_deletion();
 
 void notify_device_setRSSI();
 
+void notify_device_error(int err);
+
+void notify_request_done(const hwsim_request *req, void *arg);
+
 #endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_H
@@ -0,0 +1,464 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#include <netlink/netlink.h>
+#include <event2/event.h>
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/listener.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "hwsim_mgmt_daemon.h"
+#include "hwsim_mgmt_batch.h"
+#include "hwsim_mgmt_prewarm.h"
+
+#define DAEMON_DEADLINE_CHECK_MS 50
+
+typedef struct {
+    hwsim_engine *engine;
+    // radios known to the daemon, kept up to date with its own operations
+    // and the kernel's notifications about everybody else's
+    radio_watch watch;
+    // NULL without --prewarm
+    radio_prewarm *prewarm;
+    bool session;
+    // clients that stopped reading while the window was full
+    struct daemon_client *stalled;
+    struct event *ev_resume;
+} daemon_ctx;
+
+typedef struct daemon_client {
+    daemon_ctx *daemon;
+    struct bufferevent *bev;
+    unsigned long line_no;
+    unsigned long pending;
+    bool stalled;
+    struct daemon_client *next_stalled;
+} daemon_client;
+
+typedef struct {
+    daemon_client *client;
+    unsigned long line_no;
+    hwsim_radio radio;
+    // create served by renaming the spare radio.id
+    bool prewarmed;
+} daemon_request;
+
+static void release_client(daemon_client *client) {
+    if (!client->bev && !client->pending) {
+        free(client);
+    }
+}
+
+static void reply(daemon_client *client, unsigned long line_no, enum op_mode mode, int error, int radio_id) {
+    if (!client->bev) {
+        return;
+    }
+    if (error < 0) {
+        evbuffer_add_printf(bufferevent_get_output(client->bev), "%lu %s err %d %s\n", line_no, op_name(mode),
+                            error, strerror(abs(error)));
+    } else {
+        evbuffer_add_printf(bufferevent_get_output(client->bev), "%lu %s ok %d\n", line_no, op_name(mode),
+                            radio_id);
+    }
+}
+
+static void update_index(radio_watch *watch, const hwsim_request *req, daemon_request *dreq) {
+    radio_index *index = &watch->index;
+    const hwsim_radio *radio;
+    // with notifications the kernel already announced the change
+    if (req->error < 0 || watch->live) {
+        return;
+    }
+    pthread_mutex_lock(&watch->lock);
+    if (req->mode == HWSIM_OP_CREATE) {
+        dreq->radio.id = (uint32_t) req->radio_id;
+        put_radio(index, &dreq->radio);
+    } else if (req->mode == HWSIM_OP_DELETE_BY_ID) {
+        remove_radio(index, dreq->radio.id);
+    } else if (req->mode == HWSIM_OP_DELETE_BY_NAME && (radio = find_radio_by_name(index, dreq->radio.name))) {
+        remove_radio(index, radio->id);
+    }
+    pthread_mutex_unlock(&watch->lock);
+}
+
+/*
+ * The kernel announces no wiphy renames, so the index learns the new name
+ * of a handed out spare here.
+ */
+static void prewarmed_done(radio_watch *watch, radio_prewarm *prewarm, const hwsim_request *req,
+                           daemon_request *dreq) {
+    const hwsim_radio *radio;
+    hwsim_radio renamed;
+    if (req->error < 0) {
+        return_prewarmed(prewarm, dreq->radio.id);
+        return;
+    }
+    keep_prewarmed(prewarm);
+    pthread_mutex_lock(&watch->lock);
+    if ((radio = find_radio_by_id(&watch->index, dreq->radio.id))) {
+        renamed = *radio;
+        strcpy(renamed.name, dreq->radio.name);
+        remove_radio(&watch->index, renamed.id);
+        put_radio(&watch->index, &renamed);
+    }
+    pthread_mutex_unlock(&watch->lock);
+}
+
+/*
+ * Stops reading from client until a request completes. The line that did
+ * not fit stays in the input buffer.
+ */
+static void stall_client(daemon_client *client) {
+    daemon_ctx *daemon = client->daemon;
+    bufferevent_disable(client->bev, EV_READ);
+    client->stalled = true;
+    client->next_stalled = daemon->stalled;
+    daemon->stalled = client;
+}
+
+static void unstall_client(daemon_client *client) {
+    daemon_client **prev = &client->daemon->stalled;
+    while (*prev && *prev != client) {
+        prev = &(*prev)->next_stalled;
+    }
+    if (*prev) {
+        *prev = client->next_stalled;
+    }
+    client->stalled = false;
+}
+
+static void resume_stalled(void *arg) {
+    daemon_ctx *daemon = arg;
+    // the slot is only free once the request's callback returned
+    if (daemon->stalled) {
+        event_active(daemon->ev_resume, 0, 0);
+    }
+}
+
+static void daemon_request_done(const hwsim_request *req, void *arg) {
+    daemon_request *dreq = arg;
+    daemon_client *client = dreq->client;
+    daemon_ctx *daemon = client->daemon;
+    if (dreq->prewarmed) {
+        prewarmed_done(&client->daemon->watch, client->daemon->prewarm, req, dreq);
+        reply(client, dreq->line_no, HWSIM_OP_CREATE, req->error, req->error < 0 ? -1 : (int) dreq->radio.id);
+    } else {
+        update_index(&client->daemon->watch, req, dreq);
+        reply(client, dreq->line_no, req->mode, req->error, req->radio_id);
+    }
+    client->pending--;
+    free(dreq);
+    release_client(client);
+    resume_stalled(daemon);
+}
+
+/*
+ * Hands out a spare for a matching create. Unnamed radios are answered
+ * right away, named ones once the spare's wiphy carries the name. Returns
+ * 1 if served, 0 if the create has to go to the kernel and -EBUSY if the
+ * window is full.
+ */
+static int serve_prewarmed(daemon_client *client, hwsim_args *op, daemon_request *dreq) {
+    radio_prewarm *prewarm = client->daemon->prewarm;
+    uint32_t radio_id, wiphy_idx;
+    int ret;
+
+    if (!prewarm || !prewarm_serves(prewarm, op) || take_prewarmed(prewarm, &radio_id, &wiphy_idx)) {
+        return 0;
+    }
+    if (!op->c_hwname) {
+        keep_prewarmed(prewarm);
+        reply(client, client->line_no, HWSIM_OP_CREATE, 0, (int) radio_id);
+        free(dreq);
+        return 1;
+    }
+    dreq->prewarmed = true;
+    dreq->radio.id = radio_id;
+    memset(op, 0, sizeof(*op));
+    op->mode = HWSIM_OP_RENAME;
+    op->wiphy_idx = wiphy_idx;
+    op->new_name = dreq->radio.name;
+    client->pending++;
+    if ((ret = submit_request(client->daemon->engine, op, daemon_request_done, dreq))) {
+        client->pending--;
+        return_prewarmed(prewarm, radio_id);
+        free(dreq);
+        if (ret == -EBUSY) {
+            return -EBUSY;
+        }
+        reply(client, client->line_no, HWSIM_OP_CREATE, -EIO, -1);
+    }
+    return 1;
+}
+
+/*
+ * Returns -EBUSY if the line's request did not fit into the window, it
+ * has to be handled again later.
+ */
+static int handle_line(daemon_client *client, char *line) {
+    hwsim_args op;
+    hwsim_props props[HWSIM_PROPS_MAX];
+    daemon_request *dreq;
+    char stats[160];
+    int ret;
+
+    if (!strcmp(line, "stats")) {
+        struct evbuffer *out = bufferevent_get_output(client->bev);
+        print_overrun_stats(client->daemon->engine, 1, stats, sizeof(stats));
+        evbuffer_add_printf(out, "%lu stats ok %s", client->line_no, stats);
+        if (client->daemon->prewarm) {
+            print_prewarm_stats(client->daemon->prewarm, stats, sizeof(stats));
+            evbuffer_add_printf(out, " %s", stats);
+        }
+        evbuffer_add(out, "\n", 1);
+        return 0;
+    }
+    if (parse_batch_line(line, &op, props)) {
+        reply(client, client->line_no, HWSIM_OP_NONE, -EINVAL, -1);
+        return 0;
+    }
+    if (op.mode == HWSIM_OP_NONE) {
+        return 0;
+    }
+    if (op.mode == HWSIM_OP_CREATE && client->daemon->session) {
+        op.c_destroy_on_close = true;
+    }
+    if (op.mode == HWSIM_OP_LOOKUP) {
+        radio_watch *watch = &client->daemon->watch;
+        pthread_mutex_lock(&watch->lock);
+        const hwsim_radio *radio = find_radio_by_name(&watch->index, op.lookup_name);
+        int radio_id = radio ? (int) radio->id : -1;
+        pthread_mutex_unlock(&watch->lock);
+        reply(client, client->line_no, op.mode, radio_id >= 0 ? 0 : -ENODEV, radio_id);
+        return 0;
+    }
+    dreq = calloc(1, sizeof(daemon_request));
+    if (!dreq) {
+        reply(client, client->line_no, op.mode, -ENOMEM, -1);
+        return 0;
+    }
+    dreq->client = client;
+    dreq->line_no = client->line_no;
+    if (op.mode == HWSIM_OP_CREATE && op.c_hwname) {
+        strncpy(dreq->radio.name, op.c_hwname, sizeof(dreq->radio.name) - 1);
+        dreq->radio.channels = op.c_channels;
+        dreq->radio.use_chanctx = op.c_use_chanctx;
+        if (op.c_reg_alpha2) {
+            strncpy(dreq->radio.reg_alpha2, op.c_reg_alpha2, sizeof(dreq->radio.reg_alpha2) - 1);
+        }
+        dreq->radio.reg_custom_reg = op.c_reg_custom_reg;
+    } else if (op.mode == HWSIM_OP_DELETE_BY_ID) {
+        dreq->radio.id = op.del_radio_id;
+    } else if (op.mode == HWSIM_OP_DELETE_BY_NAME) {
+        strncpy(dreq->radio.name, op.del_radio_name, sizeof(dreq->radio.name) - 1);
+    }
+    if ((ret = serve_prewarmed(client, &op, dreq))) {
+        return ret < 0 ? ret : 0;
+    }
+    client->pending++;
+    if ((ret = submit_request(client->daemon->engine, &op, daemon_request_done, dreq))) {
+        client->pending--;
+        free(dreq);
+        if (ret == -EBUSY) {
+            return -EBUSY;
+        }
+        reply(client, client->line_no, op.mode, -EIO, -1);
+    }
+    return 0;
+}
+
+static void client_read_cb(struct bufferevent *bev, void *arg) {
+    daemon_client *client = arg;
+    struct evbuffer *input = bufferevent_get_input(bev);
+    struct evbuffer_ptr eol;
+    size_t eol_len;
+    char *line;
+    // a line is only drained once its request was accepted
+    while ((eol = evbuffer_search_eol(input, NULL, &eol_len, EVBUFFER_EOL_LF)).pos >= 0) {
+        if (!(line = malloc((size_t) eol.pos + 1))) {
+            return;
+        }
+        evbuffer_copyout(input, line, (size_t) eol.pos);
+        line[eol.pos] = '\0';
+        client->line_no++;
+        if (handle_line(client, line) == -EBUSY) {
+            client->line_no--;
+            free(line);
+            stall_client(client);
+            return;
+        }
+        free(line);
+        evbuffer_drain(input, (size_t) eol.pos + eol_len);
+    }
+}
+
+static void resume_cb(evutil_socket_t fd, short what, void *arg) {
+    UNUSED(fd);
+    UNUSED(what);
+    daemon_ctx *daemon = arg;
+    daemon_client *client = daemon->stalled;
+    daemon_client *next;
+    // clients that stall again are put on a new list
+    daemon->stalled = NULL;
+    for (; client; client = next) {
+        next = client->next_stalled;
+        client->stalled = false;
+        bufferevent_enable(client->bev, EV_READ);
+        client_read_cb(client->bev, client);
+    }
+}
+
+static void client_event_cb(struct bufferevent *bev, short what, void *arg) {
+    daemon_client *client = arg;
+    if (what & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) {
+        if (client->stalled) {
+            unstall_client(client);
+        }
+        bufferevent_free(bev);
+        client->bev = NULL;
+        release_client(client);
+    }
+}
+
+static void accept_cb(struct evconnlistener *listener, evutil_socket_t fd, struct sockaddr *addr, int socklen,
+                      void *arg) {
+    UNUSED(addr);
+    UNUSED(socklen);
+    struct event_base *ev_base = evconnlistener_get_base(listener);
+    daemon_client *client = calloc(1, sizeof(daemon_client));
+    if (!client) {
+        close(fd);
+        return;
+    }
+    client->daemon = arg;
+    client->bev = bufferevent_socket_new(ev_base, fd, BEV_OPT_CLOSE_ON_FREE);
+    if (!client->bev) {
+        close(fd);
+        free(client);
+        return;
+    }
+    bufferevent_setcb(client->bev, client_read_cb, NULL, client_event_cb, client);
+    bufferevent_enable(client->bev, EV_READ | EV_WRITE);
+}
+
+static void deadline_cb(evutil_socket_t fd, short what, void *arg) {
+    UNUSED(fd);
+    UNUSED(what);
+    daemon_ctx *daemon = arg;
+    check_deadlines(daemon->engine);
+    if (daemon->prewarm && daemon->prewarm->refilling) {
+        refill_prewarm(daemon->prewarm);
+    }
+}
+
+static void signal_cb(evutil_socket_t sig, short what, void *arg) {
+    UNUSED(sig);
+    UNUSED(what);
+    event_base_loopbreak(arg);
+}
+
+int run_daemon(hwsim_engine *engine, const char *path, bool session, uint32_t prewarm_low,
+               uint32_t prewarm_high) {
+    struct sockaddr_un addr;
+    struct timeval check_interval = {0, DAEMON_DEADLINE_CHECK_MS * 1000};
+    daemon_ctx daemon;
+    radio_prewarm prewarm;
+    char stats[160];
+    int ret = EXIT_FAILURE;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path '%s' too long\n", path);
+        return EXIT_FAILURE;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    daemon.engine = engine;
+    daemon.prewarm = NULL;
+    daemon.session = session;
+    daemon.stalled = NULL;
+    if ((ret = start_radio_watch(&daemon.watch, engine, NULL, NULL))) {
+        fprintf(stderr, "Error loading radio list: %s\n", strerror(abs(ret)));
+        return EXIT_FAILURE;
+    }
+    if (!daemon.watch.live) {
+        fprintf(stderr, "Radio changes by other processes will not be seen\n");
+    }
+    if (prewarm_high && !init_prewarm(&prewarm, engine, &daemon.watch, session, prewarm_low, prewarm_high)) {
+        daemon.prewarm = &prewarm;
+        prewarm.created_cb = resume_stalled;
+        prewarm.created_arg = &daemon;
+    }
+    ret = EXIT_FAILURE;
+
+    signal(SIGPIPE, SIG_IGN);
+    struct event_base *ev_base = event_base_new();
+    if (!ev_base) {
+        fprintf(stderr, "Error creating event base\n");
+        if (daemon.prewarm) {
+            free_prewarm(daemon.prewarm);
+        }
+        stop_radio_watch(&daemon.watch);
+        return EXIT_FAILURE;
+    }
+    struct evconnlistener *listener = evconnlistener_new_bind(ev_base, accept_cb, &daemon,
+                                                              LEV_OPT_CLOSE_ON_FREE | LEV_OPT_CLOSE_ON_EXEC, -1,
+                                                              (struct sockaddr *) &addr, sizeof(addr));
+    struct event *ev_nl = add_nl_event(engine, ev_base);
+    struct event *ev_deadline = event_new(ev_base, -1, EV_PERSIST, deadline_cb, &daemon);
+    struct event *ev_int = evsignal_new(ev_base, SIGINT, signal_cb, ev_base);
+    struct event *ev_term = evsignal_new(ev_base, SIGTERM, signal_cb, ev_base);
+    daemon.ev_resume = event_new(ev_base, -1, 0, resume_cb, &daemon);
+    if (!listener || !ev_nl || !ev_deadline || !ev_int || !ev_term || !daemon.ev_resume) {
+        fprintf(stderr, "Error listening on '%s': %s\n", path, strerror(errno));
+    } else {
+        event_add(ev_deadline, &check_interval);
+        event_add(ev_int, NULL);
+        event_add(ev_term, NULL);
+        printf("Listening on %s\n", path);
+        fflush(stdout);
+        event_base_dispatch(ev_base);
+        ret = EXIT_SUCCESS;
+    }
+
+    if (daemon.ev_resume) {
+        event_free(daemon.ev_resume);
+    }
+    if (ev_term) {
+        event_free(ev_term);
+    }
+    if (ev_int) {
+        event_free(ev_int);
+    }
+    if (ev_deadline) {
+        event_free(ev_deadline);
+    }
+    if (ev_nl) {
+        event_free(ev_nl);
+    }
+    if (listener) {
+        evconnlistener_free(listener);
+        unlink(path);
+    }
+    if (daemon.prewarm) {
+        print_prewarm_stats(daemon.prewarm, stats, sizeof(stats));
+        printf("Prewarm %s\n", stats);
+        free_prewarm(daemon.prewarm);
+    }
+    if (engine->overrun.overruns) {
+        print_overrun_stats(engine, 1, stats, sizeof(stats));
+        printf("Receive %s\n", stats);
+    }
+    event_base_free(ev_base);
+    stop_radio_watch(&daemon.watch);
+    return ret;
+}
@@ -0,0 +1,30 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_DAEMON_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_DAEMON_H
+
+#include "hwsim_mgmt_event.h"
+
+/*
+ * Serves batch lines (see hwsim_mgmt_batch.h) on the UNIX stream socket at
+ * path. Each request line is answered with "<line> <op> ok <radio id>" or
+ * "<line> <op> err <errno> <strerror>", where line counts the lines received
+ * on that connection. Replies are sent in completion order. A connection
+ * is not read while the window is full, so clients see backpressure
+ * instead of errors. lookup is answered locally from a radio table that
+ * follows the kernel's radio notifications, so it also sees radios changed
+ * by other processes.
+ * With prewarm_high, creates with novif and default options are served
+ * from a pool of spare radios (see hwsim_mgmt_prewarm.h), and the line
+ * "stats" is answered with the pool's counters. nl80211 must be resolved
+ * for that. With session, every radio is created destroy-on-close, so the
+ * kernel deletes all of them at once when the daemon's socket closes, also
+ * if it crashes. Runs until SIGINT or SIGTERM.
+ */
+int run_daemon(hwsim_engine *engine, const char *path, bool session, uint32_t prewarm_low,
+               uint32_t prewarm_high);
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_DAEMON_H
@@ -6,103 +6,919 @@
 #include <netlink/netlink.h>
 #include <netlink/genl/genl.h>
 #include <event.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
 #include <pthread.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "hwsim_mgmt_event.h"
+#include "hwsim_mgmt_journal.h"
 
-static pthread_mutex_t nl_cb_mutex;
-
-static int nl_msg_cb(struct nl_msg *msg, void *rctx) {
-    hwsim_cli_ctx *ctx = rctx;
-    struct nlmsghdr *nlh = nlmsg_hdr(msg);
-    struct genlmsghdr *gnlh = nlmsg_data(nlh);
-    int retcode = gnlh->cmd;
-    if (retcode == 0) {
-        if (!pthread_mutex_trylock(&nl_cb_mutex)) {
-            if (ctx->args.mode == HWSIM_OP_CREATE) {
-                notify_device_creation(0);
-            } else if (ctx->args.mode == HWSIM_OP_DELETE_BY_ID || ctx->args.mode == HWSIM_OP_DELETE_BY_NAME) {
-                notify_device_deletion();
-            } else if (ctx->args.mode == HWSIM_OP_SET_RSSI) {
-                notify_device_setRSSI();
+#define RECEIVE_WAIT_MS 100
+// a request whose replies never fit into the receive buffer fails after this
+#define MAX_RESENDS 8
+
+int init_engine(hwsim_engine *engine, const netlink_ctx *nl_ctx, size_t window, uint32_t timeout_ms) {
+    pthread_condattr_t cond_attr;
+    if (window == 0) {
+        window = HWSIM_DEFAULT_WINDOW;
+    }
+    engine->slots = calloc(window, sizeof(hwsim_request));
+    engine->resync_actions = calloc(window, sizeof(hwsim_resync_action));
+    if (!engine->slots || !engine->resync_actions) {
+        free(engine->slots);
+        free(engine->resync_actions);
+        engine->slots = NULL;
+        engine->resync_actions = NULL;
+        return -ENOMEM;
+    }
+    if (nl_socket_set_nonblocking(nl_ctx->sock) < 0) {
+        free(engine->slots);
+        free(engine->resync_actions);
+        engine->slots = NULL;
+        engine->resync_actions = NULL;
+        return -EBADF;
+    }
+    engine->nl_ctx = nl_ctx;
+    engine->window = window;
+    engine->limit = window;
+    engine->limit_credit = 0;
+    engine->inflight = 0;
+    engine->timeout_ms = timeout_ms;
+    engine->event_running = false;
+    engine->notify_cb = NULL;
+    engine->notify_arg = NULL;
+    memset(&engine->overrun, 0, sizeof(engine->overrun));
+    engine->resync_seq = 0;
+    engine->resync_radios = NULL;
+    engine->resync_count = 0;
+    engine->resync_cap = 0;
+    engine->resync_error = 0;
+    engine->max_radio_id = -1;
+    engine->receive_error = 0;
+    engine->journal = nl_ctx->config.journal;
+    pthread_mutex_init(&engine->send_lock, NULL);
+    pthread_mutex_init(&engine->lock, NULL);
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&engine->done, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+    return 0;
+}
+
+void free_engine(hwsim_engine *engine) {
+    size_t i;
+    pthread_cond_destroy(&engine->done);
+    pthread_mutex_destroy(&engine->lock);
+    pthread_mutex_destroy(&engine->send_lock);
+    for (i = 0; i < engine->window; i++) {
+        free(engine->slots[i].props);
+    }
+    free(engine->slots);
+    engine->slots = NULL;
+    free(engine->resync_radios);
+    engine->resync_radios = NULL;
+    free(engine->resync_actions);
+    engine->resync_actions = NULL;
+}
+
+static hwsim_request *find_request(hwsim_engine *engine, uint32_t seq) {
+    size_t i;
+    for (i = 0; i < engine->window; i++) {
+        hwsim_request *req = &engine->slots[(seq + i) % engine->window];
+        if (req->in_use && req->seq == seq) {
+            return req;
+        }
+    }
+    return NULL;
+}
+
+static hwsim_request *alloc_request(hwsim_engine *engine, uint32_t seq) {
+    size_t i;
+    for (i = 0; i < engine->window; i++) {
+        hwsim_request *req = &engine->slots[(seq + i) % engine->window];
+        if (!req->in_use) {
+            req->in_use = true;
+            req->seq = seq;
+            engine->inflight++;
+            return req;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * A completed request gives up its slot right away but stays counted as
+ * in flight until its callback returned, so that waiters never see the
+ * request done before its result was delivered.
+ */
+static void finish_request(hwsim_engine *engine) {
+    engine->inflight--;
+    pthread_cond_broadcast(&engine->done);
+}
+
+static void release_request(hwsim_engine *engine, hwsim_request *req) {
+    req->in_use = false;
+    finish_request(engine);
+}
+
+/*
+ * Completes req with error (a radio id for a successful create). Called
+ * with engine->lock held, which is released while the callback runs.
+ */
+static void complete_locked(hwsim_engine *engine, hwsim_request *req, int error, const struct timespec *now) {
+    uint8_t record[HWSIM_JOURNAL_RECORD_MAX];
+    size_t record_len = 0;
+    hwsim_request done = *req;
+    if (error < 0) {
+        done.error = error;
+    } else if (done.mode == HWSIM_OP_CREATE) {
+        done.radio_id = error;
+    }
+    done.replied = *now;
+    if (!done.sent.tv_sec && !done.sent.tv_nsec) {
+        done.sent = *now;
+    }
+    if (engine->journal) {
+        record_len = encode_journal_record(engine->journal, &done, record);
+    }
+    req->in_use = false;
+    pthread_mutex_unlock(&engine->lock);
+    if (record_len) {
+        write_journal_record(engine->journal, record, record_len);
+    }
+    if (done.cb) {
+        done.cb(&done, done.cb_arg);
+    }
+    pthread_mutex_lock(&engine->lock);
+    finish_request(engine);
+}
+
+uint64_t timespec_diff_ns(const struct timespec *from, const struct timespec *to) {
+    return (uint64_t) ((to->tv_sec - from->tv_sec) * 1000000000ll + (to->tv_nsec - from->tv_nsec));
+}
+
+uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+static bool timespec_before(const struct timespec *a, const struct timespec *b) {
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static void set_deadline(struct timespec *deadline, const struct timespec *start, uint32_t timeout_ms) {
+    *deadline = *start;
+    deadline->tv_sec += timeout_ms / 1000;
+    deadline->tv_nsec += (long) (timeout_ms % 1000) * 1000000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+static void set_target(hwsim_request *req, const hwsim_args *op) {
+    const char *name = NULL;
+    req->target_id = -1;
+    switch (op->mode) {
+        case HWSIM_OP_CREATE:
+            name = op->c_hwname;
+            break;
+        case HWSIM_OP_DELETE_BY_ID:
+            req->target_id = (int) op->del_radio_id;
+            break;
+        case HWSIM_OP_DELETE_BY_NAME:
+            name = op->del_radio_name;
+            break;
+        case HWSIM_OP_SET_RSSI:
+            req->target_id = (int) op->rssi_radio;
+            break;
+        case HWSIM_OP_RENAME:
+            name = op->new_name;
+            break;
+        case HWSIM_OP_SET_PROPS:
+            if (op->props_count == 1) {
+                req->target_id = (int) op->props[0].radio_id;
             }
-            // should not be needed
-            pthread_mutex_unlock(&nl_cb_mutex);
+            break;
+        default:
+            break;
+    }
+    if (name) {
+        strncpy(req->name, name, sizeof(req->name) - 1);
+        req->name[sizeof(req->name) - 1] = '\0';
+    } else {
+        req->name[0] = '\0';
+    }
+}
+
+static bool name_fits(const char *name, size_t len) {
+    return strlen(name) < len;
+}
+
+/*
+ * Keeps a copy of op that stays valid until the request completes: the
+ * strings and props it points to are taken from the request (set_target()
+ * copied the name already).
+ */
+static void keep_op(hwsim_request *req, const hwsim_args *op) {
+    req->op = *op;
+    req->resendable = true;
+    switch (op->mode) {
+        case HWSIM_OP_CREATE:
+            if (op->c_hwname) {
+                req->resendable = name_fits(op->c_hwname, sizeof(req->name));
+                req->op.c_hwname = req->name;
+            }
+            if (op->c_reg_alpha2) {
+                req->resendable &= name_fits(op->c_reg_alpha2, sizeof(req->alpha2));
+                strncpy(req->alpha2, op->c_reg_alpha2, sizeof(req->alpha2) - 1);
+                req->alpha2[sizeof(req->alpha2) - 1] = '\0';
+                req->op.c_reg_alpha2 = req->alpha2;
+            }
+            break;
+        case HWSIM_OP_DELETE_BY_NAME:
+            req->resendable = name_fits(op->del_radio_name, sizeof(req->name));
+            req->op.del_radio_name = req->name;
+            break;
+        case HWSIM_OP_RENAME:
+            req->resendable = name_fits(op->new_name, sizeof(req->name));
+            req->op.new_name = req->name;
+            break;
+        case HWSIM_OP_SET_PROPS:
+            if (op->props_count == 1) {
+                req->op.s_props = op->props[0];
+                req->op.props = &req->op.s_props;
+                break;
+            }
+            if (!req->props) {
+                req->props = malloc(HWSIM_PROPS_MAX * sizeof(hwsim_props));
+            }
+            if (!req->props || op->props_count > HWSIM_PROPS_MAX) {
+                req->resendable = false;
+                break;
+            }
+            memcpy(req->props, op->props, op->props_count * sizeof(hwsim_props));
+            req->op.props = req->props;
+            break;
+        default:
+            break;
+    }
+}
+
+static int send_op(const netlink_ctx *nl_ctx, uint32_t seq, const hwsim_args *op) {
+    switch (op->mode) {
+        case HWSIM_OP_CREATE:
+            return create_radio(nl_ctx, seq, op->c_channels, op->c_no_vif, op->c_hwname, op->c_use_chanctx,
+                                op->c_reg_alpha2, op->c_reg_custom_reg, op->c_destroy_on_close);
+        case HWSIM_OP_DELETE_BY_ID:
+            return delete_radio_by_id(nl_ctx, seq, op->del_radio_id);
+        case HWSIM_OP_DELETE_BY_NAME:
+            return delete_radio_by_name(nl_ctx, seq, op->del_radio_name);
+        case HWSIM_OP_SET_RSSI:
+            return set_rssi(nl_ctx, seq, op->rssi_radio, op->rssi_dbm);
+        case HWSIM_OP_RENAME:
+            return rename_wiphy(nl_ctx, seq, op->wiphy_idx, op->new_name);
+        case HWSIM_OP_SET_PROPS:
+            return set_props(nl_ctx, seq, op->props, op->props_count);
+        case HWSIM_OP_LIST:
+            return dump_radios(nl_ctx, seq);
+        default:
+            return EXIT_FAILURE;
+    }
+}
+
+int submit_request(hwsim_engine *engine, const hwsim_args *op, hwsim_request_cb cb, void *cb_arg) {
+    return submit_request_with_replies(engine, op, NULL, cb, cb_arg);
+}
+
+void wait_for_slot(hwsim_engine *engine) {
+    wait_for_requests(engine, __atomic_load_n(&engine->limit, __ATOMIC_RELAXED) - 1);
+}
+
+int submit_request_wait(hwsim_engine *engine, const hwsim_args *op, hwsim_request_cb cb, void *cb_arg) {
+    int ret;
+    while ((ret = submit_request(engine, op, cb, cb_arg)) == -EBUSY) {
+        wait_for_slot(engine);
+    }
+    return ret;
+}
+
+int submit_request_with_replies(hwsim_engine *engine, const hwsim_args *op, hwsim_reply_cb reply_cb,
+                                hwsim_request_cb cb, void *cb_arg) {
+    hwsim_request *req;
+    struct timespec submitted;
+    uint32_t seq;
+    int ret;
+
+    clock_gettime(CLOCK_MONOTONIC, &submitted);
+    pthread_mutex_lock(&engine->send_lock);
+    pthread_mutex_lock(&engine->lock);
+    if (engine->inflight >= engine->limit) {
+        pthread_mutex_unlock(&engine->lock);
+        pthread_mutex_unlock(&engine->send_lock);
+        return -EBUSY;
+    }
+    // register before sending so that a fast reply always finds its request
+    seq = nl_socket_use_seq(engine->nl_ctx->sock);
+    req = alloc_request(engine, seq);
+    req->mode = op->mode;
+    req->error = 0;
+    req->radio_id = -1;
+    req->pending = op->mode == HWSIM_OP_SET_PROPS && op->props_count ? op->props_count : 1;
+    req->reply_cb = reply_cb;
+    req->cb = cb;
+    req->cb_arg = cb_arg;
+    set_target(req, op);
+    keep_op(req, op);
+    req->resync = false;
+    req->resends = 0;
+    req->id_floor = engine->max_radio_id;
+    req->submitted = submitted;
+    memset(&req->sent, 0, sizeof(req->sent));
+    if (engine->timeout_ms) {
+        set_deadline(&req->deadline, &submitted, engine->timeout_ms);
+    }
+    pthread_mutex_unlock(&engine->lock);
+
+    ret = send_op(engine->nl_ctx, seq, op);
+    pthread_mutex_lock(&engine->lock);
+    // a fast reply or the deadline may have completed the request already
+    if (req->in_use && req->seq == seq) {
+        if (ret) {
+            release_request(engine, req);
+        } else {
+            clock_gettime(CLOCK_MONOTONIC, &req->sent);
         }
     }
-    return 0;
+    pthread_mutex_unlock(&engine->lock);
+    pthread_mutex_unlock(&engine->send_lock);
+    return ret ? -1 : 0;
 }
 
-static int nl_err_cb(struct sockaddr_nl *nla, struct nlmsgerr *nlerr, void *rctx) {
-    UNUSED(nla);
-    hwsim_cli_ctx *ctx = rctx;
-    if (!pthread_mutex_trylock(&nl_cb_mutex)) {
-        if (ctx->args.mode == HWSIM_OP_DELETE_BY_ID || ctx->args.mode == HWSIM_OP_DELETE_BY_NAME) {
-            if (nlerr->error == -ENODEV) {
-                fprintf(stderr, "Device not found\n");
-            } else {
-                fprintf(stderr, "Unknown error on device deletion with errid %d\nstrerror: %s\n", nlerr->error,
-                        strerror(abs(nlerr->error)));
+size_t requests_inflight(hwsim_engine *engine) {
+    size_t inflight;
+    pthread_mutex_lock(&engine->lock);
+    inflight = engine->inflight;
+    pthread_mutex_unlock(&engine->lock);
+    return inflight;
+}
+
+void set_notify_handler(hwsim_engine *engine, hwsim_notify_cb cb, void *arg) {
+    pthread_mutex_lock(&engine->lock);
+    engine->notify_cb = cb;
+    engine->notify_arg = arg;
+    pthread_mutex_unlock(&engine->lock);
+}
+
+static void complete_request(hwsim_engine *engine, uint32_t seq, int error) {
+    uint8_t record[HWSIM_JOURNAL_RECORD_MAX];
+    size_t record_len = 0;
+    hwsim_request done;
+
+    pthread_mutex_lock(&engine->lock);
+    hwsim_request *req = find_request(engine, seq);
+    if (!req) {
+        pthread_mutex_unlock(&engine->lock);
+        return;
+    }
+    if (error < 0 && !req->error) {
+        req->error = error;
+    }
+    if (--req->pending) {
+        pthread_mutex_unlock(&engine->lock);
+        return;
+    }
+    done = *req;
+    clock_gettime(CLOCK_MONOTONIC, &done.replied);
+    if (!done.sent.tv_sec && !done.sent.tv_nsec) {
+        done.sent = done.replied;
+    }
+    if (done.mode == HWSIM_OP_CREATE && error >= 0) {
+        // mac80211_hwsim returns the new radio id as positive error code
+        done.radio_id = error;
+        if (error > engine->max_radio_id) {
+            engine->max_radio_id = error;
+        }
+    }
+    // props of a set belong to the slot, encoded before it is reused
+    if (engine->journal) {
+        record_len = encode_journal_record(engine->journal, &done, record);
+    }
+    req->in_use = false;
+    if (engine->limit < engine->window && ++engine->limit_credit >= engine->limit) {
+        __atomic_store_n(&engine->limit, engine->limit + 1, __ATOMIC_RELAXED);
+        engine->limit_credit = 0;
+    }
+    pthread_mutex_unlock(&engine->lock);
+
+    if (record_len) {
+        write_journal_record(engine->journal, record, record_len);
+    }
+    if (done.cb) {
+        done.cb(&done, done.cb_arg);
+    }
+    pthread_mutex_lock(&engine->lock);
+    finish_request(engine);
+    pthread_mutex_unlock(&engine->lock);
+}
+
+/*
+ * Called with engine->lock held. Returns the earliest pending deadline in
+ * next, or false if no request has one.
+ */
+static bool expire_requests(hwsim_engine *engine, struct timespec *next) {
+    struct timespec now;
+    bool have_next = false;
+    size_t i;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (i = 0; i < engine->window; i++) {
+        hwsim_request *req = &engine->slots[i];
+        if (!req->in_use || !engine->timeout_ms) {
+            continue;
+        }
+        if (!timespec_before(&now, &req->deadline)) {
+            complete_locked(engine, req, -ETIMEDOUT, &now);
+        } else if (!have_next || timespec_before(&req->deadline, next)) {
+            *next = req->deadline;
+            have_next = true;
+        }
+    }
+    return have_next;
+}
+
+static void wait_while(hwsim_engine *engine, bool (*busy)(const hwsim_engine *, const void *), const void *arg) {
+    struct timespec next;
+    bool have_next;
+
+    pthread_mutex_lock(&engine->lock);
+    while (busy(engine, arg)) {
+        have_next = expire_requests(engine, &next);
+        if (!busy(engine, arg)) {
+            break;
+        }
+        if (have_next) {
+            pthread_cond_timedwait(&engine->done, &engine->lock, &next);
+        } else {
+            pthread_cond_wait(&engine->done, &engine->lock);
+        }
+    }
+    pthread_mutex_unlock(&engine->lock);
+}
+
+static bool too_many_inflight(const hwsim_engine *engine, const void *arg) {
+    return engine->inflight > *(const size_t *) arg;
+}
+
+static bool flag_unset(const hwsim_engine *engine, const void *arg) {
+    UNUSED(engine);
+    return !*(const bool *) arg;
+}
+
+void wait_for_requests(hwsim_engine *engine, size_t max_inflight) {
+    wait_while(engine, too_many_inflight, &max_inflight);
+}
+
+void wait_until(hwsim_engine *engine, const bool *done) {
+    wait_while(engine, flag_unset, done);
+}
+
+void signal_done(hwsim_engine *engine, bool *done) {
+    pthread_mutex_lock(&engine->lock);
+    *done = true;
+    pthread_cond_broadcast(&engine->done);
+    pthread_mutex_unlock(&engine->lock);
+}
+
+void check_deadlines(hwsim_engine *engine) {
+    struct timespec next;
+    pthread_mutex_lock(&engine->lock);
+    expire_requests(engine, &next);
+    pthread_mutex_unlock(&engine->lock);
+}
+
+void get_overrun_stats(hwsim_engine *engine, hwsim_overrun_stats *stats) {
+    pthread_mutex_lock(&engine->lock);
+    *stats = engine->overrun;
+    pthread_mutex_unlock(&engine->lock);
+}
+
+void print_overrun_stats(hwsim_engine *engines, size_t count, char *buf, size_t len) {
+    hwsim_overrun_stats sum, one;
+    size_t i;
+
+    memset(&sum, 0, sizeof(sum));
+    for (i = 0; i < count; i++) {
+        get_overrun_stats(&engines[i], &one);
+        sum.overruns += one.overruns;
+        sum.resyncs += one.resyncs;
+        sum.resent += one.resent;
+        sum.recovered += one.recovered;
+        sum.lost += one.lost;
+    }
+    snprintf(buf, len, "overruns=%lu resyncs=%lu resent=%lu recovered=%lu lost=%lu", sum.overruns, sum.resyncs,
+             sum.resent, sum.recovered, sum.lost);
+}
+
+/*
+ * Called with engine->send_lock and engine->lock held, so every request
+ * still waiting has been sent and handled by the kernel before the dump.
+ * Once the dump is complete, every reply to these requests was either
+ * received or dropped by the overrun.
+ */
+static void start_resync(hwsim_engine *engine) {
+    size_t i;
+
+    engine->overrun.overruns++;
+    // fewer replies in flight fit into the receive buffer
+    __atomic_store_n(&engine->limit, engine->limit > 1 ? engine->limit / 2 : 1, __ATOMIC_RELAXED);
+    engine->limit_credit = 0;
+    for (i = 0; i < engine->window; i++) {
+        hwsim_request *req = &engine->slots[i];
+        if (req->in_use) {
+            req->resync = true;
+        }
+    }
+    // a resync still running is superseded, replies to its dump are ignored
+    engine->resync_seq = nl_socket_use_seq(engine->nl_ctx->sock);
+    engine->resync_count = 0;
+    engine->resync_error = 0;
+    if (dump_radios(engine->nl_ctx, engine->resync_seq)) {
+        engine->resync_error = -EIO;
+    }
+}
+
+static void record_resync_radio(hwsim_engine *engine, struct nl_msg *msg) {
+    struct nlattr *attrs[__HWSIM_ATTR_MAX];
+    hwsim_resync_radio *radio;
+
+    if (genlmsg_parse(nlmsg_hdr(msg), 0, attrs, __HWSIM_ATTR_MAX - 1, NULL) < 0 || !attrs[HWSIM_ATTR_RADIO_ID]) {
+        return;
+    }
+    if (engine->resync_count == engine->resync_cap) {
+        size_t cap = engine->resync_cap ? engine->resync_cap * 2 : 64;
+        hwsim_resync_radio *grown = realloc(engine->resync_radios, cap * sizeof(hwsim_resync_radio));
+        if (!grown) {
+            engine->resync_error = -ENOMEM;
+            return;
+        }
+        engine->resync_radios = grown;
+        engine->resync_cap = cap;
+    }
+    radio = &engine->resync_radios[engine->resync_count++];
+    radio->id = nla_get_u32(attrs[HWSIM_ATTR_RADIO_ID]);
+    if (radio->id <= INT_MAX && (int) radio->id > engine->max_radio_id) {
+        engine->max_radio_id = (int) radio->id;
+    }
+    radio->name[0] = '\0';
+    if (attrs[HWSIM_ATTR_RADIO_NAME]) {
+        nla_strlcpy(radio->name, attrs[HWSIM_ATTR_RADIO_NAME], sizeof(radio->name));
+    }
+}
+
+static bool resync_radio_exists(const hwsim_engine *engine, int id, const char *name, int *found_id) {
+    size_t i;
+    for (i = 0; i < engine->resync_count; i++) {
+        const hwsim_resync_radio *radio = &engine->resync_radios[i];
+        if ((name && !strcmp(radio->name, name)) || (!name && radio->id == (uint32_t) id)) {
+            *found_id = (int) radio->id;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Decides how a request whose reply was lost ends. Returns true if it is
+ * to be sent again, otherwise its result is in *result.
+ */
+static bool resync_action(const hwsim_engine *engine, const hwsim_request *req, int *result) {
+    int id;
+
+    *result = -ENOBUFS;
+    switch (req->mode) {
+        case HWSIM_OP_CREATE:
+            if (!req->name[0]) {
+                // an unnamed radio cannot be told apart from the others
+                return false;
             }
-            exit(EXIT_FAILURE);
-        } else if (ctx->args.mode == HWSIM_OP_CREATE) {
-            if (nlerr->error < 0) {
-                fprintf(stderr, "Unknown error on device creation with errid %d\nstrerror: %s\n", nlerr->error,
-                        strerror(abs(nlerr->error)));
-                exit(EXIT_FAILURE);
+            if (resync_radio_exists(engine, -1, req->name, &id)) {
+                /*
+                 * Only a radio created after the ids the engine had seen
+                 * when the request was submitted can be its own, an older
+                 * one already had the name. Without such an id nothing
+                 * tells them apart.
+                 */
+                if (req->id_floor >= 0) {
+                    *result = id > req->id_floor ? id : -EEXIST;
+                }
+                return false;
             }
-            notify_device_creation(nlerr->error);
-        } else if (ctx->args.mode == HWSIM_OP_SET_RSSI) {
-            if (nlerr->error == -ENODEV) {
-                fprintf(stderr, "Device not found\n");
-            } else {
-                fprintf(stderr, "Unknown error while setting RSSI with errid %d\nstrerror: %s\n", nlerr->error,
-                        strerror(abs(nlerr->error)));
+            return true;
+        case HWSIM_OP_DELETE_BY_ID:
+        case HWSIM_OP_DELETE_BY_NAME:
+            if (!resync_radio_exists(engine, req->target_id, req->name[0] ? req->name : NULL, &id)) {
+                *result = 0;
+                return false;
             }
-            exit(EXIT_FAILURE);
+            return true;
+        case HWSIM_OP_SET_RSSI:
+        case HWSIM_OP_SET_PROPS:
+        case HWSIM_OP_RENAME:
+            return true;
+        default:
+            // dump parts may be missing
+            return false;
+    }
+}
+
+/*
+ * Settles the marked requests in three steps: decides under the locks,
+ * resends holding only send_lock (sending may have to wait for the mock
+ * peer) and completes the rest once no new request can be held up. Only
+ * the receiving thread runs this, so engine->resync_actions is its own.
+ */
+static void finish_resync(hwsim_engine *engine, int error) {
+    hwsim_resync_action *actions = engine->resync_actions;
+    struct timespec now;
+    size_t count = 0, i;
+
+    pthread_mutex_lock(&engine->send_lock);
+    pthread_mutex_lock(&engine->lock);
+    engine->resync_seq = 0;
+    engine->overrun.resyncs++;
+    if (!error) {
+        error = engine->resync_error;
+    }
+    for (i = 0; i < engine->window; i++) {
+        hwsim_request *req = &engine->slots[i];
+        hwsim_resync_action *action;
+        if (!req->in_use || !req->resync) {
+            continue;
+        }
+        req->resync = false;
+        action = &actions[count++];
+        action->req = req;
+        action->result = -ENOBUFS;
+        action->resend = error >= 0 && req->resendable && req->resends < MAX_RESENDS &&
+                         resync_action(engine, req, &action->result);
+        if (action->resend) {
+            req->resends++;
+            req->seq = nl_socket_use_seq(engine->nl_ctx->sock);
+            req->pending = req->mode == HWSIM_OP_SET_PROPS && req->op.props_count ? req->op.props_count : 1;
         }
-        // should not be needed
-        pthread_mutex_unlock(&nl_cb_mutex);
+        action->seq = req->seq;
+    }
+    pthread_mutex_unlock(&engine->lock);
+
+    // no slot is reused while send_lock is held, only deadlines complete requests
+    for (i = 0; i < count; i++) {
+        hwsim_resync_action *action = &actions[i];
+        bool waiting;
+        if (!action->resend) {
+            continue;
+        }
+        pthread_mutex_lock(&engine->lock);
+        waiting = action->req->in_use && action->req->seq == action->seq;
+        pthread_mutex_unlock(&engine->lock);
+        if (!waiting || send_op(engine->nl_ctx, action->seq, &action->req->op)) {
+            action->resend = false;
+            action->result = -EIO;
+        }
+    }
+    pthread_mutex_unlock(&engine->send_lock);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pthread_mutex_lock(&engine->lock);
+    for (i = 0; i < count; i++) {
+        hwsim_resync_action *action = &actions[i];
+        if (action->resend) {
+            engine->overrun.resent++;
+            continue;
+        }
+        // completed by its deadline, the slot may hold a new request by now
+        if (!action->req->in_use || action->req->seq != action->seq) {
+            continue;
+        }
+        if (action->result == -ENOBUFS || action->result == -EIO) {
+            engine->overrun.lost++;
+        } else {
+            engine->overrun.recovered++;
+        }
+        complete_locked(engine, action->req, action->result, &now);
+    }
+    pthread_mutex_unlock(&engine->lock);
+}
+
+/*
+ * Returns true if msg answers the dump of the running resync.
+ */
+static bool is_resync_reply(hwsim_engine *engine, struct nl_msg *msg) {
+    uint32_t seq = nlmsg_hdr(msg)->nlmsg_seq;
+    bool ret;
+    pthread_mutex_lock(&engine->lock);
+    ret = seq && seq == engine->resync_seq;
+    pthread_mutex_unlock(&engine->lock);
+    return ret;
+}
+
+static void notify(hwsim_engine *engine, struct nl_msg *msg) {
+    hwsim_notify_cb cb;
+    void *arg;
+    pthread_mutex_lock(&engine->lock);
+    cb = engine->notify_cb;
+    arg = engine->notify_arg;
+    pthread_mutex_unlock(&engine->lock);
+    if (cb) {
+        cb(msg, arg);
+    }
+}
+
+static int nl_seq_cb(struct nl_msg *msg, void *rctx) {
+    UNUSED(msg);
+    UNUSED(rctx);
+    // replies are matched against the request table instead
+    return NL_OK;
+}
+
+static int nl_valid_cb(struct nl_msg *msg, void *rctx) {
+    hwsim_engine *engine = rctx;
+    hwsim_reply_cb reply_cb = NULL;
+    void *cb_arg = NULL;
+
+    pthread_mutex_lock(&engine->lock);
+    hwsim_request *req = find_request(engine, nlmsg_hdr(msg)->nlmsg_seq);
+    if (req) {
+        reply_cb = req->reply_cb;
+        cb_arg = req->cb_arg;
+    } else if (nlmsg_hdr(msg)->nlmsg_seq == 0) {
+        reply_cb = engine->notify_cb;
+        cb_arg = engine->notify_arg;
+    } else if (nlmsg_hdr(msg)->nlmsg_seq == engine->resync_seq) {
+        record_resync_radio(engine, msg);
+        reply_cb = engine->notify_cb;
+        cb_arg = engine->notify_arg;
     }
+    pthread_mutex_unlock(&engine->lock);
+    if (reply_cb) {
+        reply_cb(msg, cb_arg);
+    }
+    return NL_OK;
+}
+
+static int nl_finish_cb(struct nl_msg *msg, void *rctx) {
+    if (is_resync_reply(rctx, msg)) {
+        notify(rctx, msg);
+        finish_resync(rctx, 0);
+        return NL_OK;
+    }
+    complete_request(rctx, nlmsg_hdr(msg)->nlmsg_seq, 0);
+    return NL_OK;
+}
+
+static int nl_ack_cb(struct nl_msg *msg, void *rctx) {
+    complete_request(rctx, nlmsg_hdr(msg)->nlmsg_seq, 0);
+    return NL_OK;
+}
+
+static int nl_err_cb(struct sockaddr_nl *nla, struct nlmsgerr *nlerr, void *rctx) {
+    hwsim_engine *engine = rctx;
+    bool resync;
+    UNUSED(nla);
+    pthread_mutex_lock(&engine->lock);
+    resync = nlerr->msg.nlmsg_seq && nlerr->msg.nlmsg_seq == engine->resync_seq;
+    pthread_mutex_unlock(&engine->lock);
+    if (resync) {
+        finish_resync(engine, nlerr->error < 0 ? nlerr->error : -EIO);
+        return NL_SKIP;
+    }
+    complete_request(engine, nlerr->msg.nlmsg_seq, nlerr->error);
     return NL_SKIP;
 }
 
+/*
+ * Dispatches messages until the socket is empty. ENOBUFS (-NLE_NOMEM)
+ * means the kernel dropped messages for the socket; the queue behind it
+ * is intact, so receiving continues after the resync was started.
+ */
+static int drain_replies(hwsim_engine *engine) {
+    int ret;
+
+    while (true) {
+        ret = nl_recvmsgs_report(engine->nl_ctx->sock, engine->nl_ctx->cb);
+        if (ret > 0 || ret == -NLE_DUMP_INTR) {
+            continue;
+        }
+        if (ret == 0 || ret == -NLE_AGAIN) {
+            return 0;
+        }
+        if (ret == -NLE_NOMEM) {
+            int error;
+            pthread_mutex_lock(&engine->send_lock);
+            pthread_mutex_lock(&engine->lock);
+            start_resync(engine);
+            error = engine->resync_error;
+            pthread_mutex_unlock(&engine->lock);
+            pthread_mutex_unlock(&engine->send_lock);
+            if (error) {
+                finish_resync(engine, error);
+            }
+            continue;
+        }
+        engine->receive_error = ret;
+        return -1;
+    }
+}
+
+int receive_replies(hwsim_engine *engine) {
+    struct pollfd pfd = {nl_socket_get_fd(engine->nl_ctx->sock), POLLIN, 0};
+    if (poll(&pfd, 1, RECEIVE_WAIT_MS) < 0 && errno != EINTR) {
+        return -1;
+    }
+    return drain_replies(engine);
+}
+
 static void nl_event_handler(int fd, short what, void *rctx) {
     UNUSED(fd);
     UNUSED(what);
-    hwsim_cli_ctx *ctx = rctx;
-    nl_recvmsgs_default(ctx->nl_ctx.sock);
+    drain_replies(rctx);
+}
+
+struct event *add_nl_event(hwsim_engine *engine, struct event_base *ev_base) {
+    struct event *ev_cmd = event_new(ev_base, nl_socket_get_fd(engine->nl_ctx->sock), EV_READ | EV_PERSIST,
+                                     nl_event_handler, engine);
+    if (!ev_cmd) {
+        return NULL;
+    }
+    event_add(ev_cmd, NULL);
+    return ev_cmd;
+}
+
+static void stop_event_handler(int fd, short what, void *rctx) {
+    UNUSED(fd);
+    UNUSED(what);
+    event_base_loopbreak(rctx);
 }
 
 static void *run_nl_event_dispatcher(void *rctx) {
-    hwsim_cli_ctx *ctx = rctx;
+    hwsim_engine *engine = rctx;
     struct event_base *ev_base = event_base_new();
-    struct event *ev_cmd = event_new(ev_base, nl_socket_get_fd(ctx->nl_ctx.sock), EV_READ | EV_PERSIST,
-                                     nl_event_handler, ctx);
-    event_add(ev_cmd, NULL);
+    struct event *ev_cmd = add_nl_event(engine, ev_base);
+    struct event *ev_stop = event_new(ev_base, engine->stop_pipe[0], EV_READ, stop_event_handler, ev_base);
+    event_add(ev_stop, NULL);
     event_base_dispatch(ev_base);
-    event_base_free(ev_base);
+    event_free(ev_stop);
     event_free(ev_cmd);
+    event_base_free(ev_base);
     return NULL;
 }
 
-int register_event(hwsim_cli_ctx *ctx) {
-    if (nl_cb_set(ctx->nl_ctx.cb, NL_CB_MSG_IN, NL_CB_CUSTOM, nl_msg_cb, ctx)) {
-        fprintf(stderr, "Error on callback registration\n");
-        return -1;
+int register_callbacks(hwsim_engine *engine) {
+    struct nl_cb *cb = engine->nl_ctx->cb;
+    if (nl_cb_set(cb, NL_CB_SEQ_CHECK, NL_CB_CUSTOM, nl_seq_cb, engine) ||
+        nl_cb_set(cb, NL_CB_ACK, NL_CB_CUSTOM, nl_ack_cb, engine) ||
+        nl_cb_set(cb, NL_CB_VALID, NL_CB_CUSTOM, nl_valid_cb, engine) ||
+        nl_cb_set(cb, NL_CB_FINISH, NL_CB_CUSTOM, nl_finish_cb, engine)
+        || nl_cb_err(cb, NL_CB_CUSTOM, nl_err_cb, engine)) {
+        return -EINVAL;
     }
-    if (nl_cb_err(ctx->nl_ctx.cb, NL_CB_CUSTOM, nl_err_cb, ctx)) {
-        fprintf(stderr, "Error on callback registration (2)\n");
-        return -1;
+    return 0;
+}
+
+int register_event(hwsim_engine *engine) {
+    int ret;
+    if ((ret = register_callbacks(engine))) {
+        return ret;
     }
 
-    pthread_t libe_thread;
-    return pthread_create(&libe_thread, NULL, run_nl_event_dispatcher, ctx);
+    if (pipe(engine->stop_pipe)) {
+        return -errno;
+    }
+    if ((ret = pthread_create(&engine->event_thread, NULL, run_nl_event_dispatcher, engine))) {
+        close(engine->stop_pipe[0]);
+        close(engine->stop_pipe[1]);
+        return -ret;
+    }
+    engine->event_running = true;
+    return 0;
+}
+
+void unregister_event(hwsim_engine *engine) {
+    if (!engine->event_running) {
+        return;
+    }
+    if (write(engine->stop_pipe[1], "", 1) == 1) {
+        pthread_join(engine->event_thread, NULL);
+    }
+    close(engine->stop_pipe[0]);
+    close(engine->stop_pipe[1]);
+    engine->event_running = false;
 }
 
-int wait_for_event() {
-    sleep(2);
-    fprintf(stderr, "Did not receive netlink event after 2 sec\n");
-    return EXIT_FAILURE;
+void wait_for_event(hwsim_engine *engine) {
+    wait_for_requests(engine, 0);
 }
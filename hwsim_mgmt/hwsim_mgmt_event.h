@@ -6,12 +6,246 @@
 #ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_EVENT_H
 #define MAC80211_HWSIM_MGMT_HWSIM_MGMT_EVENT_H
 
-#include "hwsim_mgmt_cli.h"
+#include <pthread.h>
+#include <time.h>
+#include "hwsim_mgmt_func.h"
+
+struct nl_msg;
+struct event;
+struct event_base;
+struct hwsim_journal;
 
 #define UNUSED(x) (void)(x)
 
-int register_event(hwsim_cli_ctx *ctx);
+#define HWSIM_DEFAULT_WINDOW 64
+#define HWSIM_DEFAULT_TIMEOUT_MS 2000
+#define HWSIM_REQUEST_NAME_MAX 64
+
+typedef struct hwsim_request hwsim_request;
+
+typedef void (*hwsim_request_cb)(const hwsim_request *req, void *arg);
+
+typedef void (*hwsim_reply_cb)(struct nl_msg *msg, void *arg);
+
+typedef hwsim_reply_cb hwsim_notify_cb;
+
+/*
+ * Timestamps are CLOCK_MONOTONIC: submitted before the request is built,
+ * sent once the message was handed to the socket and replied when its
+ * ACK, error or NLMSG_DONE was received (or the deadline passed). A
+ * reply that beats the sender's timestamp leaves sent equal to replied.
+ */
+struct hwsim_request {
+    bool in_use;
+    uint32_t seq;
+    enum op_mode mode;
+    int error;
+    int radio_id;
+    // radio id or name the request addresses, -1 or "" if none
+    int target_id;
+    char name[HWSIM_REQUEST_NAME_MAX];
+    struct timespec submitted;
+    struct timespec sent;
+    struct timespec replied;
+    struct timespec deadline;
+    // ACKs still expected, more than one for multi-message requests
+    uint32_t pending;
+    hwsim_reply_cb reply_cb;
+    hwsim_request_cb cb;
+    void *cb_arg;
+    // copy of the request for a resend after an overrun, see receive_replies()
+    hwsim_args op;
+    char alpha2[3];
+    // buffer of the slot for multi-radio SET_PROPS, kept across requests
+    hwsim_props *props;
+    bool resendable;
+    // sent before the running resync started, its reply may be lost
+    bool resync;
+    uint32_t resends;
+    // the engine's max_radio_id when the request was submitted
+    int id_floor;
+};
+
+/*
+ * Receive overruns of an engine's socket and how the affected requests
+ * ended: resent, settled from the radio dump, or failed with -ENOBUFS.
+ */
+typedef struct {
+    unsigned long overruns;
+    unsigned long resyncs;
+    unsigned long resent;
+    unsigned long recovered;
+    unsigned long lost;
+} hwsim_overrun_stats;
+
+typedef struct {
+    uint32_t id;
+    char name[HWSIM_REQUEST_NAME_MAX];
+} hwsim_resync_radio;
+
+// how a resync settles one request, see finish_resync()
+typedef struct {
+    hwsim_request *req;
+    uint32_t seq;
+    int result;
+    bool resend;
+} hwsim_resync_action;
+
+/*
+ * Table of outstanding requests keyed by nlmsg_seq. At most window
+ * requests are in flight; replies are matched by their sequence number.
+ * Requests not answered within timeout_ms complete with -ETIMEDOUT
+ * (0 waits forever).
+ */
+typedef struct {
+    const netlink_ctx *nl_ctx;
+    /*
+     * Held while a request is sent and while a resync starts, so that the
+     * resync dump is ordered after every request it marks. Taken before
+     * lock and never held while a callback runs.
+     */
+    pthread_mutex_t send_lock;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    hwsim_request *slots;
+    size_t window;
+    // requests allowed in flight: halved by every overrun, grown back by one per limit replies
+    size_t limit;
+    size_t limit_credit;
+    size_t inflight;
+    uint32_t timeout_ms;
+    pthread_t event_thread;
+    bool event_running;
+    int stop_pipe[2];
+    hwsim_notify_cb notify_cb;
+    void *notify_arg;
+    hwsim_overrun_stats overrun;
+    // seq of the radio dump of the running resync, 0 if none
+    uint32_t resync_seq;
+    hwsim_resync_radio *resync_radios;
+    size_t resync_count;
+    size_t resync_cap;
+    int resync_error;
+    // one per slot, filled when the resync dump is complete
+    hwsim_resync_action *resync_actions;
+    /*
+     * Highest radio id seen in a create reply or resync dump, -1 if none.
+     * mac80211_hwsim hands out ids in increasing order, so every radio
+     * with a higher id was created after it.
+     */
+    int max_radio_id;
+    // libnl error that stopped the last receive, 0 if none
+    int receive_error;
+    // from the netlink context's config, NULL if not recording
+    struct hwsim_journal *journal;
+} hwsim_engine;
+
+uint64_t timespec_diff_ns(const struct timespec *from, const struct timespec *to);
+
+// CLOCK_MONOTONIC in ns
+uint64_t monotonic_ns();
+
+/*
+ * The engine owns the receive side of nl_ctx's socket from here on and
+ * makes it non-blocking, so every wakeup reads until the socket is empty.
+ * Returns 0 or -errno.
+ */
+int init_engine(hwsim_engine *engine, const netlink_ctx *nl_ctx, size_t window, uint32_t timeout_ms);
+
+void free_engine(hwsim_engine *engine);
+
+/*
+ * Sends op and registers cb to be called with the result. Returns -EBUSY
+ * if the window is full, -1 on send errors and 0 on success.
+ */
+int submit_request(hwsim_engine *engine, const hwsim_args *op, hwsim_request_cb cb, void *cb_arg);
+
+/*
+ * Blocks until submit_request() has a free slot (or soon will).
+ */
+void wait_for_slot(hwsim_engine *engine);
+
+/*
+ * Like submit_request(), but waits for a free slot instead of returning
+ * -EBUSY. Must not be called from the event thread.
+ */
+int submit_request_wait(hwsim_engine *engine, const hwsim_args *op, hwsim_request_cb cb, void *cb_arg);
 
-int wait_for_event();
+/*
+ * Like submit_request(), but every data message answering op (e.g. each
+ * part of a dump) is passed to reply_cb before cb completes the request.
+ */
+int submit_request_with_replies(hwsim_engine *engine, const hwsim_args *op, hwsim_reply_cb reply_cb,
+                                hwsim_request_cb cb, void *cb_arg);
+
+size_t requests_inflight(hwsim_engine *engine);
+
+/*
+ * Passes unsolicited messages (multicast notifications, which carry no
+ * sequence number) to cb. NULL removes the handler.
+ */
+void set_notify_handler(hwsim_engine *engine, hwsim_notify_cb cb, void *arg);
+
+/*
+ * Waits up to 100 ms for replies and dispatches everything queued, for
+ * callers without an event loop. Returns -1 on socket errors.
+ *
+ * When the kernel reports an overrun (ENOBUFS, messages for this socket
+ * were dropped), replies of requests already sent may be lost. The engine
+ * then dumps the radios and, once the dump is complete, settles every
+ * request sent before the overrun that is still waiting: a named create
+ * whose radio exists succeeds with its id, a delete whose radio is gone
+ * succeeds, set, rename and the remaining deletes and named creates are
+ * sent again; unnamed creates and dumps fail with -ENOBUFS. Multicast
+ * notifications are lost as well, so the dump is also passed to the
+ * notify handler (nonzero nlmsg_seq), followed by its NLMSG_DONE.
+ */
+int receive_replies(hwsim_engine *engine);
+
+// returns 0 or -errno like register_event()
+int register_callbacks(hwsim_engine *engine);
+
+/*
+ * Dispatches replies from the netlink socket inside ev_base.
+ */
+struct event *add_nl_event(hwsim_engine *engine, struct event_base *ev_base);
+
+/*
+ * Starts a thread dispatching replies; stopped by unregister_event().
+ * Returns 0 or -errno.
+ */
+int register_event(hwsim_engine *engine);
+
+void unregister_event(hwsim_engine *engine);
+
+/*
+ * Blocks until at most max_inflight requests are outstanding, completing
+ * requests whose deadline has passed with -ETIMEDOUT.
+ */
+void wait_for_requests(hwsim_engine *engine, size_t max_inflight);
+
+void wait_for_event(hwsim_engine *engine);
+
+/*
+ * Blocks until signal_done() sets *done. Lets a caller wait for one
+ * particular request while other threads use the same engine.
+ */
+void wait_until(hwsim_engine *engine, const bool *done);
+
+void signal_done(hwsim_engine *engine, bool *done);
+
+/*
+ * Completes overdue requests without blocking, for callers that run their
+ * own event loop.
+ */
+void check_deadlines(hwsim_engine *engine);
+
+void get_overrun_stats(hwsim_engine *engine, hwsim_overrun_stats *stats);
+
+/*
+ * Formats the overrun counters of count engines as one line of
+ * key=value pairs.
+ */
+void print_overrun_stats(hwsim_engine *engines, size_t count, char *buf, size_t len);
 
 #endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_EVENT_H
@@ -5,164 +5,485 @@
 
 #include <netlink/netlink.h>
 #include <netlink/genl/genl.h>
-#include <netlink/genl/ctrl.h>
-#include <netlink/genl/family.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "hwsim_mgmt_func.h"
 
-int init_netlink(netlink_ctx *ctx) {
+static int ctx_error(netlink_ctx *ctx, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(ctx->error, sizeof(ctx->error), fmt, ap);
+    va_end(ap);
+    return EXIT_FAILURE;
+}
+
+/*
+ * SO_RCVBUFFORCE/SO_SNDBUFFORCE let CAP_NET_ADMIN (which creating radios
+ * needs anyway) exceed net.core.rmem_max/wmem_max.
+ */
+static int set_buffer(netlink_ctx *ctx, int force_opt, int opt, uint32_t bytes) {
+    int fd = nl_socket_get_fd(ctx->sock);
+    int val = bytes > INT_MAX ? INT_MAX : (int) bytes;
+    if (setsockopt(fd, SOL_SOCKET, force_opt, &val, sizeof(val))
+        && setsockopt(fd, SOL_SOCKET, opt, &val, sizeof(val))) {
+        return ctx_error(ctx, "Error setting socket buffer to %u bytes: %s", bytes, strerror(errno));
+    }
+    return EXIT_SUCCESS;
+}
+
+static int connect_mock(netlink_ctx *ctx) {
+    int ret = nl_connect(ctx->sock, NETLINK_USERSOCK);
+    if (ret < 0) {
+        return ctx_error(ctx, "Error connecting mock netlink socket: %s", nl_geterror(ret));
+    }
+    nl_socket_set_peer_port(ctx->sock, ctx->config.mock_port);
+    // the mock overruns full sockets through this group
+    ret = nl_socket_add_membership(ctx->sock, HWSIM_MOCK_OVERRUN_GROUP);
+    if (ret < 0) {
+        return ctx_error(ctx, "Error joining mock overrun group: %s", nl_geterror(ret));
+    }
+    ctx->family.id = HWSIM_MOCK_FAMILY_ID;
+    ctx->family.version = 1;
+    ctx->family.maxattr = __HWSIM_ATTR_MAX - 1;
+    ctx->family.cmds = 1ull << HWSIM_CMD_REGISTER | 1ull << HWSIM_CMD_FRAME | 1ull << HWSIM_CMD_TX_INFO_FRAME
+                       | 1ull << HWSIM_CMD_NEW_RADIO | 1ull << HWSIM_CMD_DEL_RADIO | 1ull << HWSIM_CMD_GET_RADIO;
+    ctx->family.config_group = HWSIM_MOCK_CONFIG_GROUP;
+    return EXIT_SUCCESS;
+}
+
+static void parse_family(struct nlmsghdr *nlh, hwsim_family *family) {
+    struct nlattr *tb[CTRL_ATTR_MAX + 1];
+    struct nlattr *nla;
+    int rem;
+
+    if (genlmsg_parse(nlh, 0, tb, CTRL_ATTR_MAX, NULL) < 0 || !tb[CTRL_ATTR_FAMILY_ID]) {
+        return;
+    }
+    family->id = nla_get_u16(tb[CTRL_ATTR_FAMILY_ID]);
+    if (tb[CTRL_ATTR_VERSION]) {
+        family->version = nla_get_u32(tb[CTRL_ATTR_VERSION]);
+    }
+    if (tb[CTRL_ATTR_MAXATTR]) {
+        family->maxattr = nla_get_u32(tb[CTRL_ATTR_MAXATTR]);
+    }
+    if (tb[CTRL_ATTR_OPS]) {
+        nla_for_each_nested(nla, tb[CTRL_ATTR_OPS], rem) {
+            struct nlattr *op[CTRL_ATTR_OP_MAX + 1];
+            if (nla_parse_nested(op, CTRL_ATTR_OP_MAX, nla, NULL) >= 0 && op[CTRL_ATTR_OP_ID]
+                && nla_get_u32(op[CTRL_ATTR_OP_ID]) < 64) {
+                family->cmds |= 1ull << nla_get_u32(op[CTRL_ATTR_OP_ID]);
+            }
+        }
+    }
+    if (tb[CTRL_ATTR_MCAST_GROUPS]) {
+        nla_for_each_nested(nla, tb[CTRL_ATTR_MCAST_GROUPS], rem) {
+            struct nlattr *grp[CTRL_ATTR_MCAST_GRP_MAX + 1];
+            if (nla_parse_nested(grp, CTRL_ATTR_MCAST_GRP_MAX, nla, NULL) >= 0 && grp[CTRL_ATTR_MCAST_GRP_NAME]
+                && grp[CTRL_ATTR_MCAST_GRP_ID] && !strcmp(nla_get_string(grp[CTRL_ATTR_MCAST_GRP_NAME]), "config")) {
+                family->config_group = nla_get_u32(grp[CTRL_ATTR_MCAST_GRP_ID]);
+            }
+        }
+    }
+}
+
+/*
+ * Asks the controller for this one family (CTRL_CMD_GETFAMILY by name)
+ * instead of downloading every registered family. Returns 0 or a
+ * negative errno value from the kernel.
+ */
+static int resolve_family(struct nl_sock *sock, const char *name, hwsim_family *family) {
+    hwsim_msg msg;
+    uint32_t seq = nl_socket_use_seq(sock);
+    int ret = 1;
+
+    memset(family, 0, sizeof(*family));
+    memset(&msg.hdr, 0, sizeof(msg.hdr));
+    msg.hdr.nlh.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    msg.hdr.nlh.nlmsg_type = GENL_ID_CTRL;
+    msg.hdr.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    msg.hdr.nlh.nlmsg_seq = seq;
+    msg.hdr.nlh.nlmsg_pid = nl_socket_get_local_port(sock);
+    msg.hdr.genl.cmd = CTRL_CMD_GETFAMILY;
+    msg.hdr.genl.version = 1;
+    if (msg_put_string(&msg, CTRL_ATTR_FAMILY_NAME, name) || nl_sendto(sock, msg.data, msg.hdr.nlh.nlmsg_len) < 0) {
+        return -EIO;
+    }
+    // the family comes first, then the ACK (or only an error)
+    while (ret > 0) {
+        struct sockaddr_nl peer;
+        unsigned char *buf = NULL;
+        int len = nl_recv(sock, &peer, &buf, NULL);
+        struct nlmsghdr *nlh = (struct nlmsghdr *) buf;
+        if (len <= 0) {
+            free(buf);
+            return -EIO;
+        }
+        for (; nlmsg_ok(nlh, len); nlh = nlmsg_next(nlh, &len)) {
+            if (nlh->nlmsg_seq != seq) {
+                continue;
+            }
+            if (nlh->nlmsg_type == NLMSG_ERROR) {
+                ret = ((struct nlmsgerr *) nlmsg_data(nlh))->error;
+            } else if (nlh->nlmsg_type == GENL_ID_CTRL) {
+                parse_family(nlh, family);
+            }
+        }
+        free(buf);
+    }
+    return ret ? ret : (family->id ? 0 : -ENOENT);
+}
+
+/*
+ * Identifies the loaded module: the id of a family changes whenever the
+ * module is reloaded, which also creates a new /sys/module directory.
+ */
+static int read_cache_key(char *boot_id, size_t len, unsigned long *module_ino) {
+    struct stat st;
+    FILE *f = fopen("/proc/sys/kernel/random/boot_id", "r");
+    if (!f) {
+        return -1;
+    }
+    if (!fgets(boot_id, (int) len, f)) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    boot_id[strcspn(boot_id, "\n")] = '\0';
+    if (stat("/sys/module/mac80211_hwsim", &st) < 0) {
+        return -1;
+    }
+    *module_ino = (unsigned long) st.st_ino;
+    return 0;
+}
+
+static int load_family(const char *path, hwsim_family *family) {
+    char boot_id[64], cached_boot_id[64];
+    unsigned long module_ino, cached_ino;
+    unsigned long long cmds;
+    unsigned int id;
+    FILE *f;
     int ret;
 
+    if (read_cache_key(boot_id, sizeof(boot_id), &module_ino) || !(f = fopen(path, "r"))) {
+        return -1;
+    }
+    ret = fscanf(f, "%63s %lu %u %" SCNu32 " %" SCNu32 " %llx %" SCNu32, cached_boot_id, &cached_ino, &id,
+                 &family->version, &family->maxattr, &cmds, &family->config_group);
+    fclose(f);
+    if (ret != 7 || strcmp(boot_id, cached_boot_id) != 0 || module_ino != cached_ino || !id || id > UINT16_MAX) {
+        return -1;
+    }
+    family->id = (uint16_t) id;
+    family->cmds = cmds;
+    return 0;
+}
+
+static void save_family(const char *path, const hwsim_family *family) {
+    char boot_id[64];
+    char tmp[PATH_MAX];
+    unsigned long module_ino;
+    FILE *f;
+
+    if (read_cache_key(boot_id, sizeof(boot_id), &module_ino)
+        || snprintf(tmp, sizeof(tmp), "%s.%d", path, (int) getpid()) >= (int) sizeof(tmp)
+        || !(f = fopen(tmp, "w"))) {
+        return;
+    }
+    fprintf(f, "%s %lu %u %" PRIu32 " %" PRIu32 " %llx %" PRIu32 "\n", boot_id, module_ino, family->id,
+            family->version, family->maxattr, (unsigned long long) family->cmds, family->config_group);
+    // readers see either the old or the complete new entry
+    if (fclose(f) || rename(tmp, path)) {
+        unlink(tmp);
+    }
+}
+
+static int connect_genl(netlink_ctx *ctx) {
+    const char *cache = ctx->config.family_cache;
+    int ret = genl_connect(ctx->sock);
+    if (ret < 0) {
+        return ctx_error(ctx, "Error connecting netlink socket: %s", nl_geterror(ret));
+    }
+    if (cache && !load_family(cache, &ctx->family)) {
+        return EXIT_SUCCESS;
+    }
+    ret = resolve_family(ctx->sock, HWSIM_FAMILY_NAME, &ctx->family);
+    if (ret == -ENOENT) {
+        return ctx_error(ctx, "Family %s not registered", HWSIM_FAMILY_NAME);
+    } else if (ret < 0) {
+        return ctx_error(ctx, "Error resolving family %s: %s", HWSIM_FAMILY_NAME, strerror(-ret));
+    }
+    if (cache) {
+        save_family(cache, &ctx->family);
+    }
+    return EXIT_SUCCESS;
+}
+
+int init_netlink(netlink_ctx *ctx, const hwsim_config *config) {
+    memset(ctx, 0, sizeof(*ctx));
+    if (config) {
+        ctx->config = *config;
+    }
+
     ctx->cb = nl_cb_alloc(NL_CB_CUSTOM);
     if (!ctx->cb) {
-        fprintf(stderr, "Error allocating netlink callbacks\n");
-        return EXIT_FAILURE;
+        return ctx_error(ctx, "Error allocating netlink callbacks");
     }
 
     ctx->sock = nl_socket_alloc_cb(ctx->cb);
     if (!ctx->sock) {
-        fprintf(stderr, "Error allocating netlink socket\n");
-        return EXIT_FAILURE;
+        return ctx_error(ctx, "Error allocating netlink socket");
     }
 
-    ret = genl_connect(ctx->sock);
-    if (ret < 0) {
-        fprintf(stderr, "Error connecting netlink socket ret=%d\n", ret);
+    if (ctx->config.mock_port ? connect_mock(ctx) : connect_genl(ctx)) {
         return EXIT_FAILURE;
     }
-
-    ret = genl_ctrl_alloc_cache(ctx->sock, &ctx->cache);
-    if (ret < 0) {
-        fprintf(stderr, "Error allocationg netlink cache ret=%d\n", ret);
+    // set after connecting, which applies the libnl defaults
+    if (ctx->config.rcvbuf && set_buffer(ctx, SO_RCVBUFFORCE, SO_RCVBUF, ctx->config.rcvbuf)) {
         return EXIT_FAILURE;
     }
-
-    ctx->family = genl_ctrl_search_by_name(ctx->cache, "MAC80211_HWSIM");
-
-    if (!ctx->family) {
-        fprintf(stderr, "Family MAC80211_HWSIM not registered\n");
+    if (ctx->config.sndbuf && set_buffer(ctx, SO_SNDBUFFORCE, SO_SNDBUF, ctx->config.sndbuf)) {
         return EXIT_FAILURE;
     }
 
+    // the kernel only acknowledges successful requests that ask for it
+    ctx->msg_template.nlh.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    ctx->msg_template.nlh.nlmsg_type = ctx->family.id;
+    ctx->msg_template.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    ctx->msg_template.nlh.nlmsg_pid = nl_socket_get_local_port(ctx->sock);
+    ctx->msg_template.genl.version = 1;
+
     return EXIT_SUCCESS;
 }
 
-int create_radio(const netlink_ctx *ctx, const uint32_t channels, const bool no_vif, const char *hwname,
-                 const bool use_chanctx, const char *reg_alpha2,
-                 const uint32_t reg_custom_reg) {
-    struct nl_msg *msg;
-    msg = nlmsg_alloc();
-
-    if (!msg) {
-        fprintf(stderr, "Error allocating new message!\n");
-        return EXIT_FAILURE;
+int resolve_nl80211(netlink_ctx *ctx) {
+    hwsim_family nl80211;
+    int ret;
+    if (ctx->config.mock_port) {
+        ctx->nl80211_id = HWSIM_MOCK_NL80211_ID;
+        return EXIT_SUCCESS;
     }
-    int fam_id = genl_family_get_id(ctx->family);
-    if (genlmsg_put(msg, NL_AUTO_PID, NL_AUTO_SEQ,
-                    fam_id, 0,
-                    NLM_F_REQUEST, HWSIM_CMD_NEW_RADIO,
-                    1) == NULL) {
-        fprintf(stderr, "Error in genlmsg_put!\n");
-        nlmsg_free(msg);
-        return EXIT_FAILURE;
+    if ((ret = resolve_family(ctx->sock, NL80211_FAMILY_NAME, &nl80211))) {
+        return ctx_error(ctx, "Error resolving family %s: %s", NL80211_FAMILY_NAME, strerror(-ret));
     }
-    if (channels != 0) {
-        nla_put_u32(msg, HWSIM_ATTR_CHANNELS, channels);
+    ctx->nl80211_id = nl80211.id;
+    return EXIT_SUCCESS;
+}
+
+int join_config_group(const netlink_ctx *ctx) {
+    int ret;
+    if (!ctx->family.config_group) {
+        return -EOPNOTSUPP;
     }
-    if (no_vif) {
-        nla_put_flag(msg, HWSIM_ATTR_NO_VIF);
+    ret = nl_socket_add_membership(ctx->sock, (int) ctx->family.config_group);
+    return ret < 0 ? -EIO : 0;
+}
+
+void free_netlink(netlink_ctx *ctx) {
+    if (ctx->sock && ctx->config.mock_port) {
+        // the mock cannot see the socket close, tell it instead
+        struct nlmsghdr release = {NLMSG_HDRLEN, NLMSG_NOOP, NLM_F_REQUEST, 0, 0};
+        nl_sendto(ctx->sock, &release, sizeof(release));
     }
-    if (hwname) {
-        nla_put_string(msg, HWSIM_ATTR_RADIO_NAME, hwname);
+    if (ctx->sock) {
+        nl_socket_free(ctx->sock);
     }
-    if (use_chanctx) {
-        nla_put_flag(msg, HWSIM_ATTR_USE_CHANCTX);
+    if (ctx->cb) {
+        nl_cb_put(ctx->cb);
     }
-    if (reg_alpha2 != NULL) {
-        nla_put_string(msg, HWSIM_ATTR_REG_HINT_ALPHA2, reg_alpha2);
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+/*
+ * Requests are built in a caller-provided buffer instead of an nl_msg:
+ * the netlink and genl headers come from the per-socket template, only
+ * seq, flags and the attributes are filled in per message.
+ */
+static void init_msg(const netlink_ctx *ctx, hwsim_msg *msg, const uint32_t seq, const uint8_t cmd,
+                     const int flags) {
+    msg->hdr = ctx->msg_template;
+    msg->hdr.nlh.nlmsg_flags |= flags;
+    msg->hdr.nlh.nlmsg_seq = seq;
+    msg->hdr.genl.cmd = cmd;
+}
+
+int msg_put_attr(hwsim_msg *msg, const uint16_t type, const void *data, const uint16_t len) {
+    struct nlmsghdr *hdr = &msg->hdr.nlh;
+    struct nlattr *nla = (struct nlattr *) ((uint8_t *) hdr + NLMSG_ALIGN(hdr->nlmsg_len));
+    if (NLMSG_ALIGN(hdr->nlmsg_len) + nla_total_size(len) > sizeof(msg->data)) {
+        return -1;
     }
-    if (reg_custom_reg != 0) {
-        nla_put_u32(msg, HWSIM_ATTR_REG_CUSTOM_REG, reg_custom_reg);
+    nla->nla_type = type;
+    nla->nla_len = (uint16_t) nla_attr_size(len);
+    if (len) {
+        memcpy(nla_data(nla), data, len);
+        memset((uint8_t *) nla_data(nla) + len, 0, nla_padlen(len));
     }
-    if (nl_send_auto(ctx->sock, msg) < 0) {
-        fprintf(stderr, "Error sending message!\n");
-        nlmsg_free(msg);
-        return EXIT_FAILURE;
+    hdr->nlmsg_len = NLMSG_ALIGN(hdr->nlmsg_len) + nla_total_size(len);
+    return 0;
+}
+
+int msg_put_u32(hwsim_msg *msg, const uint16_t type, const uint32_t value) {
+    return msg_put_attr(msg, type, &value, sizeof(value));
+}
+
+int msg_put_flag(hwsim_msg *msg, const uint16_t type) {
+    return msg_put_attr(msg, type, NULL, 0);
+}
+
+int msg_put_string(hwsim_msg *msg, const uint16_t type, const char *str) {
+    size_t len = strlen(str) + 1;
+    if (len > UINT16_MAX) {
+        return -1;
     }
-    return EXIT_SUCCESS;
+    return msg_put_attr(msg, type, str, (uint16_t) len);
 }
 
-int delete_radio_by_id(const netlink_ctx *ctx, const uint32_t radio_id) {
-    struct nl_msg *msg;
-    msg = nlmsg_alloc();
-    if (!msg) {
-        fprintf(stderr, "Error allocating new message!\n");
+/*
+ * Engine sockets are non-blocking. The kernel never refuses a request for
+ * lack of room, only a userspace peer (the mock) does; wait for it like a
+ * blocking socket would.
+ */
+static int send_buf(const netlink_ctx *ctx, void *buf, size_t len) {
+    int ret;
+    while ((ret = nl_sendto(ctx->sock, buf, len)) == -NLE_AGAIN) {
+        sched_yield();
+    }
+    return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static int send_msg(const netlink_ctx *ctx, hwsim_msg *msg) {
+    return send_buf(ctx, msg->data, msg->hdr.nlh.nlmsg_len);
+}
+
+int create_radio(const netlink_ctx *ctx, const uint32_t seq, const uint32_t channels, const bool no_vif,
+                 const char *hwname, const bool use_chanctx, const char *reg_alpha2,
+                 const uint32_t reg_custom_reg, const bool destroy_on_close) {
+    hwsim_msg msg;
+    init_msg(ctx, &msg, seq, HWSIM_CMD_NEW_RADIO, 0);
+    if (channels != 0 && msg_put_u32(&msg, HWSIM_ATTR_CHANNELS, channels)) {
         return EXIT_FAILURE;
     }
-    if (genlmsg_put(msg, NL_AUTO_PID, NL_AUTO_SEQ,
-                    genl_family_get_id(ctx->family), 0,
-                    NLM_F_REQUEST, HWSIM_CMD_DEL_RADIO,
-                    1) == NULL) {
-        fprintf(stderr, "Error in genlmsg_put!\n");
-        nlmsg_free(msg);
+    if (no_vif && msg_put_flag(&msg, HWSIM_ATTR_NO_VIF)) {
         return EXIT_FAILURE;
     }
-    nla_put_u32(msg, HWSIM_ATTR_RADIO_ID, radio_id);
-    if (nl_send_auto(ctx->sock, msg) < 0) {
-        fprintf(stderr, "Error sending message!\n");
-        nlmsg_free(msg);
+    if (hwname && msg_put_string(&msg, HWSIM_ATTR_RADIO_NAME, hwname)) {
         return EXIT_FAILURE;
     }
-    return EXIT_SUCCESS;
+    if (use_chanctx && msg_put_flag(&msg, HWSIM_ATTR_USE_CHANCTX)) {
+        return EXIT_FAILURE;
+    }
+    if (reg_alpha2 != NULL && msg_put_string(&msg, HWSIM_ATTR_REG_HINT_ALPHA2, reg_alpha2)) {
+        return EXIT_FAILURE;
+    }
+    if (reg_custom_reg != 0 && msg_put_u32(&msg, HWSIM_ATTR_REG_CUSTOM_REG, reg_custom_reg)) {
+        return EXIT_FAILURE;
+    }
+    // the kernel deletes the radio when this socket is closed
+    if (destroy_on_close && msg_put_flag(&msg, HWSIM_ATTR_DESTROY_RADIO_ON_CLOSE)) {
+        return EXIT_FAILURE;
+    }
+    return send_msg(ctx, &msg);
 }
 
-int delete_radio_by_name(const netlink_ctx *ctx, const char *radio_name) {
-    struct nl_msg *msg;
-    msg = nlmsg_alloc();
-    if (!msg) {
-        fprintf(stderr, "Error allocating new message!\n");
+int delete_radio_by_id(const netlink_ctx *ctx, const uint32_t seq, const uint32_t radio_id) {
+    hwsim_msg msg;
+    init_msg(ctx, &msg, seq, HWSIM_CMD_DEL_RADIO, 0);
+    if (msg_put_u32(&msg, HWSIM_ATTR_RADIO_ID, radio_id)) {
         return EXIT_FAILURE;
     }
-    if (genlmsg_put(msg, NL_AUTO_PID, NL_AUTO_SEQ,
-                    genl_family_get_id(ctx->family), 0,
-                    NLM_F_REQUEST, HWSIM_CMD_DEL_RADIO,
-                    1) == NULL) {
-        fprintf(stderr, "Error in genlmsg_put!\n");
-        nlmsg_free(msg);
+    return send_msg(ctx, &msg);
+}
+
+int delete_radio_by_name(const netlink_ctx *ctx, const uint32_t seq, const char *radio_name) {
+    hwsim_msg msg;
+    init_msg(ctx, &msg, seq, HWSIM_CMD_DEL_RADIO, 0);
+    if (msg_put_string(&msg, HWSIM_ATTR_RADIO_NAME, radio_name)) {
         return EXIT_FAILURE;
     }
-    nla_put_string(msg, HWSIM_ATTR_RADIO_NAME, radio_name);
-    if (nl_send_auto(ctx->sock, msg) < 0) {
-        fprintf(stderr, "Error sending message!\n");
-        nlmsg_free(msg);
+    return send_msg(ctx, &msg);
+}
+
+int set_rssi(const netlink_ctx *ctx, const uint32_t seq, const uint32_t radio_id, const int32_t signal) {
+    hwsim_msg msg;
+    init_msg(ctx, &msg, seq, HWSIM_CMD_GET_RADIO, 0);
+    // the kernel reads the u32 attribute back as a signed dBm value
+    if (msg_put_u32(&msg, HWSIM_ATTR_SIGNAL, (uint32_t) signal)
+        || msg_put_u32(&msg, HWSIM_ATTR_RADIO_ID, radio_id)) {
         return EXIT_FAILURE;
     }
-    return EXIT_SUCCESS;
+    return send_msg(ctx, &msg);
+}
 
+static int put_props(const netlink_ctx *ctx, hwsim_msg *msg, const uint32_t seq, const hwsim_props *props) {
+    init_msg(ctx, msg, seq, HWSIM_CMD_GET_RADIO, 0);
+    if (msg_put_u32(msg, HWSIM_ATTR_RADIO_ID, props->radio_id)) {
+        return -1;
+    }
+    if ((props->set & HWSIM_PROP_SIGNAL) && msg_put_u32(msg, HWSIM_ATTR_SIGNAL, (uint32_t) props->signal)) {
+        return -1;
+    }
+    if ((props->set & HWSIM_PROP_FREQ) && msg_put_u32(msg, HWSIM_ATTR_FREQ, props->freq)) {
+        return -1;
+    }
+    if ((props->set & HWSIM_PROP_TX_INFO)
+        && (props->tx_info_count > HWSIM_TX_MAX_RATES
+            || msg_put_attr(msg, HWSIM_ATTR_TX_INFO, props->tx_info,
+                            (uint16_t) (props->tx_info_count * sizeof(hwsim_tx_rate))))) {
+        return -1;
+    }
+    return 0;
 }
 
-int set_rssi(const netlink_ctx *ctx, const uint32_t radio_id, const uint32_t rssi) {
-    struct nl_msg *msg;
+int set_props(const netlink_ctx *ctx, const uint32_t seq, const hwsim_props *props, const uint32_t count) {
+    uint8_t buf[HWSIM_PROPS_MAX * 128];
+    size_t len = 0;
+    uint32_t i;
 
-    msg = nlmsg_alloc();
-    if (!msg) {
-        fprintf(stderr, "Error allocating new message!\n");
+    if (!count || count > HWSIM_PROPS_MAX) {
         return EXIT_FAILURE;
     }
-    if (genlmsg_put(msg, NL_AUTO_PID, NL_AUTO_SEQ,
-                    genl_family_get_id(ctx->family), 0,
-                    NLM_F_REQUEST, HWSIM_CMD_GET_RADIO,
-                    1) == NULL) {
-        fprintf(stderr, "Error in genlmsg_put!\n");
-        nlmsg_free(msg);
+    for (i = 0; i < count; i++) {
+        hwsim_msg msg;
+        if (put_props(ctx, &msg, seq, &props[i])) {
+            return EXIT_FAILURE;
+        }
+        if (len + NLMSG_ALIGN(msg.hdr.nlh.nlmsg_len) > sizeof(buf)) {
+            return EXIT_FAILURE;
+        }
+        memcpy(buf + len, msg.data, msg.hdr.nlh.nlmsg_len);
+        len += NLMSG_ALIGN(msg.hdr.nlh.nlmsg_len);
+    }
+    return send_buf(ctx, buf, len);
+}
+
+int register_medium(const netlink_ctx *ctx, const uint32_t seq) {
+    hwsim_msg msg;
+    init_msg(ctx, &msg, seq, HWSIM_CMD_REGISTER, 0);
+    return send_msg(ctx, &msg);
+}
+
+int rename_wiphy(const netlink_ctx *ctx, const uint32_t seq, const uint32_t wiphy_idx, const char *name) {
+    hwsim_msg msg;
+    if (!ctx->nl80211_id) {
         return EXIT_FAILURE;
     }
-    nla_put_u32(msg, HWSIM_ATTR_SIGNAL, rssi * -1);
-    nla_put_u32(msg, HWSIM_ATTR_RADIO_ID, radio_id);
-    if (nl_send_auto(ctx->sock, msg) < 0) {
-        fprintf(stderr, "Error sending message!\n");
-        nlmsg_free(msg);
+    init_msg(ctx, &msg, seq, NL80211_CMD_SET_WIPHY, 0);
+    msg.hdr.nlh.nlmsg_type = ctx->nl80211_id;
+    if (msg_put_u32(&msg, NL80211_ATTR_WIPHY, wiphy_idx) || msg_put_string(&msg, NL80211_ATTR_WIPHY_NAME, name)) {
         return EXIT_FAILURE;
     }
-    return EXIT_SUCCESS;
+    return send_msg(ctx, &msg);
+}
+
+int dump_radios(const netlink_ctx *ctx, const uint32_t seq) {
+    hwsim_msg msg;
+    init_msg(ctx, &msg, seq, HWSIM_CMD_GET_RADIO, NLM_F_DUMP);
+    return send_msg(ctx, &msg);
 }
@@ -7,6 +7,9 @@
 #define MAC80211_HWSIM_MGMT_HWSIM_MGMT_FUNC_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
 
 #define HWSIM_CMD_UNSPEC 0
 #define HWSIM_CMD_REGISTER 1
@@ -17,6 +20,12 @@
 #define HWSIM_CMD_GET_RADIO 6
 #define __HWSIM_CMD_MAX 7
 
+// the parts of nl80211 needed to rename a radio's wiphy
+#define NL80211_FAMILY_NAME "nl80211"
+#define NL80211_CMD_SET_WIPHY 2
+#define NL80211_ATTR_WIPHY 1
+#define NL80211_ATTR_WIPHY_NAME 2
+
 #define HWSIM_ATTR_UNSPEC 0
 #define HWSIM_ATTR_ADDR_RECEIVER 1
 #define HWSIM_ATTR_ADDR_TRANSMITTER 2
@@ -40,23 +49,274 @@
 #define HWSIM_ATTR_PAD 20
 #define __HWSIM_ATTR_MAX 21
 
+// HWSIM_ATTR_FLAGS of frames passed through a medium
+#define HWSIM_TX_CTL_REQ_TX_STATUS 0x1
+#define HWSIM_TX_CTL_NO_ACK 0x2
+#define HWSIM_TX_STAT_ACK 0x4
+
+enum op_mode {
+    HWSIM_OP_NONE,
+    HWSIM_OP_CREATE,
+    HWSIM_OP_DELETE_BY_ID,
+    HWSIM_OP_DELETE_BY_NAME,
+    HWSIM_OP_SET_RSSI,
+    HWSIM_OP_BATCH,
+    HWSIM_OP_DAEMON,
+    HWSIM_OP_RSSI_STREAM,
+    HWSIM_OP_LIST,
+    HWSIM_OP_LOOKUP,
+    HWSIM_OP_SET_PROPS,
+    HWSIM_OP_RENAME,
+    HWSIM_OP_APPLY,
+    HWSIM_OP_BENCH,
+    HWSIM_OP_WATCH,
+    HWSIM_OP_REPLAY,
+    HWSIM_OP_PROBE,
+    HWSIM_OP_TEARDOWN,
+    HWSIM_OP_MEDIUM,
+    HWSIM_OP_JOURNAL_REPLAY,
+    HWSIM_OP_SCALE
+};
+
+#define HWSIM_RSSI_MIN (-128)
+#define HWSIM_TX_MAX_RATES 4
+#define HWSIM_PROPS_MAX 64
+
+#define HWSIM_PROP_SIGNAL 0x1
+#define HWSIM_PROP_FREQ 0x2
+#define HWSIM_PROP_TX_INFO 0x4
+
+/*
+ * Layout of struct hwsim_tx_rate in HWSIM_ATTR_TX_INFO.
+ */
+typedef struct {
+    int8_t idx;
+    uint8_t count;
+} hwsim_tx_rate;
+
+/*
+ * Properties of one radio; only the fields flagged in set (HWSIM_PROP_*)
+ * are sent. signal is in dBm, freq in MHz.
+ */
+typedef struct {
+    uint32_t radio_id;
+    uint32_t set;
+    int32_t signal;
+    uint32_t freq;
+    hwsim_tx_rate tx_info[HWSIM_TX_MAX_RATES];
+    uint32_t tx_info_count;
+} hwsim_props;
+
+typedef struct {
+    enum op_mode mode;
+    char *c_hwname;
+    uint32_t c_channels;
+    bool c_no_vif;
+    bool c_use_chanctx;
+    bool c_destroy_on_close;
+    char *c_reg_alpha2;
+    uint32_t c_reg_custom_reg;
+    uint32_t del_radio_id;
+    char *del_radio_name;
+    char *lookup_name;
+    uint32_t rssi_radio;
+    int32_t rssi_dbm;
+    const hwsim_props *props;
+    uint32_t props_count;
+    hwsim_props s_props;
+    uint32_t wiphy_idx;
+    char *new_name;
+    char *batch_file;
+    char *daemon_socket;
+    char *rssi_stream;
+    char *topology_file;
+    char *replay_file;
+    char *medium_file;
+    char *pcap_file;
+    char *journal_file;
+    char *journal_replay;
+    bool journal_fast;
+    uint32_t bench_ops;
+    // 0 = no limit
+    uint32_t bench_max_p99_us;
+    uint32_t scale_radios;
+    uint32_t scale_step;
+    uint32_t scale_inflight;
+    bool scale_kernel;
+    uint32_t tick_ms;
+    bool json;
+    uint32_t window;
+    uint32_t sockets;
+    uint32_t max_failures;
+    bool session;
+    uint32_t prewarm;
+    // NULL deletes every radio
+    char *teardown_pattern;
+    bool teardown_regex;
+    bool teardown_session;
+    uint32_t prewarm_low;
+    uint32_t timeout_ms;
+    char *family_cache;
+    uint32_t rcvbuf;
+    uint32_t sndbuf;
+    bool mock;
+    uint32_t mock_latency_us;
+    uint32_t mock_fail_every;
+    uint32_t mock_errno;
+} hwsim_args;
+
+#define HWSIM_MSG_SIZE 512
+
+typedef struct {
+    struct nlmsghdr nlh;
+    struct genlmsghdr genl;
+} hwsim_msg_hdr;
+
+/*
+ * Buffer a request is built in. Attributes that do not fit (e.g. overly
+ * long radio names) make the sender fail instead of allocating.
+ */
+typedef union {
+    hwsim_msg_hdr hdr;
+    uint8_t data[HWSIM_MSG_SIZE];
+} hwsim_msg;
+
+#define HWSIM_FAMILY_NAME "MAC80211_HWSIM"
+#define HWSIM_DEFAULT_FAMILY_CACHE "/run/hwsim_mgmt.family"
+
+/*
+ * The MAC80211_HWSIM family as announced by the generic netlink
+ * controller of the running kernel.
+ */
+typedef struct {
+    uint16_t id;
+    uint32_t version;
+    uint32_t maxattr;
+    // bit n is set if command n is supported
+    uint64_t cmds;
+    // 0 if the kernel has no "config" multicast group
+    uint32_t config_group;
+} hwsim_family;
+
+struct hwsim_journal;
+
+/*
+ * Settings of one netlink context, copied by init_netlink(). All zero
+ * talks to the kernel with the libnl defaults.
+ */
+typedef struct {
+    // NETLINK_USERSOCK port of the mock backend (hwsim_mgmt_mock.h), 0 for the kernel
+    uint32_t mock_port;
+    /*
+     * Keeps the resolved family in this file (NULL disables the cache). An
+     * entry is only used while the kernel boot id and the loaded
+     * mac80211_hwsim module are the same, so short-lived invocations skip
+     * the controller round trip.
+     */
+    const char *family_cache;
+    /*
+     * Receive and send buffer sizes in bytes (0 keeps the libnl default). A
+     * larger receive buffer absorbs bigger bursts of ACKs and notifications
+     * before the kernel has to drop them.
+     */
+    uint32_t rcvbuf;
+    uint32_t sndbuf;
+    // engines on this context append the creates, deletes and sets they complete (hwsim_mgmt_journal.h)
+    struct hwsim_journal *journal;
+} hwsim_config;
+
+#define HWSIM_ERROR_LEN 128
+
 typedef struct {
     struct nl_cb *cb;
     struct nl_sock *sock;
-    struct nl_cache *cache;
-    struct genl_family *family;
+    hwsim_config config;
+    hwsim_family family;
+    // 0 until resolve_nl80211()
+    uint16_t nl80211_id;
+    hwsim_msg_hdr msg_template;
+    // why the last init_netlink() or resolve_nl80211() failed
+    char error[HWSIM_ERROR_LEN];
 } netlink_ctx;
 
-int init_netlink(netlink_ctx *ctx);
+/*
+ * Family id the mock backend (hwsim_mgmt_mock.h) answers to.
+ */
+#define HWSIM_MOCK_FAMILY_ID 0x7f
+#define HWSIM_MOCK_NL80211_ID 0x7e
+#define HWSIM_MOCK_CONFIG_GROUP 1
+#define HWSIM_MOCK_OVERRUN_GROUP 2
+
+/*
+ * Opens the socket described by config (NULL for the defaults) and
+ * resolves the family. On failure ctx->error tells why.
+ */
+int init_netlink(netlink_ctx *ctx, const hwsim_config *config);
+
+void free_netlink(netlink_ctx *ctx);
+
+/*
+ * Looks up the nl80211 family for rename_wiphy(). Must not run while
+ * replies or notifications are expected on the socket.
+ */
+int resolve_nl80211(netlink_ctx *ctx);
+
+/*
+ * Subscribes to the "config" multicast group, where mac80211_hwsim
+ * announces every HWSIM_CMD_NEW_RADIO and HWSIM_CMD_DEL_RADIO. Returns
+ * -EOPNOTSUPP if the kernel has no such group.
+ */
+int join_config_group(const netlink_ctx *ctx);
+
+/*
+ * Append an attribute to msg. Return -1 if it does not fit.
+ */
+int msg_put_attr(hwsim_msg *msg, const uint16_t type, const void *data, const uint16_t len);
+
+int msg_put_u32(hwsim_msg *msg, const uint16_t type, const uint32_t value);
 
-int create_radio(const netlink_ctx *ctx, const uint32_t channels, const bool no_vif, const char *hwname,
-                 const bool use_chanctx, const char *reg_alpha2,
-                 const uint32_t reg_custom_reg);
+int msg_put_flag(hwsim_msg *msg, const uint16_t type);
 
-int delete_radio_by_id(const netlink_ctx *ctx, const uint32_t radio_id);
+int msg_put_string(hwsim_msg *msg, const uint16_t type, const char *str);
 
-int delete_radio_by_name(const netlink_ctx *ctx, const char *radio_name);
+/*
+ * Message senders: seq is stamped into the netlink header so that the reply
+ * can be matched to its request. The messages are sent as built, libnl's
+ * NL_AUTO_SEQ is not applied; every message also asks for an ACK.
+ */
+int create_radio(const netlink_ctx *ctx, const uint32_t seq, const uint32_t channels, const bool no_vif,
+                 const char *hwname, const bool use_chanctx, const char *reg_alpha2,
+                 const uint32_t reg_custom_reg, const bool destroy_on_close);
+
+int delete_radio_by_id(const netlink_ctx *ctx, const uint32_t seq, const uint32_t radio_id);
+
+int delete_radio_by_name(const netlink_ctx *ctx, const uint32_t seq, const char *radio_name);
+
+int set_rssi(const netlink_ctx *ctx, const uint32_t seq, const uint32_t radio_id, const int32_t signal);
+
+/*
+ * Sends one message per entry of props (at most HWSIM_PROPS_MAX) back to
+ * back in a single datagram. All of them carry seq, so the request is
+ * answered by count ACKs or errors.
+ */
+int set_props(const netlink_ctx *ctx, const uint32_t seq, const hwsim_props *props, const uint32_t count);
 
-int set_rssi(const netlink_ctx *ctx, const uint32_t radio_id, const uint32_t rssi);
+/*
+ * Registers the socket as the wireless medium: from now on the kernel
+ * passes every transmitted frame to it (HWSIM_CMD_FRAME) instead of
+ * delivering it itself.
+ */
+int register_medium(const netlink_ctx *ctx, const uint32_t seq);
+
+/*
+ * Renames wiphy wiphy_idx with NL80211_CMD_SET_WIPHY. mac80211_hwsim has
+ * no rename of its own, but reports the wiphy name as radio name.
+ */
+int rename_wiphy(const netlink_ctx *ctx, const uint32_t seq, const uint32_t wiphy_idx, const char *name);
+
+/*
+ * Requests a HWSIM_CMD_GET_RADIO dump: one reply per radio, then NLMSG_DONE.
+ */
+int dump_radios(const netlink_ctx *ctx, const uint32_t seq);
 
 #endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_FUNC_H
@@ -0,0 +1,250 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hwsim_mgmt_journal.h"
+
+#define JOURNAL_BUFFER (1u << 20)
+#define JOURNAL_ALIGN 8
+
+int open_journal(hwsim_journal *journal, const char *path) {
+    hwsim_journal_header header;
+    struct timespec now;
+
+    memset(journal, 0, sizeof(hwsim_journal));
+    journal->file = fopen(path, "wb");
+    if (!journal->file) {
+        return -errno;
+    }
+    setvbuf(journal->file, NULL, _IOFBF, JOURNAL_BUFFER);
+    clock_gettime(CLOCK_REALTIME, &now);
+    memcpy(header.magic, HWSIM_JOURNAL_MAGIC, sizeof(header.magic));
+    header.started_ns = htole64((uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec);
+    if (fwrite(&header, sizeof(header), 1, journal->file) != 1) {
+        int error = errno;
+        fclose(journal->file);
+        journal->file = NULL;
+        return -error;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &journal->started);
+    pthread_mutex_init(&journal->lock, NULL);
+    return 0;
+}
+
+int close_journal(hwsim_journal *journal) {
+    int ret;
+    // the lock stays usable, engines may still complete a stray request
+    pthread_mutex_lock(&journal->lock);
+    ret = fclose(journal->file) ? -errno : 0;
+    if (journal->write_error) {
+        ret = -journal->write_error;
+    }
+    journal->file = NULL;
+    pthread_mutex_unlock(&journal->lock);
+    return ret;
+}
+
+static uint8_t journal_flags(const hwsim_args *op) {
+    return (uint8_t) ((op->c_no_vif ? HWSIM_JOURNAL_NO_VIF : 0) | (op->c_use_chanctx ? HWSIM_JOURNAL_CHANCTX : 0)
+                      | (op->c_destroy_on_close ? HWSIM_JOURNAL_DESTROY_ON_CLOSE : 0));
+}
+
+static void encode_props(uint8_t *buf, const hwsim_props *props) {
+    hwsim_journal_props out;
+    uint32_t i;
+
+    out.radio_id = htole32(props->radio_id);
+    out.set = htole32(props->set);
+    out.signal = (int32_t) htole32((uint32_t) props->signal);
+    out.freq = htole32(props->freq);
+    for (i = 0; i < HWSIM_TX_MAX_RATES; i++) {
+        out.tx_info[i] = props->tx_info[i];
+    }
+    out.tx_info_count = htole32(props->tx_info_count);
+    memcpy(buf, &out, sizeof(out));
+}
+
+size_t encode_journal_record(const hwsim_journal *journal, const hwsim_request *req, uint8_t *buf) {
+    const hwsim_args *op = &req->op;
+    hwsim_journal_record rec;
+    size_t len = sizeof(rec);
+    size_t name_len = 0;
+    uint32_t i;
+
+    memset(&rec, 0, sizeof(rec));
+    switch (req->mode) {
+        case HWSIM_OP_CREATE:
+            rec.mode = HWSIM_JOURNAL_OP_CREATE;
+            name_len = strlen(req->name);
+            rec.flags = journal_flags(op);
+            rec.channels = htole32(op->c_channels);
+            rec.reg_custom_reg = htole32(op->c_reg_custom_reg);
+            if (op->c_reg_alpha2) {
+                memcpy(rec.alpha2, req->alpha2, sizeof(rec.alpha2));
+            }
+            break;
+        case HWSIM_OP_DELETE_BY_ID:
+            rec.mode = HWSIM_JOURNAL_OP_DELETE_BY_ID;
+            rec.radio_id = htole32(op->del_radio_id);
+            break;
+        case HWSIM_OP_DELETE_BY_NAME:
+            rec.mode = HWSIM_JOURNAL_OP_DELETE_BY_NAME;
+            name_len = strlen(req->name);
+            break;
+        case HWSIM_OP_SET_RSSI:
+            rec.mode = HWSIM_JOURNAL_OP_SET_RSSI;
+            rec.radio_id = htole32(op->rssi_radio);
+            rec.signal = (int32_t) htole32((uint32_t) op->rssi_dbm);
+            break;
+        case HWSIM_OP_SET_PROPS:
+            if (!op->props || op->props_count > HWSIM_PROPS_MAX) {
+                return 0;
+            }
+            rec.mode = HWSIM_JOURNAL_OP_SET_PROPS;
+            rec.props_count = (uint8_t) op->props_count;
+            for (i = 0; i < op->props_count; i++) {
+                encode_props(buf + len, &op->props[i]);
+                len += sizeof(hwsim_journal_props);
+            }
+            break;
+        default:
+            return 0;
+    }
+    memcpy(buf + len, req->name, name_len);
+    len += name_len;
+    memset(buf + len, 0, (JOURNAL_ALIGN - len % JOURNAL_ALIGN) % JOURNAL_ALIGN);
+    len = (len + JOURNAL_ALIGN - 1) & ~(size_t) (JOURNAL_ALIGN - 1);
+
+    rec.size = htole16((uint16_t) len);
+    rec.name_len = (uint8_t) name_len;
+    rec.result = (int32_t) htole32((uint32_t) (req->error < 0 ? req->error
+                                                              : req->mode == HWSIM_OP_CREATE ? req->radio_id : 0));
+    // requests submitted before the recording started count from its start
+    if (req->submitted.tv_sec > journal->started.tv_sec
+        || (req->submitted.tv_sec == journal->started.tv_sec && req->submitted.tv_nsec >= journal->started.tv_nsec)) {
+        rec.submitted_ns = htole64(timespec_diff_ns(&journal->started, &req->submitted));
+    }
+    rec.latency_us = htole32((uint32_t) (timespec_diff_ns(&req->submitted, &req->replied) / 1000));
+    memcpy(buf, &rec, sizeof(rec));
+    return len;
+}
+
+void write_journal_record(hwsim_journal *journal, const uint8_t *buf, size_t len) {
+    pthread_mutex_lock(&journal->lock);
+    if (journal->file && !journal->write_error) {
+        if (fwrite(buf, len, 1, journal->file) != 1) {
+            journal->write_error = errno ? errno : EIO;
+        } else {
+            journal->records++;
+        }
+    }
+    pthread_mutex_unlock(&journal->lock);
+}
+
+int read_journal_header(FILE *in, hwsim_journal_header *header) {
+    if (fread(header, sizeof(hwsim_journal_header), 1, in) != 1
+        || memcmp(header->magic, HWSIM_JOURNAL_MAGIC, sizeof(header->magic)) != 0) {
+        return -1;
+    }
+    header->started_ns = le64toh(header->started_ns);
+    return 0;
+}
+
+static void decode_props(hwsim_props *props, const uint8_t *buf) {
+    hwsim_journal_props in;
+    uint32_t i;
+
+    memcpy(&in, buf, sizeof(in));
+    props->radio_id = le32toh(in.radio_id);
+    props->set = le32toh(in.set);
+    props->signal = (int32_t) le32toh((uint32_t) in.signal);
+    props->freq = le32toh(in.freq);
+    for (i = 0; i < HWSIM_TX_MAX_RATES; i++) {
+        props->tx_info[i] = in.tx_info[i];
+    }
+    props->tx_info_count = le32toh(in.tx_info_count);
+    if (props->tx_info_count > HWSIM_TX_MAX_RATES) {
+        props->tx_info_count = HWSIM_TX_MAX_RATES;
+    }
+}
+
+int read_journal_record(FILE *in, hwsim_journal_entry *entry) {
+    uint8_t payload[HWSIM_JOURNAL_RECORD_MAX];
+    hwsim_args *op = &entry->op;
+    hwsim_journal_record rec;
+    size_t payload_len, got;
+    uint32_t i;
+
+    if ((got = fread(&rec, 1, sizeof(rec), in)) != sizeof(rec)) {
+        return !got && feof(in) ? 0 : -1;
+    }
+    rec.size = le16toh(rec.size);
+    if (rec.size < sizeof(rec) || rec.size % JOURNAL_ALIGN || rec.size - sizeof(rec) > sizeof(payload)) {
+        return -1;
+    }
+    payload_len = rec.size - sizeof(rec);
+    if (payload_len && fread(payload, payload_len, 1, in) != 1) {
+        return -1;
+    }
+    if (rec.name_len >= sizeof(entry->name)
+        || rec.name_len + (size_t) rec.props_count * sizeof(hwsim_journal_props) > payload_len
+        || rec.props_count > HWSIM_PROPS_MAX) {
+        return -1;
+    }
+
+    memset(op, 0, sizeof(hwsim_args));
+    memcpy(entry->name, payload + rec.props_count * sizeof(hwsim_journal_props), rec.name_len);
+    entry->name[rec.name_len] = '\0';
+    entry->result = (int32_t) le32toh((uint32_t) rec.result);
+    entry->submitted_ns = le64toh(rec.submitted_ns);
+    entry->latency_us = le32toh(rec.latency_us);
+    // unknown codes come from a newer format or a damaged file
+    switch (rec.mode) {
+        case HWSIM_JOURNAL_OP_CREATE:
+            op->mode = HWSIM_OP_CREATE;
+            op->c_hwname = rec.name_len ? entry->name : NULL;
+            op->c_channels = le32toh(rec.channels);
+            op->c_no_vif = rec.flags & HWSIM_JOURNAL_NO_VIF;
+            op->c_use_chanctx = rec.flags & HWSIM_JOURNAL_CHANCTX;
+            op->c_destroy_on_close = rec.flags & HWSIM_JOURNAL_DESTROY_ON_CLOSE;
+            op->c_reg_custom_reg = le32toh(rec.reg_custom_reg);
+            if (rec.alpha2[0]) {
+                memcpy(entry->alpha2, rec.alpha2, sizeof(rec.alpha2));
+                entry->alpha2[sizeof(rec.alpha2)] = '\0';
+                op->c_reg_alpha2 = entry->alpha2;
+            }
+            return 1;
+        case HWSIM_JOURNAL_OP_DELETE_BY_ID:
+            op->mode = HWSIM_OP_DELETE_BY_ID;
+            op->del_radio_id = le32toh(rec.radio_id);
+            return 1;
+        case HWSIM_JOURNAL_OP_DELETE_BY_NAME:
+            op->mode = HWSIM_OP_DELETE_BY_NAME;
+            op->del_radio_name = entry->name;
+            return 1;
+        case HWSIM_JOURNAL_OP_SET_RSSI:
+            op->mode = HWSIM_OP_SET_RSSI;
+            op->rssi_radio = le32toh(rec.radio_id);
+            op->rssi_dbm = (int32_t) le32toh((uint32_t) rec.signal);
+            return 1;
+        case HWSIM_JOURNAL_OP_SET_PROPS:
+            op->mode = HWSIM_OP_SET_PROPS;
+            if (!entry->props && !(entry->props = malloc(HWSIM_PROPS_MAX * sizeof(hwsim_props)))) {
+                return -1;
+            }
+            for (i = 0; i < rec.props_count; i++) {
+                decode_props(&entry->props[i], payload + i * sizeof(hwsim_journal_props));
+            }
+            op->props = entry->props;
+            op->props_count = rec.props_count;
+            return 1;
+        default:
+            return -1;
+    }
+}
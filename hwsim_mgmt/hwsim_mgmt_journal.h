@@ -0,0 +1,134 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_JOURNAL_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_JOURNAL_H
+
+#include <stdio.h>
+#include "hwsim_mgmt_event.h"
+
+#define HWSIM_JOURNAL_MAGIC "HWJRNL01"
+
+#define HWSIM_JOURNAL_NO_VIF 0x1
+#define HWSIM_JOURNAL_CHANCTX 0x2
+#define HWSIM_JOURNAL_DESTROY_ON_CLOSE 0x4
+
+/*
+ * Operation codes of a record. They belong to the file format and never
+ * change, whatever happens to enum op_mode.
+ */
+#define HWSIM_JOURNAL_OP_CREATE 1
+#define HWSIM_JOURNAL_OP_DELETE_BY_ID 2
+#define HWSIM_JOURNAL_OP_DELETE_BY_NAME 3
+#define HWSIM_JOURNAL_OP_SET_RSSI 4
+#define HWSIM_JOURNAL_OP_SET_PROPS 10
+
+/*
+ * Header of an operation journal, all fields little endian. started_ns
+ * is the CLOCK_REALTIME of the start of the recording.
+ */
+typedef struct {
+    char magic[8];
+    uint64_t started_ns;
+} hwsim_journal_header;
+
+/*
+ * One completed operation (mode is a HWSIM_JOURNAL_OP_*), padded to a multiple of 8 bytes. submitted_ns counts from the
+ * start of the recording (CLOCK_MONOTONIC), latency_us until the reply
+ * arrived. result is the radio id of a create, 0 or -errno. A create or
+ * delete by name is followed by name_len bytes of name, a set by
+ * props_count hwsim_journal_props.
+ */
+typedef struct {
+    uint16_t size;
+    uint8_t mode;
+    uint8_t flags;
+    int32_t result;
+    uint64_t submitted_ns;
+    uint32_t latency_us;
+    uint32_t radio_id;
+    int32_t signal;
+    uint32_t channels;
+    uint32_t reg_custom_reg;
+    char alpha2[2];
+    uint8_t name_len;
+    uint8_t props_count;
+} hwsim_journal_record;
+
+typedef struct {
+    uint32_t radio_id;
+    uint32_t set;
+    int32_t signal;
+    uint32_t freq;
+    hwsim_tx_rate tx_info[HWSIM_TX_MAX_RATES];
+    uint32_t tx_info_count;
+} hwsim_journal_props;
+
+#define HWSIM_JOURNAL_RECORD_MAX (sizeof(hwsim_journal_record) + HWSIM_PROPS_MAX * sizeof(hwsim_journal_props))
+
+/*
+ * Journal being recorded. Engines of every thread append to it, so
+ * records are in the order the operations completed.
+ */
+struct hwsim_journal {
+    FILE *file;
+    pthread_mutex_t lock;
+    struct timespec started;
+    unsigned long records;
+    // errno of the first failed write, later records are dropped
+    int write_error;
+};
+
+typedef struct hwsim_journal hwsim_journal;
+
+/*
+ * A record read back for replay. op points into the entry; props is
+ * allocated by the first set read into the entry and kept.
+ */
+typedef struct {
+    hwsim_args op;
+    char name[HWSIM_REQUEST_NAME_MAX];
+    char alpha2[3];
+    hwsim_props *props;
+    int32_t result;
+    uint64_t submitted_ns;
+    uint32_t latency_us;
+} hwsim_journal_entry;
+
+/*
+ * Creates (or truncates) the journal at path and writes its header.
+ * Returns 0 or -errno.
+ */
+int open_journal(hwsim_journal *journal, const char *path);
+
+/*
+ * Writes the records still buffered and closes the file. Returns -errno
+ * of the first failed write, 0 if all succeeded.
+ */
+int close_journal(hwsim_journal *journal);
+
+/*
+ * Encodes the completed request req into buf (HWSIM_JOURNAL_RECORD_MAX
+ * bytes) and returns the record's size, or 0 if its operation is not
+ * journaled. Only reads the request, so it can run under the engine lock
+ * while the request's props are still valid.
+ */
+size_t encode_journal_record(const hwsim_journal *journal, const hwsim_request *req, uint8_t *buf);
+
+void write_journal_record(hwsim_journal *journal, const uint8_t *buf, size_t len);
+
+/*
+ * Checks the header of a journal opened for reading.
+ */
+int read_journal_header(FILE *in, hwsim_journal_header *header);
+
+/*
+ * Reads the next record into entry. Returns 1, 0 at the end of the
+ * journal or -1 if the record is truncated, malformed or of an unknown
+ * operation.
+ */
+int read_journal_record(FILE *in, hwsim_journal_entry *entry);
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_JOURNAL_H
@@ -0,0 +1,210 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hwsim_mgmt_lib.h"
+#include "hwsim_mgmt_event.h"
+
+struct hwsim_handle {
+    netlink_ctx nl_ctx;
+    hwsim_engine engine;
+    bool session;
+};
+
+typedef struct {
+    bool done;
+    int error;
+    int radio_id;
+} lib_result;
+
+typedef struct {
+    hwsim_handle *handle;
+    lib_result *result;
+} lib_call;
+
+static hwsim_handle *open_failed(hwsim_handle *handle, hwsim_open_error *error, int code, const char *message) {
+    free(handle);
+    if (error) {
+        error->error = code;
+        snprintf(error->message, sizeof(error->message), "%s", message);
+    }
+    errno = -code;
+    return NULL;
+}
+
+hwsim_handle *hwsim_open_with(const hwsim_open_options *options, hwsim_open_error *error) {
+    hwsim_config config = {0, NULL, options->rcvbuf, options->sndbuf, NULL};
+    hwsim_handle *handle = calloc(1, sizeof(hwsim_handle));
+    char message[HWSIM_ERROR_LEN];
+    int ret;
+
+    if (!handle) {
+        return open_failed(NULL, error, -ENOMEM, "Error allocating handle");
+    }
+    if (init_netlink(&handle->nl_ctx, &config)) {
+        // init_netlink() only explains its failures
+        snprintf(message, sizeof(message), "%s", handle->nl_ctx.error);
+        free_netlink(&handle->nl_ctx);
+        return open_failed(handle, error, -EIO, message);
+    }
+    if ((ret = init_engine(&handle->engine, &handle->nl_ctx, HWSIM_DEFAULT_WINDOW, options->timeout_ms))) {
+        free_netlink(&handle->nl_ctx);
+        return open_failed(handle, error, ret, "Error setting up the request engine");
+    }
+    if ((ret = register_event(&handle->engine))) {
+        free_engine(&handle->engine);
+        free_netlink(&handle->nl_ctx);
+        return open_failed(handle, error, ret, "Error starting the reply thread");
+    }
+    handle->session = options->session;
+    return handle;
+}
+
+hwsim_handle *hwsim_open(uint32_t timeout_ms) {
+    hwsim_open_options options = {timeout_ms, 0, 0, false};
+    return hwsim_open_with(&options, NULL);
+}
+
+hwsim_handle *hwsim_open_session(uint32_t timeout_ms) {
+    hwsim_open_options options = {timeout_ms, 0, 0, true};
+    return hwsim_open_with(&options, NULL);
+}
+
+void hwsim_close(hwsim_handle *handle) {
+    if (!handle) {
+        return;
+    }
+    unregister_event(&handle->engine);
+    free_engine(&handle->engine);
+    free_netlink(&handle->nl_ctx);
+    free(handle);
+}
+
+static void lib_request_done(const hwsim_request *req, void *arg) {
+    lib_call *call = arg;
+    call->result->error = req->error;
+    call->result->radio_id = req->radio_id;
+    signal_done(&call->handle->engine, &call->result->done);
+}
+
+static int call_sync(hwsim_handle *handle, const hwsim_args *op, lib_result *result) {
+    lib_call call = {handle, result};
+
+    result->done = false;
+    if (submit_request_wait(&handle->engine, op, lib_request_done, &call)) {
+        return -EIO;
+    }
+    wait_until(&handle->engine, &result->done);
+    return result->error;
+}
+
+int hwsim_create_radio(hwsim_handle *handle, const hwsim_radio_params *params) {
+    hwsim_args op;
+    lib_result result;
+    int ret;
+
+    memset(&op, 0, sizeof(op));
+    op.mode = HWSIM_OP_CREATE;
+    if (params) {
+        op.c_hwname = (char *) params->name;
+        op.c_channels = params->channels;
+        op.c_no_vif = params->no_vif;
+        op.c_use_chanctx = params->use_chanctx;
+        op.c_reg_alpha2 = (char *) params->reg_alpha2;
+        op.c_reg_custom_reg = params->reg_custom_reg;
+    }
+    op.c_destroy_on_close = handle->session;
+    if ((ret = call_sync(handle, &op, &result))) {
+        return ret;
+    }
+    return result.radio_id;
+}
+
+int hwsim_delete_radio_by_id(hwsim_handle *handle, uint32_t radio_id) {
+    hwsim_args op;
+    lib_result result;
+
+    memset(&op, 0, sizeof(op));
+    op.mode = HWSIM_OP_DELETE_BY_ID;
+    op.del_radio_id = radio_id;
+    return call_sync(handle, &op, &result);
+}
+
+int hwsim_delete_radio_by_name(hwsim_handle *handle, const char *radio_name) {
+    hwsim_args op;
+    lib_result result;
+
+    memset(&op, 0, sizeof(op));
+    op.mode = HWSIM_OP_DELETE_BY_NAME;
+    op.del_radio_name = (char *) radio_name;
+    return call_sync(handle, &op, &result);
+}
+
+int hwsim_set_rssi(hwsim_handle *handle, uint32_t radio_id, uint32_t rssi) {
+    return hwsim_set_signal(handle, radio_id, -(int32_t) rssi);
+}
+
+int hwsim_set_signal(hwsim_handle *handle, uint32_t radio_id, int32_t signal_dbm) {
+    hwsim_args op;
+    lib_result result;
+
+    memset(&op, 0, sizeof(op));
+    op.mode = HWSIM_OP_SET_RSSI;
+    op.rssi_radio = radio_id;
+    op.rssi_dbm = signal_dbm;
+    return call_sync(handle, &op, &result);
+}
+
+static void copy_props(hwsim_props *to, const hwsim_radio_props *from) {
+    uint32_t i;
+    memset(to, 0, sizeof(*to));
+    to->radio_id = from->radio_id;
+    to->set = (from->set & HWSIM_RADIO_SIGNAL ? HWSIM_PROP_SIGNAL : 0)
+              | (from->set & HWSIM_RADIO_FREQ ? HWSIM_PROP_FREQ : 0)
+              | (from->set & HWSIM_RADIO_TX_INFO ? HWSIM_PROP_TX_INFO : 0);
+    to->signal = from->signal;
+    to->freq = from->freq;
+    to->tx_info_count = from->tx_info_count;
+    for (i = 0; i < from->tx_info_count && i < HWSIM_TX_MAX_RATES; i++) {
+        to->tx_info[i].idx = from->tx_info[i].idx;
+        to->tx_info[i].count = from->tx_info[i].count;
+    }
+}
+
+int hwsim_set_props(hwsim_handle *handle, const hwsim_radio_props *props, size_t count) {
+    hwsim_props chunk[HWSIM_PROPS_MAX];
+    hwsim_args op;
+    lib_result result;
+    size_t done, i;
+    int ret = 0, err;
+
+    for (done = 0; done < count; done += op.props_count) {
+        memset(&op, 0, sizeof(op));
+        op.mode = HWSIM_OP_SET_PROPS;
+        op.props = chunk;
+        op.props_count = (uint32_t) (count - done < HWSIM_PROPS_MAX ? count - done : HWSIM_PROPS_MAX);
+        for (i = 0; i < op.props_count; i++) {
+            copy_props(&chunk[i], &props[done + i]);
+        }
+        if ((err = call_sync(handle, &op, &result)) && !ret) {
+            ret = err;
+        }
+    }
+    return ret;
+}
+
+void hwsim_get_overrun_counters(hwsim_handle *handle, hwsim_overrun_counters *counters) {
+    hwsim_overrun_stats stats;
+    get_overrun_stats(&handle->engine, &stats);
+    counters->overruns = stats.overruns;
+    counters->resyncs = stats.resyncs;
+    counters->resent = stats.resent;
+    counters->recovered = stats.recovered;
+    counters->lost = stats.lost;
+}
@@ -0,0 +1,143 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_LIB_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_LIB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * libhwsim_mgmt: radio management for embedding into other processes.
+ * All state lives in the handle; calls on one handle may be issued from
+ * several threads at once. Results are returned instead of printed and the
+ * process is never terminated: failures are negative errno values.
+ */
+typedef struct hwsim_handle hwsim_handle;
+
+typedef struct {
+    const char *name;
+    uint32_t channels;
+    bool no_vif;
+    bool use_chanctx;
+    const char *reg_alpha2;
+    uint32_t reg_custom_reg;
+} hwsim_radio_params;
+
+#define HWSIM_RADIO_SIGNAL 0x1
+#define HWSIM_RADIO_FREQ 0x2
+#define HWSIM_RADIO_TX_INFO 0x4
+
+typedef struct {
+    int8_t idx;
+    uint8_t count;
+} hwsim_radio_tx_rate;
+
+/*
+ * Properties of one radio for hwsim_set_props(). Only the fields flagged
+ * in set (HWSIM_RADIO_*) are sent; signal is in dBm, freq in MHz and up
+ * to 4 TX rates are taken.
+ */
+typedef struct {
+    uint32_t radio_id;
+    uint32_t set;
+    int32_t signal;
+    uint32_t freq;
+    hwsim_radio_tx_rate tx_info[4];
+    uint32_t tx_info_count;
+} hwsim_radio_props;
+
+/*
+ * Receive overruns of a handle's socket (the kernel dropped ACKs or
+ * notifications) and how the calls they hit ended: sent again, settled
+ * from a radio dump, or failed with -ENOBUFS.
+ */
+typedef struct {
+    unsigned long overruns;
+    unsigned long resyncs;
+    unsigned long resent;
+    unsigned long recovered;
+    unsigned long lost;
+} hwsim_overrun_counters;
+
+/*
+ * Settings of one handle for hwsim_open_with(). timeout_ms bounds each
+ * call (0 waits forever), rcvbuf and sndbuf are the socket buffer sizes
+ * in bytes (0 keeps the default) and session is as hwsim_open_session().
+ */
+typedef struct {
+    uint32_t timeout_ms;
+    uint32_t rcvbuf;
+    uint32_t sndbuf;
+    bool session;
+} hwsim_open_options;
+
+/*
+ * Why hwsim_open_with() failed: error is a negative errno value, message
+ * says what went wrong (e.g. that the MAC80211_HWSIM family is missing).
+ */
+typedef struct {
+    int error;
+    char message[128];
+} hwsim_open_error;
+
+/*
+ * Opens a netlink session. timeout_ms bounds each call (0 waits forever).
+ * Returns NULL and sets errno on failure.
+ */
+hwsim_handle *hwsim_open(uint32_t timeout_ms);
+
+/*
+ * Like hwsim_open(). On failure error, if not NULL, also receives the
+ * reason.
+ */
+hwsim_handle *hwsim_open_with(const hwsim_open_options *options, hwsim_open_error *error);
+
+/*
+ * Like hwsim_open(), but every radio created through the handle is
+ * destroy-on-close: the kernel deletes all of them when hwsim_close() is
+ * called or the process dies, without one delete per radio.
+ */
+hwsim_handle *hwsim_open_session(uint32_t timeout_ms);
+
+void hwsim_close(hwsim_handle *handle);
+
+/*
+ * Returns the new radio id or a negative errno value.
+ */
+int hwsim_create_radio(hwsim_handle *handle, const hwsim_radio_params *params);
+
+/*
+ * The following return 0 or a negative errno value.
+ */
+int hwsim_delete_radio_by_id(hwsim_handle *handle, uint32_t radio_id);
+
+int hwsim_delete_radio_by_name(hwsim_handle *handle, const char *radio_name);
+
+/*
+ * Sets the signal to -rssi dBm.
+ */
+int hwsim_set_rssi(hwsim_handle *handle, uint32_t radio_id, uint32_t rssi);
+
+int hwsim_set_signal(hwsim_handle *handle, uint32_t radio_id, int32_t signal_dbm);
+
+/*
+ * Updates count radios with one netlink request per 64 radios. Returns
+ * the first error of any radio.
+ */
+int hwsim_set_props(hwsim_handle *handle, const hwsim_radio_props *props, size_t count);
+
+void hwsim_get_overrun_counters(hwsim_handle *handle, hwsim_overrun_counters *counters);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_LIB_H
@@ -0,0 +1,497 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#define _GNU_SOURCE
+
+#include <netlink/netlink.h>
+#include <netlink/genl/genl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include "hwsim_mgmt_medium.h"
+#include "hwsim_mgmt_cli.h"
+#include "hwsim_mgmt_pcap.h"
+#include "hwsim_mgmt_radio.h"
+
+#define MEDIUM_DELIM " \t\r\n"
+// radio ids are 16 bit in the addresses mac80211_hwsim derives from them
+#define MEDIUM_MAX_RADIOS 0x10000
+#define MEDIUM_BATCH 64
+#define MEDIUM_BUF_SIZE 16384
+#define MEDIUM_QUEUE 256
+#define MEDIUM_SOCK_BUF (4 << 20)
+#define MEDIUM_REPORT_MS 1000
+#define MEDIUM_REGISTER_SEQ 1
+
+typedef struct {
+    uint32_t tx;
+    uint32_t rx;
+    int8_t signal;
+    uint8_t loss;
+} medium_line;
+
+typedef struct {
+    uint32_t rx;
+    int8_t signal;
+    uint8_t loss;
+} medium_link;
+
+/*
+ * An outgoing message: headers and fixed attributes in head, a relayed
+ * frame's payload referenced from the receive buffer it arrived in.
+ */
+typedef struct {
+    hwsim_msg head;
+    struct iovec iov[3];
+} medium_out;
+
+typedef struct {
+    const netlink_ctx *nl_ctx;
+    int fd;
+    struct sockaddr_nl peer;
+    // receivers of transmitter tx are links[rows[tx]] up to links[rows[tx + 1]]
+    uint32_t *rows;
+    uint32_t radio_count;
+    medium_link *links;
+    uint8_t *rx_bufs;
+    struct iovec rx_iov[MEDIUM_BATCH];
+    struct mmsghdr rx_msgs[MEDIUM_BATCH];
+    medium_out out[MEDIUM_QUEUE];
+    struct mmsghdr out_msgs[MEDIUM_QUEUE];
+    size_t out_count;
+    uint32_t rand_state;
+    frame_tap *tap;
+    int register_error;
+    bool registered;
+    unsigned long frames;
+    unsigned long delivered;
+    unsigned long lost;
+    unsigned long acked;
+    unsigned long unacked;
+    unsigned long errors;
+    unsigned long overruns;
+    unsigned long send_drops;
+} medium;
+
+static volatile sig_atomic_t medium_stop;
+
+static const uint8_t zero_pad[NLA_ALIGNTO];
+
+static void stop_cb(int sig) {
+    UNUSED(sig);
+    medium_stop = 1;
+}
+
+static uint32_t next_rand(medium *m) {
+    uint32_t x = m->rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return m->rand_state = x;
+}
+
+static int parse_link_line(char *line, medium_line *link) {
+    char *saveptr = NULL;
+    char *tx = strtok_r(line, MEDIUM_DELIM, &saveptr);
+    char *rx, *signal, *loss;
+    uint32_t loss_pct = 0;
+    int32_t dbm;
+
+    if (!tx || tx[0] == '#') {
+        return 1;
+    }
+    rx = strtok_r(NULL, MEDIUM_DELIM, &saveptr);
+    signal = strtok_r(NULL, MEDIUM_DELIM, &saveptr);
+    loss = strtok_r(NULL, MEDIUM_DELIM, &saveptr);
+    if (!rx || !signal || strtok_r(NULL, MEDIUM_DELIM, &saveptr) || parse_uint32(tx, &link->tx)
+        || parse_uint32(rx, &link->rx) || parse_rssi(signal, &dbm) || (loss && parse_uint32(loss, &loss_pct))
+        || link->tx >= MEDIUM_MAX_RADIOS || link->rx >= MEDIUM_MAX_RADIOS || loss_pct > 100) {
+        return -1;
+    }
+    link->signal = (int8_t) dbm;
+    link->loss = (uint8_t) loss_pct;
+    return 0;
+}
+
+static int compare_line(const void *a, const void *b) {
+    const medium_line *la = a, *lb = b;
+    if (la->tx != lb->tx) {
+        return la->tx < lb->tx ? -1 : 1;
+    }
+    return la->rx < lb->rx ? -1 : la->rx > lb->rx;
+}
+
+/*
+ * Sorting the lines by transmitter and receiver gives the rows directly.
+ */
+static int build_table(medium *m, medium_line *lines, size_t count) {
+    size_t i;
+
+    qsort(lines, count, sizeof(medium_line), compare_line);
+    for (i = 0; i < count; i++) {
+        if (i && !compare_line(&lines[i - 1], &lines[i])) {
+            fprintf(stderr, "Duplicate link %u -> %u\n", lines[i].tx, lines[i].rx);
+            return -1;
+        }
+        if (lines[i].tx >= m->radio_count) {
+            m->radio_count = lines[i].tx + 1;
+        }
+    }
+    m->rows = calloc(m->radio_count + 1, sizeof(uint32_t));
+    m->links = malloc((count ? count : 1) * sizeof(medium_link));
+    if (!m->rows || !m->links) {
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        m->rows[lines[i].tx + 1]++;
+        m->links[i].rx = lines[i].rx;
+        m->links[i].signal = lines[i].signal;
+        m->links[i].loss = lines[i].loss;
+    }
+    for (i = 0; i < m->radio_count; i++) {
+        m->rows[i + 1] += m->rows[i];
+    }
+    return 0;
+}
+
+static int read_links(medium *m, FILE *in) {
+    medium_line *lines = NULL;
+    size_t count = 0, cap = 0;
+    char *line = NULL;
+    size_t line_cap = 0;
+    unsigned long line_no = 0;
+    int ret = 0;
+
+    while (!ret && getline(&line, &line_cap, in) != -1) {
+        line_no++;
+        if (count == cap) {
+            size_t new_cap = cap ? cap * 2 : 256;
+            medium_line *grown = realloc(lines, new_cap * sizeof(medium_line));
+            if (!grown) {
+                ret = -1;
+                break;
+            }
+            lines = grown;
+            cap = new_cap;
+        }
+        int parsed = parse_link_line(line, &lines[count]);
+        if (parsed < 0) {
+            fprintf(stderr, "Invalid link line %lu\n", line_no);
+            ret = -1;
+        } else if (!parsed) {
+            count++;
+        }
+    }
+    free(line);
+    if (!ret) {
+        ret = build_table(m, lines, count);
+    }
+    free(lines);
+    return ret;
+}
+
+static void flush_out(medium *m) {
+    size_t sent = 0;
+    while (sent < m->out_count) {
+        int ret = sendmmsg(m->fd, m->out_msgs + sent, (unsigned int) (m->out_count - sent), 0);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            m->send_drops += m->out_count - sent;
+            break;
+        }
+        sent += (size_t) ret;
+    }
+    m->out_count = 0;
+}
+
+/*
+ * Relay messages do not ask for an ACK, the kernel only answers failures.
+ */
+static hwsim_msg *next_out(medium *m, uint8_t cmd) {
+    if (m->out_count == MEDIUM_QUEUE) {
+        flush_out(m);
+    }
+    hwsim_msg *msg = &m->out[m->out_count].head;
+    msg->hdr = m->nl_ctx->msg_template;
+    msg->hdr.nlh.nlmsg_flags = NLM_F_REQUEST;
+    msg->hdr.genl.cmd = cmd;
+    return msg;
+}
+
+static void queue_frame(medium *m, const medium_link *link, uint32_t rate, uint32_t freq, const uint8_t *frame,
+                        uint32_t len) {
+    hwsim_msg *msg = next_out(m, HWSIM_CMD_FRAME);
+    medium_out *out = &m->out[m->out_count];
+    struct nlattr *nla;
+    uint8_t addr[6];
+
+    radio_hwaddr(link->rx, addr);
+    if (msg_put_attr(msg, HWSIM_ATTR_ADDR_RECEIVER, addr, sizeof(addr))
+        || msg_put_u32(msg, HWSIM_ATTR_RX_RATE, rate)
+        || msg_put_u32(msg, HWSIM_ATTR_SIGNAL, (uint32_t) (int32_t) link->signal)
+        || (freq && msg_put_u32(msg, HWSIM_ATTR_FREQ, freq))) {
+        return;
+    }
+    // the payload goes last and is sent straight from the receive buffer
+    nla = (struct nlattr *) (msg->data + msg->hdr.nlh.nlmsg_len);
+    nla->nla_type = HWSIM_ATTR_FRAME;
+    nla->nla_len = (uint16_t) (NLA_HDRLEN + len);
+    out->iov[0].iov_base = msg->data;
+    out->iov[0].iov_len = msg->hdr.nlh.nlmsg_len + NLA_HDRLEN;
+    out->iov[1].iov_base = (void *) frame;
+    out->iov[1].iov_len = len;
+    out->iov[2].iov_base = (void *) zero_pad;
+    out->iov[2].iov_len = NLA_ALIGN(len) - len;
+    msg->hdr.nlh.nlmsg_len += NLA_HDRLEN + NLA_ALIGN(len);
+    m->out_msgs[m->out_count].msg_hdr.msg_iovlen = 3;
+    m->out_count++;
+    m->delivered++;
+}
+
+static void queue_tx_status(medium *m, struct nlattr **attrs, uint32_t flags, int8_t signal,
+                            const hwsim_tx_rate *rates) {
+    hwsim_msg *msg = next_out(m, HWSIM_CMD_TX_INFO_FRAME);
+    medium_out *out = &m->out[m->out_count];
+
+    if (msg_put_attr(msg, HWSIM_ATTR_ADDR_TRANSMITTER, nla_data(attrs[HWSIM_ATTR_ADDR_TRANSMITTER]), 6)
+        || msg_put_u32(msg, HWSIM_ATTR_FLAGS, flags)
+        || msg_put_u32(msg, HWSIM_ATTR_SIGNAL, (uint32_t) (int32_t) signal)
+        || msg_put_attr(msg, HWSIM_ATTR_TX_INFO, rates, HWSIM_TX_MAX_RATES * sizeof(hwsim_tx_rate))
+        || msg_put_attr(msg, HWSIM_ATTR_COOKIE, nla_data(attrs[HWSIM_ATTR_COOKIE]),
+                        (uint16_t) nla_len(attrs[HWSIM_ATTR_COOKIE]))) {
+        return;
+    }
+    out->iov[0].iov_base = msg->data;
+    out->iov[0].iov_len = msg->hdr.nlh.nlmsg_len;
+    m->out_msgs[m->out_count].msg_hdr.msg_iovlen = 1;
+    m->out_count++;
+}
+
+/*
+ * Sends the frame to every receiver in range of its transmitter. A
+ * unicast frame is acknowledged if its destination (addr1 of the 802.11
+ * header) received it, or any radio if the destination is no address
+ * derived from a radio id.
+ */
+static void relay_frame(medium *m, struct nlmsghdr *nlh) {
+    struct nlattr *attrs[__HWSIM_ATTR_MAX];
+    hwsim_tx_rate rates[HWSIM_TX_MAX_RATES];
+    const uint8_t *frame, *dest;
+    uint32_t flags, freq, len, i;
+    int tx, dest_id = -1;
+    bool need_ack, acked;
+    int8_t ack_signal = 0, best_signal = 0;
+    bool heard = false;
+
+    if (genlmsg_parse(nlh, 0, attrs, __HWSIM_ATTR_MAX - 1, NULL) < 0 || !attrs[HWSIM_ATTR_ADDR_TRANSMITTER]
+        || nla_len(attrs[HWSIM_ATTR_ADDR_TRANSMITTER]) < 6 || !attrs[HWSIM_ATTR_FRAME]
+        || !attrs[HWSIM_ATTR_FLAGS] || !attrs[HWSIM_ATTR_COOKIE] || !attrs[HWSIM_ATTR_TX_INFO]) {
+        m->errors++;
+        return;
+    }
+    m->frames++;
+    memset(rates, 0, sizeof(rates));
+    memcpy(rates, nla_data(attrs[HWSIM_ATTR_TX_INFO]),
+           (size_t) nla_len(attrs[HWSIM_ATTR_TX_INFO]) < sizeof(rates) ? (size_t) nla_len(attrs[HWSIM_ATTR_TX_INFO])
+                                                                       : sizeof(rates));
+    frame = nla_data(attrs[HWSIM_ATTR_FRAME]);
+    len = (uint32_t) nla_len(attrs[HWSIM_ATTR_FRAME]);
+    flags = nla_get_u32(attrs[HWSIM_ATTR_FLAGS]);
+    freq = attrs[HWSIM_ATTR_FREQ] ? nla_get_u32(attrs[HWSIM_ATTR_FREQ]) : 0;
+    tx = radio_id_from_hwaddr(nla_data(attrs[HWSIM_ATTR_ADDR_TRANSMITTER]));
+    dest = len >= 10 ? frame + 4 : NULL;
+    need_ack = dest && !(dest[0] & 0x01) && !(flags & HWSIM_TX_CTL_NO_ACK);
+    if (need_ack) {
+        dest_id = radio_id_from_hwaddr(dest);
+    }
+    acked = !need_ack;
+
+    if (tx >= 0 && (uint32_t) tx < m->radio_count) {
+        for (i = m->rows[tx]; i < m->rows[tx + 1]; i++) {
+            const medium_link *link = &m->links[i];
+            if (link->loss && next_rand(m) % 100 < link->loss) {
+                m->lost++;
+                continue;
+            }
+            queue_frame(m, link, rates[0].idx < 0 ? 0 : (uint32_t) rates[0].idx, freq, frame, len);
+            if (!heard || link->signal > best_signal) {
+                best_signal = link->signal;
+                heard = true;
+            }
+            if (need_ack && (dest_id < 0 || (uint32_t) dest_id == link->rx)) {
+                acked = true;
+                ack_signal = link->signal;
+            }
+        }
+    }
+    if (m->tap) {
+        tap_frame(m->tap, frame, len, freq, rates[0].idx, heard, best_signal);
+    }
+    if (need_ack && acked) {
+        m->acked++;
+    } else if (need_ack) {
+        m->unacked++;
+    }
+    if (!(flags & HWSIM_TX_CTL_REQ_TX_STATUS)) {
+        return;
+    }
+    if (acked) {
+        // delivered with the first attempt of the first rate
+        rates[0].count = 1;
+        for (i = 1; i < HWSIM_TX_MAX_RATES; i++) {
+            rates[i].idx = -1;
+            rates[i].count = 0;
+        }
+        flags |= HWSIM_TX_STAT_ACK;
+    }
+    queue_tx_status(m, attrs, flags, ack_signal, rates);
+}
+
+static void handle_msg(medium *m, struct nlmsghdr *nlh) {
+    if (nlh->nlmsg_type == NLMSG_ERROR) {
+        struct nlmsgerr *err = nlmsg_data(nlh);
+        if (nlh->nlmsg_seq == MEDIUM_REGISTER_SEQ && !m->registered) {
+            m->register_error = err->error;
+            m->registered = !err->error;
+        } else if (err->error) {
+            m->errors++;
+        }
+        return;
+    }
+    if (nlh->nlmsg_type == m->nl_ctx->family.id
+        && ((struct genlmsghdr *) nlmsg_data(nlh))->cmd == HWSIM_CMD_FRAME) {
+        relay_frame(m, nlh);
+    }
+}
+
+static void receive_batch(medium *m) {
+    int count, i;
+
+    count = recvmmsg(m->fd, m->rx_msgs, MEDIUM_BATCH, MSG_DONTWAIT, NULL);
+    if (count < 0) {
+        // the kernel dropped frames because the receive buffer was full
+        if (errno == ENOBUFS) {
+            m->overruns++;
+        }
+        return;
+    }
+    for (i = 0; i < count; i++) {
+        struct nlmsghdr *nlh = m->rx_iov[i].iov_base;
+        int remaining = (int) m->rx_msgs[i].msg_len;
+        if (m->rx_msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            m->errors++;
+            continue;
+        }
+        for (; nlmsg_ok(nlh, remaining); nlh = nlmsg_next(nlh, &remaining)) {
+            handle_msg(m, nlh);
+        }
+    }
+    // the queued frames point into the receive buffers
+    flush_out(m);
+}
+
+static void report(medium *m, FILE *out, const char *prefix, uint64_t elapsed_ms) {
+    double secs = elapsed_ms ? elapsed_ms / 1000.0 : 1.0;
+    fprintf(out, "%s%lu frames (%.0f/s), %lu delivered (%.0f/s), %lu lost, %lu acked, %lu unacked, %lu errors, "
+                 "%lu overruns, %lu send drops\n", prefix,
+            m->frames, m->frames / secs, m->delivered, m->delivered / secs, m->lost, m->acked, m->unacked,
+            m->errors, m->overruns, m->send_drops);
+    if (m->tap) {
+        fprintf(out, "%scaptured %lu frames, %lu dropped by the capture\n", prefix,
+                __atomic_load_n(&m->tap->captured, __ATOMIC_RELAXED),
+                __atomic_load_n(&m->tap->dropped, __ATOMIC_RELAXED));
+    }
+}
+
+static int relay(medium *m) {
+    struct pollfd pfd = {m->fd, POLLIN, 0};
+    struct sigaction sa;
+    uint64_t start, last_report;
+    size_t i;
+
+    for (i = 0; i < MEDIUM_BATCH; i++) {
+        m->rx_iov[i].iov_base = m->rx_bufs + i * MEDIUM_BUF_SIZE;
+        m->rx_iov[i].iov_len = MEDIUM_BUF_SIZE;
+        m->rx_msgs[i].msg_hdr.msg_iov = &m->rx_iov[i];
+        m->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    for (i = 0; i < MEDIUM_QUEUE; i++) {
+        m->out_msgs[i].msg_hdr.msg_name = &m->peer;
+        m->out_msgs[i].msg_hdr.msg_namelen = sizeof(m->peer);
+        m->out_msgs[i].msg_hdr.msg_iov = m->out[i].iov;
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_cb;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if (register_medium(m->nl_ctx, MEDIUM_REGISTER_SEQ)) {
+        return EXIT_FAILURE;
+    }
+    start = last_report = monotonic_ns() / 1000000;
+    while (!medium_stop && !m->register_error) {
+        if (poll(&pfd, 1, MEDIUM_REPORT_MS) > 0) {
+            receive_batch(m);
+        }
+        uint64_t now = monotonic_ns() / 1000000;
+        if (now - last_report >= MEDIUM_REPORT_MS) {
+            report(m, stderr, "medium: ", now - start);
+            last_report = now;
+        }
+    }
+    if (m->register_error) {
+        fprintf(stderr, "Error registering as medium: %s\n", strerror(-m->register_error));
+        return EXIT_FAILURE;
+    }
+    report(m, stdout, "", monotonic_ns() / 1000000 - start);
+    return EXIT_SUCCESS;
+}
+
+int run_medium(const netlink_ctx *nl_ctx, FILE *in, const char *pcap_path) {
+    medium *m = calloc(1, sizeof(medium));
+    frame_tap tap;
+    int ret = EXIT_FAILURE;
+
+    if (!m) {
+        return EXIT_FAILURE;
+    }
+    if (pcap_path) {
+        if (open_frame_tap(&tap, pcap_path)) {
+            free(m);
+            return EXIT_FAILURE;
+        }
+        m->tap = &tap;
+    }
+    m->nl_ctx = nl_ctx;
+    m->fd = nl_socket_get_fd(nl_ctx->sock);
+    m->peer.nl_family = AF_NETLINK;
+    m->peer.nl_pid = nl_socket_get_peer_port(nl_ctx->sock);
+    m->rand_state = (uint32_t) (monotonic_ns() / 1000000) | 1;
+    m->rx_bufs = malloc(MEDIUM_BATCH * MEDIUM_BUF_SIZE);
+    if (m->rx_bufs && !read_links(m, in)) {
+        int rcvbuf = 0;
+        socklen_t rcvbuf_len = sizeof(rcvbuf);
+        // a burst of frames must not overrun the socket between two batches; the kernel reports double the size
+        if (getsockopt(m->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &rcvbuf_len) || rcvbuf / 2 < MEDIUM_SOCK_BUF) {
+            nl_socket_set_buffer_size(nl_ctx->sock, MEDIUM_SOCK_BUF, MEDIUM_SOCK_BUF);
+        }
+        ret = relay(m);
+    }
+    if (m->tap) {
+        close_frame_tap(m->tap);
+    }
+    free(m->rx_bufs);
+    free(m->rows);
+    free(m->links);
+    free(m);
+    return ret;
+}
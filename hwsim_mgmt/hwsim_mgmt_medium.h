@@ -0,0 +1,28 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_MEDIUM_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_MEDIUM_H
+
+#include <stdio.h>
+#include "hwsim_mgmt_func.h"
+
+/*
+ * Registers nl_ctx's socket as the wireless medium and relays every
+ * transmitted frame to the receivers listed for its transmitter in the
+ * link table read from in. Lines have the form
+ *   TX RX DBM [LOSS]
+ * (radio ids, signal at RX in dBm, per cent of frames lost, default 0);
+ * links are directed and radios without a line do not hear each other.
+ * A unicast frame counts as acknowledged when its destination radio got
+ * it; the TX status goes back with the frame's cookie. Frames are read
+ * and sent in batches and relayed without copying their payload. Rates
+ * are reported on stderr every second. Runs until SIGINT or SIGTERM.
+ * If pcap_path is set, every transmitted frame is also captured there once,
+ * with the strongest signal any receiver got.
+ */
+int run_medium(const netlink_ctx *nl_ctx, FILE *in, const char *pcap_path);
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_MEDIUM_H
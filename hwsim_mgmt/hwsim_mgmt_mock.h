@@ -0,0 +1,82 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_MOCK_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_MOCK_H
+
+#include <pthread.h>
+#include "hwsim_mgmt_radio.h"
+
+// channel mock_send_frame() reports frames on
+#define HWSIM_MOCK_FREQ 2412
+
+typedef struct {
+    uint32_t latency_us;
+    uint32_t fail_every;
+    int fail_errno;
+} hwsim_mock_config;
+
+/*
+ * In-process stand-in for the MAC80211_HWSIM family, so the tool can run
+ * without root or the kernel module. A thread serves requests on a
+ * NETLINK_USERSOCK socket and answers them like mac80211_hwsim does:
+ * NEW_RADIO acks with the new id (-EEXIST for a taken name), DEL_RADIO
+ * with 0 or -ENODEV, GET_RADIO dumps the radio list and GET_RADIO with
+ * HWSIM_ATTR_SIGNAL sets the RSSI. NL80211_CMD_SET_WIPHY sent to
+ * HWSIM_MOCK_NL80211_ID renames a radio. Radios created with
+ * HWSIM_ATTR_DESTROY_RADIO_ON_CLOSE are deleted when their creator's
+ * free_netlink() sends NLMSG_NOOP. A socket sending HWSIM_CMD_REGISTER
+ * becomes the medium: mock_send_frame() passes frames to it and its
+ * HWSIM_CMD_FRAME and HWSIM_CMD_TX_INFO_FRAME replies are counted. New and
+ * deleted radios are announced
+ * to multicast group HWSIM_MOCK_CONFIG_GROUP. Like the kernel, the mock
+ * drops ACKs and frames for a full socket and overruns it (ENOBUFS), but
+ * waits for room while dumping. Each request is delayed by latency_us and
+ * every fail_every-th request fails with -fail_errno.
+ */
+typedef struct {
+    uint32_t radio_id;
+    uint32_t port;
+} hwsim_mock_owner;
+
+typedef struct {
+    hwsim_mock_config config;
+    int fd;
+    uint32_t port;
+    pthread_t thread;
+    int stop_pipe[2];
+    radio_index radios;
+    // creators of destroy-on-close radios
+    hwsim_mock_owner *owners;
+    size_t owner_count;
+    size_t owner_cap;
+    uint32_t next_id;
+    unsigned long requests;
+    // port registered as medium, 0 if none
+    uint32_t medium_port;
+    unsigned long frames_delivered;
+    unsigned long tx_status;
+    unsigned long tx_acked;
+    // replies dropped because the client's receive buffer was full
+    unsigned long replies_dropped;
+} hwsim_mock;
+
+/*
+ * Starts the mock; contexts whose hwsim_config has mock_port set to
+ * mock->port talk to it.
+ */
+int start_mock(hwsim_mock *mock, const hwsim_mock_config *config);
+
+void stop_mock(hwsim_mock *mock);
+
+/*
+ * Sends len bytes of frame to the registered medium as transmitted by
+ * radio_id, like mac80211_hwsim does for every frame when a medium is
+ * registered. Returns 0 or a negative errno value.
+ */
+int mock_send_frame(hwsim_mock *mock, uint32_t radio_id, const void *frame, size_t len, uint32_t flags,
+                    uint64_t cookie);
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_MOCK_H
@@ -0,0 +1,259 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hwsim_mgmt_pcap.h"
+
+#define TAP_RING_SIZE (16u << 20)
+#define TAP_WRITE_BUF (1u << 20)
+#define TAP_ALIGN 32
+#define TAP_IDLE_NS 1000000
+#define TAP_SNAPLEN 65535
+
+#define PCAP_MAGIC 0xa1b2c3d4
+#define LINKTYPE_IEEE802_11_RADIOTAP 127
+
+#define RADIOTAP_RATE 2
+#define RADIOTAP_CHANNEL 3
+#define RADIOTAP_DBM_ANTSIGNAL 5
+#define RADIOTAP_CHAN_2GHZ 0x0080
+#define RADIOTAP_CHAN_5GHZ 0x0100
+#define RADIOTAP_MAX_LEN 16
+
+/*
+ * Record in the ring, followed by the frame. A record with caplen 0 pads
+ * the end of the ring, the next record starts at offset 0.
+ */
+typedef struct {
+    uint32_t size;
+    uint32_t caplen;
+    uint64_t ts_ns;
+    uint32_t freq;
+    int8_t rate_idx;
+    int8_t signal;
+    bool has_signal;
+    uint8_t reserved[9];
+} tap_record;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t network;
+} pcap_file_header;
+
+typedef struct {
+    uint32_t ts_sec;
+    uint32_t ts_usec;
+    uint32_t incl_len;
+    uint32_t orig_len;
+} pcap_record_header;
+
+// mac80211_hwsim bitrates in 500 kbit/s, 5 GHz bands start at the fifth
+static const uint8_t hwsim_rates[] = {2, 4, 11, 22, 12, 18, 24, 36, 48, 72, 96, 108};
+
+static uint32_t record_size(uint32_t caplen) {
+    return (uint32_t) ((sizeof(tap_record) + caplen + TAP_ALIGN - 1) & ~(TAP_ALIGN - 1));
+}
+
+static int write_all(int fd, const uint8_t *data, size_t len) {
+    while (len) {
+        ssize_t ret = write(fd, data, len);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            return -1;
+        }
+        data += ret;
+        len -= (size_t) ret;
+    }
+    return 0;
+}
+
+static void flush_buf(frame_tap *tap) {
+    if (tap->buf_len && !tap->write_failed && write_all(tap->fd, tap->buf, tap->buf_len)) {
+        fprintf(stderr, "Error writing capture: %s\n", strerror(errno));
+        tap->write_failed = true;
+    }
+    tap->buf_len = 0;
+}
+
+static uint8_t *reserve_buf(frame_tap *tap, size_t len) {
+    if (tap->buf_len + len > TAP_WRITE_BUF) {
+        flush_buf(tap);
+    }
+    uint8_t *p = tap->buf + tap->buf_len;
+    tap->buf_len += len;
+    return p;
+}
+
+static size_t put_radiotap(uint8_t *rt, const tap_record *rec) {
+    uint32_t present = 0;
+    size_t len = 8;
+    int rate_idx = rec->rate_idx;
+
+    if (rec->freq >= 5000) {
+        rate_idx += 4;
+    }
+    if (rec->rate_idx >= 0 && (size_t) rate_idx < sizeof(hwsim_rates)) {
+        present |= 1u << RADIOTAP_RATE;
+        rt[len++] = hwsim_rates[rate_idx];
+    }
+    if (rec->freq) {
+        uint16_t freq = htole16((uint16_t) rec->freq);
+        uint16_t chan_flags = htole16(rec->freq >= 5000 ? RADIOTAP_CHAN_5GHZ : RADIOTAP_CHAN_2GHZ);
+        present |= 1u << RADIOTAP_CHANNEL;
+        // the channel field is aligned to 2 bytes
+        if (len & 1) {
+            rt[len++] = 0;
+        }
+        memcpy(rt + len, &freq, sizeof(freq));
+        memcpy(rt + len + 2, &chan_flags, sizeof(chan_flags));
+        len += 4;
+    }
+    if (rec->has_signal) {
+        present |= 1u << RADIOTAP_DBM_ANTSIGNAL;
+        rt[len++] = (uint8_t) rec->signal;
+    }
+    uint16_t rt_len = htole16((uint16_t) len);
+    present = htole32(present);
+    rt[0] = 0;
+    rt[1] = 0;
+    memcpy(rt + 2, &rt_len, sizeof(rt_len));
+    memcpy(rt + 4, &present, sizeof(present));
+    return len;
+}
+
+static void write_record(frame_tap *tap, const tap_record *rec) {
+    pcap_record_header hdr;
+    uint8_t rt[RADIOTAP_MAX_LEN];
+    size_t rt_len = put_radiotap(rt, rec);
+    uint32_t caplen = rec->caplen;
+
+    if (caplen > TAP_SNAPLEN - rt_len) {
+        caplen = (uint32_t) (TAP_SNAPLEN - rt_len);
+    }
+    hdr.ts_sec = (uint32_t) (rec->ts_ns / 1000000000);
+    hdr.ts_usec = (uint32_t) (rec->ts_ns % 1000000000 / 1000);
+    hdr.incl_len = (uint32_t) rt_len + caplen;
+    hdr.orig_len = (uint32_t) rt_len + rec->caplen;
+    uint8_t *p = reserve_buf(tap, sizeof(hdr) + rt_len + caplen);
+    memcpy(p, &hdr, sizeof(hdr));
+    memcpy(p + sizeof(hdr), rt, rt_len);
+    memcpy(p + sizeof(hdr) + rt_len, rec + 1, caplen);
+}
+
+/*
+ * Drains the ring. The file is written when the buffer is full or the ring
+ * runs empty, so a quiet medium still leaves a current capture behind.
+ */
+static void *writer_thread(void *arg) {
+    frame_tap *tap = arg;
+    struct timespec idle = {0, TAP_IDLE_NS};
+    uint64_t tail = tap->tail;
+
+    while (true) {
+        uint64_t head = __atomic_load_n(&tap->head, __ATOMIC_ACQUIRE);
+        if (tail == head) {
+            flush_buf(tap);
+            if (__atomic_load_n(&tap->stop, __ATOMIC_ACQUIRE)) {
+                // the producer is done, check once more for its last records
+                if (__atomic_load_n(&tap->head, __ATOMIC_ACQUIRE) == tail) {
+                    break;
+                }
+                continue;
+            }
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        while (tail != head) {
+            const tap_record *rec = (const tap_record *) (tap->ring + (tail & (TAP_RING_SIZE - 1)));
+            if (rec->caplen) {
+                write_record(tap, rec);
+            }
+            tail += rec->size;
+            __atomic_store_n(&tap->tail, tail, __ATOMIC_RELEASE);
+        }
+    }
+    return NULL;
+}
+
+int open_frame_tap(frame_tap *tap, const char *path) {
+    pcap_file_header hdr = {PCAP_MAGIC, 2, 4, 0, 0, TAP_SNAPLEN, LINKTYPE_IEEE802_11_RADIOTAP};
+
+    memset(tap, 0, sizeof(frame_tap));
+    tap->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (tap->fd < 0) {
+        fprintf(stderr, "Cannot create capture '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    tap->ring = malloc(TAP_RING_SIZE);
+    tap->buf = malloc(TAP_WRITE_BUF);
+    if (!tap->ring || !tap->buf || write_all(tap->fd, (const uint8_t *) &hdr, sizeof(hdr))
+        || pthread_create(&tap->writer, NULL, writer_thread, tap)) {
+        fprintf(stderr, "Cannot start capture '%s'\n", path);
+        free(tap->ring);
+        free(tap->buf);
+        close(tap->fd);
+        return -1;
+    }
+    return 0;
+}
+
+void tap_frame(frame_tap *tap, const uint8_t *frame, uint32_t len, uint32_t freq, int rate_idx, bool has_signal,
+               int8_t signal) {
+    uint64_t head = tap->head;
+    uint64_t tail = __atomic_load_n(&tap->tail, __ATOMIC_ACQUIRE);
+    uint32_t size = record_size(len);
+    uint32_t to_end = TAP_RING_SIZE - (uint32_t) (head & (TAP_RING_SIZE - 1));
+    uint32_t needed = size <= to_end ? size : to_end + size;
+    struct timespec ts;
+    tap_record *rec;
+
+    if (!len || TAP_RING_SIZE - (head - tail) < needed) {
+        __atomic_store_n(&tap->dropped, tap->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    if (size > to_end) {
+        // records are aligned, so the padding always has room for a header
+        rec = (tap_record *) (tap->ring + (head & (TAP_RING_SIZE - 1)));
+        rec->size = to_end;
+        rec->caplen = 0;
+        head += to_end;
+    }
+    clock_gettime(CLOCK_REALTIME, &ts);
+    rec = (tap_record *) (tap->ring + (head & (TAP_RING_SIZE - 1)));
+    rec->size = size;
+    rec->caplen = len;
+    rec->ts_ns = (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+    rec->freq = freq;
+    rec->rate_idx = (int8_t) (rate_idx < 0 || rate_idx > INT8_MAX ? -1 : rate_idx);
+    rec->has_signal = has_signal;
+    rec->signal = signal;
+    memcpy(rec + 1, frame, len);
+    __atomic_store_n(&tap->head, head + size, __ATOMIC_RELEASE);
+    __atomic_store_n(&tap->captured, tap->captured + 1, __ATOMIC_RELAXED);
+}
+
+void close_frame_tap(frame_tap *tap) {
+    __atomic_store_n(&tap->stop, true, __ATOMIC_RELEASE);
+    pthread_join(tap->writer, NULL);
+    flush_buf(tap);
+    close(tap->fd);
+    free(tap->ring);
+    free(tap->buf);
+}
@@ -0,0 +1,53 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_PCAP_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_PCAP_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Captures frames into a pcap file (802.11 with radiotap). The thread
+ * relaying frames copies them into a single-producer/single-consumer ring
+ * and never waits: frames that do not fit are dropped and counted. A
+ * writer thread drains the ring with large buffered writes.
+ */
+typedef struct {
+    uint8_t *ring;
+    int fd;
+    pthread_t writer;
+    bool stop;
+    // written by the producer
+    uint64_t head __attribute__((aligned(64)));
+    unsigned long captured;
+    unsigned long dropped;
+    // written by the writer
+    uint64_t tail __attribute__((aligned(64)));
+    uint8_t *buf;
+    size_t buf_len;
+    bool write_failed;
+} frame_tap;
+
+/*
+ * Creates the file at path, writes the pcap header and starts the writer.
+ */
+int open_frame_tap(frame_tap *tap, const char *path);
+
+/*
+ * Queues one frame. freq is in MHz (0 = unknown), rate_idx the
+ * mac80211_hwsim bitrate index (negative = unknown), signal in dBm if
+ * has_signal.
+ */
+void tap_frame(frame_tap *tap, const uint8_t *frame, uint32_t len, uint32_t freq, int rate_idx, bool has_signal,
+               int8_t signal);
+
+/*
+ * Writes the frames still queued and closes the file.
+ */
+void close_frame_tap(frame_tap *tap);
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_PCAP_H
@@ -0,0 +1,494 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#include <event.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hwsim_mgmt_playback.h"
+#include "hwsim_mgmt_journal.h"
+#include "hwsim_mgmt_batch.h"
+#include "hwsim_mgmt_radio.h"
+#include "hwsim_mgmt_stats.h"
+
+#define PLAYBACK_TICK_US 1000
+// power of two, the wheel looks this many ticks ahead
+#define PLAYBACK_WHEEL_SLOTS 1024
+#define PLAYBACK_QUEUE_MAX 4096
+#define PLAYBACK_LATE_US (2 * PLAYBACK_TICK_US)
+#define PLAYBACK_REPORT_MS 1000
+#define PLAYBACK_BUFFER (1u << 20)
+
+// id_map entries: 0 = not created by the journal, else the new id + 1
+#define ID_PENDING UINT32_MAX
+
+typedef struct playback playback;
+
+typedef struct playback_op {
+    struct playback_op *next;
+    playback *pb;
+    hwsim_journal_entry entry;
+    unsigned long record_no;
+    // microseconds after the start of the replay
+    uint64_t due_us;
+    uint64_t drift_us;
+} playback_op;
+
+typedef struct {
+    playback_op *head;
+    playback_op *tail;
+} op_queue;
+
+/*
+ * Operations are read ahead into a hashed timer wheel of one slot per
+ * tick. The wheel only holds operations of the next PLAYBACK_WHEEL_SLOTS
+ * ticks, so every slot holds a single tick and expiring it is a list
+ * splice. Expired operations wait in ready for room in the window and for
+ * the creates of the radios they address.
+ */
+struct playback {
+    hwsim_engine *engine;
+    FILE *in;
+    bool fast;
+    bool json;
+    struct event_base *ev_base;
+    struct event *ev_pump;
+    playback_op *ops;
+    playback_op *free_ops;
+    op_queue wheel[PLAYBACK_WHEEL_SLOTS];
+    // next tick to expire
+    uint64_t tick;
+    op_queue ready;
+    // read, but beyond the wheel
+    playback_op *next;
+    bool eof;
+    bool read_failed;
+    bool have_base;
+    uint64_t base_ns;
+    uint64_t start_us;
+    uint64_t last_report_us;
+    uint32_t *id_map;
+    size_t id_cap;
+    unsigned long records;
+    unsigned long queued;
+    unsigned long submitted;
+    unsigned long done;
+    unsigned long failed;
+    unsigned long diverged;
+    unsigned long late;
+    op_stats took;
+    latency_hist recorded;
+    latency_hist drift;
+};
+
+static void enqueue(op_queue *queue, playback_op *op) {
+    op->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = op;
+    } else {
+        queue->head = op;
+    }
+    queue->tail = op;
+}
+
+static void splice(op_queue *to, op_queue *from) {
+    if (!from->head) {
+        return;
+    }
+    if (to->tail) {
+        to->tail->next = from->head;
+    } else {
+        to->head = from->head;
+    }
+    to->tail = from->tail;
+    from->head = from->tail = NULL;
+}
+
+static void release_op(playback *pb, playback_op *op) {
+    op->next = pb->free_ops;
+    pb->free_ops = op;
+    pb->queued--;
+}
+
+static uint32_t *map_slot(playback *pb, uint32_t id) {
+    if (id >= pb->id_cap) {
+        size_t cap = pb->id_cap ? pb->id_cap : 1024;
+        while (cap <= id) {
+            cap *= 2;
+        }
+        uint32_t *grown = realloc(pb->id_map, cap * sizeof(uint32_t));
+        if (!grown) {
+            return NULL;
+        }
+        memset(grown + pb->id_cap, 0, (cap - pb->id_cap) * sizeof(uint32_t));
+        pb->id_map = grown;
+        pb->id_cap = cap;
+    }
+    return &pb->id_map[id];
+}
+
+static uint32_t mapped_id(const playback *pb, uint32_t id) {
+    return id < pb->id_cap ? pb->id_map[id] : 0;
+}
+
+/*
+ * Returns true while a radio op addresses is still being created.
+ */
+static bool waits_for_create(const playback *pb, const hwsim_args *op) {
+    uint32_t i;
+    switch (op->mode) {
+        case HWSIM_OP_DELETE_BY_ID:
+            return mapped_id(pb, op->del_radio_id) == ID_PENDING;
+        case HWSIM_OP_SET_RSSI:
+            return mapped_id(pb, op->rssi_radio) == ID_PENDING;
+        case HWSIM_OP_SET_PROPS:
+            for (i = 0; i < op->props_count; i++) {
+                if (mapped_id(pb, op->props[i].radio_id) == ID_PENDING) {
+                    return true;
+                }
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+static void translate_id(const playback *pb, uint32_t *id) {
+    uint32_t mapped = mapped_id(pb, *id);
+    if (mapped && mapped != ID_PENDING) {
+        *id = mapped - 1;
+    }
+}
+
+/*
+ * props (HWSIM_PROPS_MAX entries) receives the translated props of a set,
+ * the journal entry keeps the recorded ids for a retry.
+ */
+static void translate_ids(const playback *pb, hwsim_args *op, hwsim_props *props) {
+    uint32_t i;
+    switch (op->mode) {
+        case HWSIM_OP_DELETE_BY_ID:
+            translate_id(pb, &op->del_radio_id);
+            break;
+        case HWSIM_OP_SET_RSSI:
+            translate_id(pb, &op->rssi_radio);
+            break;
+        case HWSIM_OP_SET_PROPS:
+            for (i = 0; i < op->props_count; i++) {
+                props[i] = op->props[i];
+                translate_id(pb, &props[i].radio_id);
+            }
+            op->props = props;
+            break;
+        default:
+            break;
+    }
+}
+
+static void print_result(playback *pb, const playback_op *op, const hwsim_request *req) {
+    const hwsim_journal_entry *entry = &op->entry;
+    double took_us = timespec_diff_ns(&req->submitted, &req->replied) / 1e3;
+    int id = req->radio_id >= 0 ? req->radio_id : req->target_id;
+
+    if (pb->json) {
+        printf("{\"record\":%lu,\"op\":\"%s\",\"id\":", op->record_no, op_name(req->mode));
+        if (id >= 0) {
+            printf("%d", id);
+        } else {
+            printf("null");
+        }
+        printf(",\"name\":");
+        if (req->name[0]) {
+            print_json_string(stdout, req->name);
+        } else {
+            printf("null");
+        }
+        printf(",\"error\":%d", req->error < 0 ? req->error : 0);
+        if (!pb->fast) {
+            printf(",\"drift_us\":%lu", (unsigned long) op->drift_us);
+        }
+        printf(",\"took_us\":%.1f,\"recorded\":%d,\"recorded_us\":%u}\n", took_us, entry->result,
+               entry->latency_us);
+        return;
+    }
+    if (req->error < 0) {
+        printf("%lu %s err %d %s", op->record_no, op_name(req->mode), req->error, strerror(abs(req->error)));
+    } else {
+        printf("%lu %s ok %d", op->record_no, op_name(req->mode), req->radio_id);
+    }
+    if (!pb->fast) {
+        printf(" drift_us=%lu", (unsigned long) op->drift_us);
+    }
+    printf(" took_us=%.1f recorded=%d recorded_us=%u\n", took_us, entry->result, entry->latency_us);
+}
+
+/*
+ * Reports an operation that could not be sent like a completed one, with
+ * -EIO and no time taken.
+ */
+static void print_submit_failure(playback *pb, const playback_op *op, const hwsim_args *args) {
+    hwsim_request req;
+
+    memset(&req, 0, sizeof(req));
+    req.mode = args->mode;
+    req.error = -EIO;
+    req.radio_id = -1;
+    req.target_id = -1;
+    if (args->mode == HWSIM_OP_DELETE_BY_ID) {
+        req.target_id = (int) args->del_radio_id;
+    } else if (args->mode == HWSIM_OP_SET_RSSI) {
+        req.target_id = (int) args->rssi_radio;
+    }
+    strcpy(req.name, op->entry.name);
+    print_result(pb, op, &req);
+}
+
+static void playback_done(const hwsim_request *req, void *arg) {
+    playback_op *op = arg;
+    playback *pb = op->pb;
+    const hwsim_journal_entry *entry = &op->entry;
+
+    if (req->mode == HWSIM_OP_CREATE && entry->result >= 0) {
+        uint32_t *slot = map_slot(pb, (uint32_t) entry->result);
+        if (slot) {
+            // a failed create leaves later operations on the recorded id
+            *slot = req->error < 0 ? 0 : (uint32_t) req->radio_id + 1;
+        }
+    }
+    if ((req->error < 0) != (entry->result < 0) || (req->error < 0 && req->error != entry->result)) {
+        pb->diverged++;
+    }
+    pb->done++;
+    pb->failed += req->error < 0;
+    record_request(&pb->took, req);
+    record_latency(&pb->recorded, (uint64_t) entry->latency_us * 1000, entry->result < 0);
+    print_result(pb, op, req);
+    release_op(pb, op);
+    // submit more once the engine has released the slot
+    event_active(pb->ev_pump, EV_TIMEOUT, 0);
+}
+
+/*
+ * Reads operations until the wheel's horizon or the queue limit is
+ * reached. Operations that are already due go to ready directly.
+ */
+static void read_ahead(playback *pb) {
+    while (!pb->eof) {
+        playback_op *op = pb->next;
+        if (!op) {
+            int ret;
+            if (!pb->free_ops) {
+                return;
+            }
+            op = pb->free_ops;
+            ret = read_journal_record(pb->in, &op->entry);
+            if (ret <= 0) {
+                if (ret < 0) {
+                    fprintf(stderr, "Journal is truncated or malformed after record %lu\n", pb->records);
+                    pb->read_failed = true;
+                }
+                pb->eof = true;
+                return;
+            }
+            pb->free_ops = op->next;
+            pb->queued++;
+            op->record_no = ++pb->records;
+            if (!pb->have_base) {
+                pb->base_ns = op->entry.submitted_ns;
+                pb->have_base = true;
+            }
+            op->due_us = pb->fast || op->entry.submitted_ns < pb->base_ns
+                         ? 0 : (op->entry.submitted_ns - pb->base_ns) / 1000;
+            pb->next = op;
+        }
+        uint64_t due_tick = op->due_us / PLAYBACK_TICK_US;
+        if (due_tick >= pb->tick + PLAYBACK_WHEEL_SLOTS) {
+            return;
+        }
+        pb->next = NULL;
+        enqueue(due_tick < pb->tick ? &pb->ready : &pb->wheel[due_tick & (PLAYBACK_WHEEL_SLOTS - 1)], op);
+    }
+}
+
+/*
+ * Expires every tick up to the current one; submit_ready() holds back
+ * operations of the current tick until their time.
+ */
+static void expire_ticks(playback *pb, uint64_t now) {
+    uint64_t elapsed = now - pb->start_us;
+    while (pb->tick * PLAYBACK_TICK_US <= elapsed) {
+        splice(&pb->ready, &pb->wheel[pb->tick & (PLAYBACK_WHEEL_SLOTS - 1)]);
+        pb->tick++;
+    }
+}
+
+static void submit_ready(playback *pb) {
+    playback_op *op;
+
+    while ((op = pb->ready.head)) {
+        hwsim_props props[HWSIM_PROPS_MAX];
+        hwsim_args args = op->entry.op;
+        uint64_t now = monotonic_ns() / 1000;
+        int ret;
+
+        // keeps the order of the journal, later operations may need the radio as well
+        if (waits_for_create(pb, &args) || (!pb->fast && pb->start_us + op->due_us > now)) {
+            return;
+        }
+        translate_ids(pb, &args, props);
+        if (!pb->fast) {
+            uint64_t due = pb->start_us + op->due_us;
+            op->drift_us = now > due ? now - due : 0;
+        }
+        ret = submit_request(pb->engine, &args, playback_done, op);
+        if (ret == -EBUSY) {
+            return;
+        }
+        pb->ready.head = op->next;
+        if (!pb->ready.head) {
+            pb->ready.tail = NULL;
+        }
+        if (ret) {
+            print_submit_failure(pb, op, &args);
+            pb->failed++;
+            pb->diverged++;
+            release_op(pb, op);
+            continue;
+        }
+        pb->submitted++;
+        if (!pb->fast) {
+            record_latency(&pb->drift, op->drift_us * 1000, false);
+            pb->late += op->drift_us > PLAYBACK_LATE_US;
+        }
+        if (args.mode == HWSIM_OP_CREATE && op->entry.result >= 0) {
+            uint32_t *slot = map_slot(pb, (uint32_t) op->entry.result);
+            if (slot) {
+                *slot = ID_PENDING;
+            }
+        }
+    }
+}
+
+static void report(playback *pb, FILE *out, const char *prefix, uint64_t elapsed_us) {
+    double secs = elapsed_us ? elapsed_us / 1000000.0 : 1.0;
+    fprintf(out, "%s%lu read, %lu submitted (%.0f/s), %lu done, %lu failed, %lu diverged, %lu late\n", prefix,
+            pb->records, pb->submitted, pb->submitted / secs, pb->done, pb->failed, pb->diverged, pb->late);
+}
+
+static void pump(playback *pb) {
+    uint64_t now = monotonic_ns() / 1000;
+
+    expire_ticks(pb, now);
+    read_ahead(pb);
+    submit_ready(pb);
+    if (now - pb->last_report_us >= PLAYBACK_REPORT_MS * 1000) {
+        report(pb, stderr, "playback: ", now - pb->start_us);
+        pb->last_report_us = now;
+    }
+    if (pb->eof && !pb->queued) {
+        event_base_loopbreak(pb->ev_base);
+    }
+}
+
+static void pump_cb(evutil_socket_t fd, short what, void *arg) {
+    UNUSED(fd);
+    UNUSED(what);
+    pump(arg);
+}
+
+static void tick_cb(evutil_socket_t fd, short what, void *arg) {
+    UNUSED(fd);
+    UNUSED(what);
+    playback *pb = arg;
+    check_deadlines(pb->engine);
+    pump(pb);
+}
+
+static int play_journal(playback *pb) {
+    struct timeval tick = {0, PLAYBACK_TICK_US};
+    hwsim_journal_header header;
+    size_t i;
+
+    if (read_journal_header(pb->in, &header)) {
+        fprintf(stderr, "Not an operation journal\n");
+        return EXIT_FAILURE;
+    }
+    pb->ev_base = event_base_new();
+    if (!pb->ev_base) {
+        fprintf(stderr, "Error creating event base\n");
+        return EXIT_FAILURE;
+    }
+    struct event *ev_nl = add_nl_event(pb->engine, pb->ev_base);
+    struct event *ev_tick = event_new(pb->ev_base, -1, EV_PERSIST, tick_cb, pb);
+    pb->ev_pump = event_new(pb->ev_base, -1, 0, pump_cb, pb);
+    if (ev_nl && ev_tick && pb->ev_pump) {
+        for (i = 0; i < PLAYBACK_QUEUE_MAX; i++) {
+            pb->ops[i].pb = pb;
+            pb->ops[i].next = pb->free_ops;
+            pb->free_ops = &pb->ops[i];
+        }
+        pb->start_us = pb->last_report_us = monotonic_ns() / 1000;
+        event_add(ev_tick, &tick);
+        event_active(pb->ev_pump, EV_TIMEOUT, 0);
+        event_base_dispatch(pb->ev_base);
+    } else {
+        fprintf(stderr, "Error registering events!\n");
+        pb->read_failed = true;
+    }
+
+    if (pb->ev_pump) {
+        event_free(pb->ev_pump);
+    }
+    if (ev_tick) {
+        event_free(ev_tick);
+    }
+    if (ev_nl) {
+        event_free(ev_nl);
+    }
+    event_base_free(pb->ev_base);
+    return pb->read_failed || pb->diverged ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int run_journal_replay(hwsim_engine *engine, const char *path, bool fast, bool json) {
+    playback *pb = calloc(1, sizeof(playback));
+    char stats[160];
+    int ret = EXIT_FAILURE;
+    size_t i;
+
+    if (!pb || !(pb->ops = calloc(PLAYBACK_QUEUE_MAX, sizeof(playback_op)))) {
+        free(pb);
+        return EXIT_FAILURE;
+    }
+    pb->engine = engine;
+    pb->fast = fast;
+    pb->json = json;
+    init_op_stats(&pb->took);
+    pb->in = fopen(path, "rb");
+    if (!pb->in) {
+        fprintf(stderr, "Cannot open journal '%s': %s\n", path, strerror(errno));
+    } else {
+        setvbuf(pb->in, NULL, _IOFBF, PLAYBACK_BUFFER);
+        ret = play_journal(pb);
+        fclose(pb->in);
+        // keep stdout parseable: the text summary goes to stderr
+        print_op_stats(&pb->took, json ? stdout : stderr, json);
+        print_latency_hist("recorded", &pb->recorded, json ? stdout : stderr, json);
+        print_latency_hist("drift", &pb->drift, json ? stdout : stderr, json);
+        report(pb, stderr, "", monotonic_ns() / 1000 - pb->start_us);
+        if (engine->overrun.overruns) {
+            print_overrun_stats(engine, 1, stats, sizeof(stats));
+            fprintf(stderr, "Receive %s\n", stats);
+        }
+    }
+    for (i = 0; i < PLAYBACK_QUEUE_MAX; i++) {
+        free(pb->ops[i].entry.props);
+    }
+    free_op_stats(&pb->took);
+    free(pb->id_map);
+    free(pb->ops);
+    free(pb);
+    return ret;
+}
@@ -0,0 +1,22 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_PLAYBACK_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_PLAYBACK_H
+
+#include "hwsim_mgmt_event.h"
+
+/*
+ * Runs the operations of the journal at path (hwsim_mgmt_journal.h) again,
+ * at their recorded offsets from the first one or, if fast is set, as fast
+ * as the window allows. Radio ids are translated from the recorded creates
+ * to the radios they create now. Prints one result line per operation with
+ * its drift from the schedule, its latency and the recorded latency, then
+ * histograms of all three. The engine's replies must not be dispatched by
+ * an event thread: the replay runs its own event loop.
+ */
+int run_journal_replay(hwsim_engine *engine, const char *path, bool fast, bool json);
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_PLAYBACK_H
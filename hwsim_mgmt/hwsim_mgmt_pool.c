@@ -0,0 +1,119 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hwsim_mgmt_pool.h"
+#include "hwsim_mgmt_radio.h"
+
+int init_pool(hwsim_pool *pool, const hwsim_config *config, size_t count, size_t window, uint32_t timeout_ms) {
+    size_t i;
+    int ret;
+    pool->error[0] = '\0';
+    if (count == 0 || count > HWSIM_MAX_SOCKETS) {
+        snprintf(pool->error, sizeof(pool->error), "Socket count must be between 1 and %d", HWSIM_MAX_SOCKETS);
+        return -1;
+    }
+    pool->count = 0;
+    pool->next = 0;
+    pool->nl_ctxs = calloc(count, sizeof(netlink_ctx));
+    pool->engines = calloc(count, sizeof(hwsim_engine));
+    if (!pool->nl_ctxs || !pool->engines) {
+        snprintf(pool->error, sizeof(pool->error), "Error allocating socket pool");
+        free_pool(pool);
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        if (init_netlink(&pool->nl_ctxs[i], config)) {
+            snprintf(pool->error, sizeof(pool->error), "Error initializing netlink context: %s",
+                     pool->nl_ctxs[i].error);
+            free_netlink(&pool->nl_ctxs[i]);
+            free_pool(pool);
+            return -1;
+        }
+        if ((ret = init_engine(&pool->engines[i], &pool->nl_ctxs[i], window, timeout_ms))) {
+            snprintf(pool->error, sizeof(pool->error), "Error initializing engine: %s", strerror(-ret));
+            free_netlink(&pool->nl_ctxs[i]);
+            free_pool(pool);
+            return -1;
+        }
+        pool->count++;
+        if ((ret = register_event(&pool->engines[i]))) {
+            snprintf(pool->error, sizeof(pool->error), "Error registering events: %s", strerror(-ret));
+            free_pool(pool);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void free_pool(hwsim_pool *pool) {
+    size_t i;
+    for (i = 0; i < pool->count; i++) {
+        unregister_event(&pool->engines[i]);
+        free_engine(&pool->engines[i]);
+        free_netlink(&pool->nl_ctxs[i]);
+    }
+    free(pool->engines);
+    free(pool->nl_ctxs);
+    pool->engines = NULL;
+    pool->nl_ctxs = NULL;
+    pool->count = 0;
+}
+
+hwsim_engine *pool_engine(hwsim_pool *pool, const hwsim_args *op) {
+    size_t shard;
+    if (pool->count == 1) {
+        return &pool->engines[0];
+    }
+    switch (op->mode) {
+        case HWSIM_OP_CREATE:
+            if (op->c_hwname) {
+                shard = radio_name_hash(op->c_hwname);
+            } else {
+                shard = pool->next++;
+            }
+            break;
+        case HWSIM_OP_DELETE_BY_NAME:
+            shard = radio_name_hash(op->del_radio_name);
+            break;
+        case HWSIM_OP_DELETE_BY_ID:
+            shard = op->del_radio_id;
+            break;
+        case HWSIM_OP_SET_RSSI:
+            shard = op->rssi_radio;
+            break;
+        case HWSIM_OP_SET_PROPS:
+            shard = op->props_count ? op->props[0].radio_id : 0;
+            break;
+        default:
+            shard = 0;
+            break;
+    }
+    return &pool->engines[shard % pool->count];
+}
+
+void wait_for_pool(hwsim_pool *pool) {
+    size_t i;
+    for (i = 0; i < pool->count; i++) {
+        wait_for_event(&pool->engines[i]);
+    }
+}
+
+void report_pool_overruns(hwsim_pool *pool, FILE *out) {
+    hwsim_overrun_stats stats;
+    char buf[128];
+    size_t i;
+
+    for (i = 0; i < pool->count; i++) {
+        get_overrun_stats(&pool->engines[i], &stats);
+        if (stats.overruns) {
+            print_overrun_stats(pool->engines, pool->count, buf, sizeof(buf));
+            fprintf(out, "Receive %s\n", buf);
+            return;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_POOL_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_POOL_H
+
+#include <stdio.h>
+#include "hwsim_mgmt_event.h"
+
+#define HWSIM_MAX_SOCKETS 64
+
+/*
+ * A set of genl sockets, each with its own engine and event thread, so
+ * the kernel can work on requests from several sockets in parallel.
+ */
+typedef struct {
+    size_t count;
+    netlink_ctx *nl_ctxs;
+    hwsim_engine *engines;
+    size_t next;
+    // why init_pool() failed, may quote a netlink_ctx error
+    char error[2 * HWSIM_ERROR_LEN];
+} hwsim_pool;
+
+/*
+ * Opens count sockets configured by config with a window of window
+ * requests each and starts their event threads. On failure pool->error
+ * tells why.
+ */
+int init_pool(hwsim_pool *pool, const hwsim_config *config, size_t count, size_t window, uint32_t timeout_ms);
+
+void free_pool(hwsim_pool *pool);
+
+/*
+ * Picks the engine for op. Operations on the same radio name or id
+ * always use the same socket and keep their order; creates without a
+ * name are spread round robin. Ordering between different shards (e.g.
+ * create by name followed by delid) is not guaranteed.
+ */
+hwsim_engine *pool_engine(hwsim_pool *pool, const hwsim_args *op);
+
+/*
+ * Blocks until no request is outstanding on any socket.
+ */
+void wait_for_pool(hwsim_pool *pool);
+
+/*
+ * Prints the overrun counters of all sockets to out, if any socket was
+ * overrun.
+ */
+void report_pool_overruns(hwsim_pool *pool, FILE *out);
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_POOL_H
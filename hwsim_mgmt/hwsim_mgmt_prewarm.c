@@ -0,0 +1,157 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hwsim_mgmt_prewarm.h"
+
+/*
+ * Deletes a radio the pool has no room for, it would outlive the daemon
+ * otherwise.
+ */
+static void drop_spare(radio_prewarm *pw, uint32_t radio_id) {
+    hwsim_args op;
+    memset(&op, 0, sizeof(op));
+    op.mode = HWSIM_OP_DELETE_BY_ID;
+    op.del_radio_id = radio_id;
+    if (submit_request(pw->engine, &op, NULL, NULL)) {
+        fprintf(stderr, "Could not delete surplus spare radio %u\n", radio_id);
+    }
+}
+
+static void prewarm_created(const hwsim_request *req, void *arg) {
+    radio_prewarm *pw = arg;
+    pw->creating--;
+    if (req->error < 0) {
+        // no retries until the next take
+        pw->refilling = false;
+        pw->failed++;
+    } else if (pw->spare_count >= pw->high) {
+        pw->created++;
+        drop_spare(pw, (uint32_t) req->radio_id);
+    } else {
+        pw->created++;
+        pw->spare[pw->spare_count++] = (uint32_t) req->radio_id;
+    }
+    if (pw->created_cb) {
+        pw->created_cb(pw->created_arg);
+    }
+}
+
+int init_prewarm(radio_prewarm *pw, hwsim_engine *engine, radio_watch *watch, bool destroy_on_close, uint32_t low,
+                 uint32_t high) {
+    memset(pw, 0, sizeof(*pw));
+    if (!watch->live) {
+        fprintf(stderr, "Radio notifications unavailable, not prewarming radios\n");
+        return EXIT_FAILURE;
+    }
+    pw->spare = malloc(high * sizeof(uint32_t));
+    if (!pw->spare) {
+        return EXIT_FAILURE;
+    }
+    pw->engine = engine;
+    pw->watch = watch;
+    pw->low = low < high ? low : high - 1;
+    pw->high = high;
+    pw->destroy_on_close = destroy_on_close;
+    refill_prewarm(pw);
+    return EXIT_SUCCESS;
+}
+
+void refill_prewarm(radio_prewarm *pw) {
+    hwsim_args op;
+    if (!pw->refilling && pw->spare_count + pw->creating + pw->renaming > pw->low) {
+        return;
+    }
+    memset(&op, 0, sizeof(op));
+    op.mode = HWSIM_OP_CREATE;
+    op.c_no_vif = true;
+    op.c_destroy_on_close = pw->destroy_on_close;
+    pw->refilling = true;
+    while (pw->spare_count + pw->creating + pw->renaming < pw->high) {
+        pw->creating++;
+        if (submit_request(pw->engine, &op, prewarm_created, pw)) {
+            pw->creating--;
+            return;
+        }
+    }
+    pw->refilling = false;
+}
+
+bool prewarm_serves(const radio_prewarm *pw, const hwsim_args *op) {
+    return op->mode == HWSIM_OP_CREATE && op->c_no_vif && op->c_destroy_on_close == pw->destroy_on_close
+           && !op->c_channels && !op->c_use_chanctx && !op->c_reg_alpha2 && !op->c_reg_custom_reg;
+}
+
+/*
+ * A spare still carries the name the kernel gave its wiphy, "phy" and the
+ * wiphy index. Spares that are gone or were renamed by someone else are
+ * dropped.
+ */
+int take_prewarmed(radio_prewarm *pw, uint32_t *radio_id, uint32_t *wiphy_idx) {
+    const hwsim_radio *radio;
+    int found = -1, len;
+
+    pthread_mutex_lock(&pw->watch->lock);
+    while (found < 0 && pw->spare_count) {
+        *radio_id = pw->spare[--pw->spare_count];
+        radio = find_radio_by_id(&pw->watch->index, *radio_id);
+        if (radio && sscanf(radio->name, "phy%u%n", wiphy_idx, &len) == 1 && radio->name[len] == '\0') {
+            found = 0;
+        }
+    }
+    pthread_mutex_unlock(&pw->watch->lock);
+    if (found < 0) {
+        pw->misses++;
+    } else {
+        pw->hits++;
+        pw->renaming++;
+    }
+    refill_prewarm(pw);
+    return found;
+}
+
+void keep_prewarmed(radio_prewarm *pw) {
+    pw->renaming--;
+    refill_prewarm(pw);
+}
+
+void return_prewarmed(radio_prewarm *pw, uint32_t radio_id) {
+    pw->hits--;
+    pw->renaming--;
+    if (pw->spare_count < pw->high) {
+        pw->spare[pw->spare_count++] = radio_id;
+    } else {
+        drop_spare(pw, radio_id);
+    }
+}
+
+void print_prewarm_stats(const radio_prewarm *pw, char *buf, size_t len) {
+    snprintf(buf, len, "spare=%u creating=%u renaming=%u hits=%lu misses=%lu created=%lu failed=%lu",
+             pw->spare_count, pw->creating, pw->renaming, pw->hits, pw->misses, pw->created, pw->failed);
+}
+
+void free_prewarm(radio_prewarm *pw) {
+    hwsim_args op;
+    uint32_t i;
+
+    if (!pw->spare) {
+        return;
+    }
+    if (pw->spare_count && !pw->destroy_on_close && !register_event(pw->engine)) {
+        memset(&op, 0, sizeof(op));
+        op.mode = HWSIM_OP_DELETE_BY_ID;
+        for (i = 0; i < pw->spare_count; i++) {
+            op.del_radio_id = pw->spare[i];
+            submit_request_wait(pw->engine, &op, NULL, NULL);
+        }
+        wait_for_event(pw->engine);
+        unregister_event(pw->engine);
+    }
+    free(pw->spare);
+    pw->spare = NULL;
+}
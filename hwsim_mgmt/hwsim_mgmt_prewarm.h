@@ -0,0 +1,85 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_PREWARM_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_PREWARM_H
+
+#include "hwsim_mgmt_watch.h"
+
+/*
+ * Spare radios created ahead of time without name and without interface,
+ * so a matching create only costs a rename of the spare's wiphy. Refilled
+ * up to high once spare and pending radios fall to low; a spare handed
+ * out stays pending until it was kept or returned, so the pool never
+ * holds more than high radios. All functions but
+ * free_prewarm() run on the thread dispatching the engine's replies; the
+ * watch must be live to learn the spares' wiphy names.
+ */
+typedef struct {
+    hwsim_engine *engine;
+    radio_watch *watch;
+    uint32_t low;
+    uint32_t high;
+    // spares are created destroy-on-close, and left to the kernel at exit
+    bool destroy_on_close;
+    uint32_t *spare;
+    uint32_t spare_count;
+    uint32_t creating;
+    // handed out, neither kept nor returned yet
+    uint32_t renaming;
+    // set until a started refill reached high
+    bool refilling;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long created;
+    unsigned long failed;
+    // called after every spare create, whose slot in the window is free then
+    void (*created_cb)(void *arg);
+    void *created_arg;
+} radio_prewarm;
+
+/*
+ * Starts filling the pool, low is capped below high.
+ */
+int init_prewarm(radio_prewarm *pw, hwsim_engine *engine, radio_watch *watch, bool destroy_on_close, uint32_t low,
+                 uint32_t high);
+
+/*
+ * Submits creates for missing spares. Stops early if the engine's window
+ * is full, the next call continues where it stopped.
+ */
+void refill_prewarm(radio_prewarm *pw);
+
+/*
+ * Whether a spare can stand in for the radio op creates: only creates
+ * with no_vif, the pool's destroy-on-close and otherwise default options.
+ */
+bool prewarm_serves(const radio_prewarm *pw, const hwsim_args *op);
+
+/*
+ * Hands out a spare with its id and wiphy index. Returns -1 and counts a
+ * miss if there is none. A spare handed out is either kept or returned.
+ */
+int take_prewarmed(radio_prewarm *pw, uint32_t *radio_id, uint32_t *wiphy_idx);
+
+/*
+ * Marks a spare handed out as serving its create.
+ */
+void keep_prewarmed(radio_prewarm *pw);
+
+/*
+ * Puts back a spare whose rename failed.
+ */
+void return_prewarmed(radio_prewarm *pw, uint32_t radio_id);
+
+void print_prewarm_stats(const radio_prewarm *pw, char *buf, size_t len);
+
+/*
+ * Deletes the remaining spares. Must be called after the event loop
+ * stopped dispatching replies.
+ */
+void free_prewarm(radio_prewarm *pw);
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_PREWARM_H
@@ -0,0 +1,363 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#include <netlink/netlink.h>
+#include <netlink/genl/genl.h>
+#include <errno.h>
+#include <string.h>
+
+#include "hwsim_mgmt_radio.h"
+
+typedef struct {
+    hwsim_engine *engine;
+    radio_index *index;
+    bool done;
+    int error;
+} radio_dump;
+
+uint32_t radio_name_hash(const char *name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash = (hash ^ (uint8_t) *name++) * 16777619u;
+    }
+    return hash;
+}
+
+void radio_hwaddr(uint32_t id, uint8_t addr[6]) {
+    addr[0] = 0x42;
+    addr[1] = 0;
+    addr[2] = 0;
+    addr[3] = (uint8_t) (id >> 8);
+    addr[4] = (uint8_t) id;
+    addr[5] = 0;
+}
+
+int radio_id_from_hwaddr(const uint8_t *addr) {
+    if ((addr[0] != 0x02 && addr[0] != 0x42) || addr[1] || addr[2] || addr[5]) {
+        return -1;
+    }
+    return addr[3] << 8 | addr[4];
+}
+
+void init_radio_index(radio_index *index) {
+    memset(index, 0, sizeof(*index));
+}
+
+void free_radio_index(radio_index *index) {
+    free(index->radios);
+    free(index->by_id);
+    free(index->by_name);
+    init_radio_index(index);
+}
+
+void clear_radio_index(radio_index *index) {
+    index->count = 0;
+    if (index->by_id) {
+        memset(index->by_id, 0xff, index->id_cap * sizeof(int32_t));
+    }
+    if (index->by_name) {
+        memset(index->by_name, 0xff, index->name_cap * sizeof(int32_t));
+    }
+}
+
+static void hash_insert(radio_index *index, size_t pos) {
+    size_t slot = radio_name_hash(index->radios[pos].name) & (index->name_cap - 1);
+    while (index->by_name[slot] >= 0) {
+        slot = (slot + 1) & (index->name_cap - 1);
+    }
+    index->by_name[slot] = (int32_t) pos;
+}
+
+static size_t hash_find(const radio_index *index, size_t pos) {
+    size_t slot = radio_name_hash(index->radios[pos].name) & (index->name_cap - 1);
+    while (index->by_name[slot] != (int32_t) pos) {
+        slot = (slot + 1) & (index->name_cap - 1);
+    }
+    return slot;
+}
+
+/*
+ * Backward shift deletion: moves later entries of the probe sequence into
+ * the hole so that lookups never need tombstones.
+ */
+static void hash_delete(radio_index *index, size_t slot) {
+    size_t mask = index->name_cap - 1;
+    size_t hole = slot;
+    size_t next = (slot + 1) & mask;
+    while (index->by_name[next] >= 0) {
+        size_t home = radio_name_hash(index->radios[index->by_name[next]].name) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            index->by_name[hole] = index->by_name[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    index->by_name[hole] = -1;
+}
+
+static int rebuild_names(radio_index *index, size_t name_cap) {
+    size_t i;
+    if (name_cap != index->name_cap) {
+        int32_t *by_name = realloc(index->by_name, name_cap * sizeof(int32_t));
+        if (!by_name) {
+            return -1;
+        }
+        index->by_name = by_name;
+        index->name_cap = name_cap;
+    }
+    memset(index->by_name, 0xff, index->name_cap * sizeof(int32_t));
+    for (i = 0; i < index->count; i++) {
+        if (index->radios[i].name[0]) {
+            hash_insert(index, i);
+        }
+    }
+    return 0;
+}
+
+static int reserve(radio_index *index, uint32_t id) {
+    if (index->count == index->cap) {
+        size_t cap = index->cap ? index->cap * 2 : 64;
+        hwsim_radio *radios = realloc(index->radios, cap * sizeof(hwsim_radio));
+        if (!radios) {
+            return -1;
+        }
+        index->radios = radios;
+        index->cap = cap;
+    }
+    if (id >= index->id_cap) {
+        size_t cap = index->id_cap ? index->id_cap : 64;
+        while (cap <= id) {
+            cap *= 2;
+        }
+        int32_t *by_id = realloc(index->by_id, cap * sizeof(int32_t));
+        if (!by_id) {
+            return -1;
+        }
+        memset(&by_id[index->id_cap], 0xff, (cap - index->id_cap) * sizeof(int32_t));
+        index->by_id = by_id;
+        index->id_cap = cap;
+    }
+    // keep the name table at most half full
+    if ((index->count + 1) * 2 > index->name_cap) {
+        return rebuild_names(index, index->name_cap ? index->name_cap * 2 : 128);
+    }
+    return 0;
+}
+
+int put_radio(radio_index *index, const hwsim_radio *radio) {
+    const hwsim_radio *old = find_radio_by_id(index, radio->id);
+    if (old) {
+        size_t pos = old - index->radios;
+        bool renamed = strcmp(old->name, radio->name) != 0;
+        index->radios[pos] = *radio;
+        return renamed ? rebuild_names(index, index->name_cap) : 0;
+    }
+    if (reserve(index, radio->id)) {
+        return -1;
+    }
+    index->radios[index->count] = *radio;
+    index->by_id[radio->id] = (int32_t) index->count;
+    if (radio->name[0]) {
+        hash_insert(index, index->count);
+    }
+    index->count++;
+    return 0;
+}
+
+void remove_radio(radio_index *index, uint32_t id) {
+    const hwsim_radio *old = find_radio_by_id(index, id);
+    if (!old) {
+        return;
+    }
+    size_t pos = old - index->radios;
+    if (old->name[0]) {
+        hash_delete(index, hash_find(index, pos));
+    }
+    index->by_id[id] = -1;
+    index->count--;
+    if (pos != index->count) {
+        // the last radio takes the free position
+        if (index->radios[index->count].name[0]) {
+            index->by_name[hash_find(index, index->count)] = (int32_t) pos;
+        }
+        index->radios[pos] = index->radios[index->count];
+        index->by_id[index->radios[pos].id] = (int32_t) pos;
+    }
+}
+
+const hwsim_radio *find_radio_by_id(const radio_index *index, uint32_t id) {
+    if (id >= index->id_cap || index->by_id[id] < 0) {
+        return NULL;
+    }
+    return &index->radios[index->by_id[id]];
+}
+
+const hwsim_radio *find_radio_by_name(const radio_index *index, const char *name) {
+    if (!index->name_cap) {
+        return NULL;
+    }
+    size_t slot = radio_name_hash(name) & (index->name_cap - 1);
+    while (index->by_name[slot] >= 0) {
+        const hwsim_radio *radio = &index->radios[index->by_name[slot]];
+        if (!strcmp(radio->name, name)) {
+            return radio;
+        }
+        slot = (slot + 1) & (index->name_cap - 1);
+    }
+    return NULL;
+}
+
+int parse_radio(struct nl_msg *msg, hwsim_radio *radio) {
+    struct nlattr *attrs[__HWSIM_ATTR_MAX];
+    struct nlmsghdr *nlh = nlmsg_hdr(msg);
+
+    if (genlmsg_parse(nlh, 0, attrs, __HWSIM_ATTR_MAX - 1, NULL) < 0 || !attrs[HWSIM_ATTR_RADIO_ID]) {
+        return -1;
+    }
+    memset(radio, 0, sizeof(*radio));
+    radio->id = nla_get_u32(attrs[HWSIM_ATTR_RADIO_ID]);
+    if (attrs[HWSIM_ATTR_RADIO_NAME]) {
+        // the kernel does not terminate the name
+        nla_strlcpy(radio->name, attrs[HWSIM_ATTR_RADIO_NAME], sizeof(radio->name));
+    }
+    if (attrs[HWSIM_ATTR_CHANNELS]) {
+        radio->channels = nla_get_u32(attrs[HWSIM_ATTR_CHANNELS]);
+    }
+    if (attrs[HWSIM_ATTR_REG_HINT_ALPHA2]) {
+        nla_strlcpy(radio->reg_alpha2, attrs[HWSIM_ATTR_REG_HINT_ALPHA2], sizeof(radio->reg_alpha2));
+    }
+    if (attrs[HWSIM_ATTR_REG_CUSTOM_REG]) {
+        radio->reg_custom_reg = nla_get_u32(attrs[HWSIM_ATTR_REG_CUSTOM_REG]);
+    }
+    radio->use_chanctx = attrs[HWSIM_ATTR_USE_CHANCTX] != NULL;
+    radio->p2p_device = attrs[HWSIM_ATTR_SUPPORT_P2P_DEVICE] != NULL;
+    radio->destroy_on_close = attrs[HWSIM_ATTR_DESTROY_RADIO_ON_CLOSE] != NULL;
+    radio->reg_strict = attrs[HWSIM_ATTR_REG_STRICT_REG] != NULL;
+    return 0;
+}
+
+static void radio_dump_reply(struct nl_msg *msg, void *arg) {
+    radio_dump *dump = arg;
+    hwsim_radio radio;
+    if (!parse_radio(msg, &radio) && put_radio(dump->index, &radio)) {
+        dump->error = -ENOMEM;
+    }
+}
+
+static void radio_dump_done(const hwsim_request *req, void *arg) {
+    radio_dump *dump = arg;
+    if (req->error < 0) {
+        dump->error = req->error;
+    }
+    signal_done(dump->engine, &dump->done);
+}
+
+int load_radio_index(hwsim_engine *engine, radio_index *index) {
+    radio_dump dump = {engine, index, false, 0};
+    hwsim_args op;
+    int ret;
+
+    memset(&op, 0, sizeof(op));
+    op.mode = HWSIM_OP_LIST;
+    clear_radio_index(index);
+    while ((ret = submit_request_with_replies(engine, &op, radio_dump_reply, radio_dump_done, &dump)) == -EBUSY) {
+        if (engine->event_running) {
+            wait_for_slot(engine);
+        } else if (receive_replies(engine)) {
+            return -EIO;
+        }
+    }
+    if (ret) {
+        return -EIO;
+    }
+    if (engine->event_running) {
+        wait_until(engine, &dump.done);
+    } else {
+        while (!dump.done) {
+            if (receive_replies(engine)) {
+                return -EIO;
+            }
+            check_deadlines(engine);
+        }
+    }
+    return dump.error;
+}
+
+void print_list_error(FILE *out, int error) {
+    fprintf(out, "Error listing radios with errid %d\nstrerror: %s\n", error, strerror(abs(error)));
+}
+
+static int compare_radio_id(const void *a, const void *b) {
+    const hwsim_radio *ra = *(const hwsim_radio *const *) a;
+    const hwsim_radio *rb = *(const hwsim_radio *const *) b;
+    return ra->id < rb->id ? -1 : ra->id > rb->id;
+}
+
+void print_json_string(FILE *out, const char *str) {
+    fputc('"', out);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\') {
+            fprintf(out, "\\%c", *str);
+        } else if ((unsigned char) *str < 0x20) {
+            fprintf(out, "\\u%04x", (unsigned char) *str);
+        } else {
+            fputc(*str, out);
+        }
+    }
+    fputc('"', out);
+}
+
+void print_radio_json(const hwsim_radio *radio, FILE *out) {
+    fprintf(out, "{\"id\":%u,\"name\":", radio->id);
+    print_json_string(out, radio->name);
+    fprintf(out, ",\"channels\":%u,\"use_chanctx\":%s,\"reg_alpha2\":", radio->channels,
+            radio->use_chanctx ? "true" : "false");
+    if (radio->reg_alpha2[0]) {
+        print_json_string(out, radio->reg_alpha2);
+    } else {
+        fprintf(out, "null");
+    }
+    fprintf(out, ",\"reg_custom_reg\":%u,\"reg_strict\":%s,\"p2p_device\":%s,\"destroy_on_close\":%s}",
+            radio->reg_custom_reg, radio->reg_strict ? "true" : "false",
+            radio->p2p_device ? "true" : "false", radio->destroy_on_close ? "true" : "false");
+}
+
+void print_radios(const radio_index *index, FILE *out, bool json) {
+    const hwsim_radio **sorted = malloc((index->count ? index->count : 1) * sizeof(hwsim_radio *));
+    size_t i;
+
+    if (!sorted) {
+        return;
+    }
+    for (i = 0; i < index->count; i++) {
+        sorted[i] = &index->radios[i];
+    }
+    qsort(sorted, index->count, sizeof(hwsim_radio *), compare_radio_id);
+
+    if (json) {
+        fprintf(out, "[");
+    } else {
+        fprintf(out, "%-6s %-20s %-8s %-7s %-6s %-9s %s\n", "ID", "NAME", "CHANNELS", "CHANCTX", "ALPHA2",
+                "CUSTOMREG", "FLAGS");
+    }
+    for (i = 0; i < index->count; i++) {
+        const hwsim_radio *radio = sorted[i];
+        if (json) {
+            if (i) {
+                fputc(',', out);
+            }
+            print_radio_json(radio, out);
+        } else {
+            fprintf(out, "%-6u %-20s %-8u %-7s %-6s %-9u %s%s%s\n", radio->id, radio->name, radio->channels,
+                    radio->use_chanctx ? "yes" : "no", radio->reg_alpha2[0] ? radio->reg_alpha2 : "-",
+                    radio->reg_custom_reg, radio->reg_strict ? "strict " : "", radio->p2p_device ? "p2p " : "",
+                    radio->destroy_on_close ? "destroy-on-close" : "");
+        }
+    }
+    if (json) {
+        fprintf(out, "]\n");
+    }
+    free(sorted);
+}
@@ -0,0 +1,97 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_RADIO_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_RADIO_H
+
+#include <stdio.h>
+#include "hwsim_mgmt_event.h"
+
+#define HWSIM_RADIO_NAME_MAX 64
+
+typedef struct {
+    uint32_t id;
+    char name[HWSIM_RADIO_NAME_MAX];
+    uint32_t channels;
+    bool use_chanctx;
+    bool p2p_device;
+    bool destroy_on_close;
+    bool reg_strict;
+    char reg_alpha2[3];
+    uint32_t reg_custom_reg;
+} hwsim_radio;
+
+/*
+ * Radios indexed by id (dense table) and by name (open addressing hash).
+ * Not synchronized: callers that share an index between threads lock it.
+ */
+typedef struct {
+    hwsim_radio *radios;
+    size_t count;
+    size_t cap;
+    int32_t *by_id;
+    size_t id_cap;
+    int32_t *by_name;
+    size_t name_cap;
+} radio_index;
+
+void init_radio_index(radio_index *index);
+
+void free_radio_index(radio_index *index);
+
+void clear_radio_index(radio_index *index);
+
+/*
+ * Inserts radio or replaces the entry with the same id.
+ */
+int put_radio(radio_index *index, const hwsim_radio *radio);
+
+void remove_radio(radio_index *index, uint32_t id);
+
+const hwsim_radio *find_radio_by_id(const radio_index *index, uint32_t id);
+
+const hwsim_radio *find_radio_by_name(const radio_index *index, const char *name);
+
+/*
+ * FNV-1a hash of a radio name.
+ */
+uint32_t radio_name_hash(const char *name);
+
+/*
+ * mac80211_hwsim derives a radio's addresses from its id: 02:00:00:hi:lo:00
+ * is the first interface's address and the same with 0x42 in the first
+ * byte identifies the radio in HWSIM_ATTR_ADDR_TRANSMITTER/_RECEIVER.
+ */
+void radio_hwaddr(uint32_t id, uint8_t addr[6]);
+
+/*
+ * Returns the radio id of either address or -1 if addr is none of them.
+ */
+int radio_id_from_hwaddr(const uint8_t *addr);
+
+/*
+ * Parses one HWSIM_CMD_GET_RADIO reply.
+ */
+int parse_radio(struct nl_msg *msg, hwsim_radio *radio);
+
+/*
+ * Replaces the contents of index with a HWSIM_CMD_GET_RADIO dump. Waits
+ * for the event thread if one runs, otherwise receives in the calling
+ * thread. Returns 0 or a negative errno value.
+ */
+int load_radio_index(hwsim_engine *engine, radio_index *index);
+
+/*
+ * Reports error, as returned by load_radio_index(), on out.
+ */
+void print_list_error(FILE *out, int error);
+
+void print_json_string(FILE *out, const char *str);
+
+void print_radio_json(const hwsim_radio *radio, FILE *out);
+
+void print_radios(const radio_index *index, FILE *out, bool json);
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_RADIO_H
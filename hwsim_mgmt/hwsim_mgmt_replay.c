@@ -0,0 +1,263 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hwsim_mgmt_replay.h"
+
+#define REPLAY_WINDOW (64u << 20)
+#define REPLAY_BLOCK 64
+#define REPLAY_REPORT_MS 1000
+
+typedef struct {
+    hwsim_engine *engine;
+    int fd;
+    uint64_t file_size;
+    // mapped window of the file
+    uint8_t *map;
+    uint64_t map_offset;
+    size_t map_len;
+    uint32_t *radio_ids;
+    uint32_t radio_count;
+    uint8_t value_size;
+    size_t frame_size;
+    uint8_t *prev;
+    // written by the event thread
+    unsigned long acked;
+    unsigned long failed;
+    // written by the replaying thread
+    unsigned long frames;
+    unsigned long changed;
+    unsigned long sent;
+    unsigned long dropped;
+    unsigned long late;
+} rssi_replay;
+
+static void sleep_until_us(uint64_t due) {
+    struct timespec ts = {(time_t) (due / 1000000), (long) (due % 1000000) * 1000};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+static void replay_request_done(const hwsim_request *req, void *arg) {
+    rssi_replay *replay = arg;
+    if (req->error < 0) {
+        __atomic_fetch_add(&replay->failed, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&replay->acked, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static int read_header(rssi_replay *replay, uint64_t *frame_count, uint32_t *timestep_us) {
+    hwsim_replay_header header;
+    uint64_t data_offset, available;
+    uint32_t i;
+
+    if (pread(replay->fd, &header, sizeof(header), 0) != sizeof(header)
+        || memcmp(header.magic, HWSIM_REPLAY_MAGIC, sizeof(header.magic)) != 0) {
+        fprintf(stderr, "Not an RSSI matrix file\n");
+        return -1;
+    }
+    replay->radio_count = le32toh(header.radio_count);
+    replay->value_size = header.value_size;
+    if ((replay->value_size != 1 && replay->value_size != 2) || !replay->radio_count) {
+        fprintf(stderr, "Unsupported RSSI matrix: %u radios, %u byte values\n", replay->radio_count,
+                replay->value_size);
+        return -1;
+    }
+    replay->frame_size = (size_t) replay->radio_count * replay->value_size;
+    data_offset = sizeof(header) + (uint64_t) replay->radio_count * sizeof(uint32_t);
+    if (replay->file_size < data_offset) {
+        fprintf(stderr, "RSSI matrix is truncated in the radio id table\n");
+        return -1;
+    }
+    replay->radio_ids = malloc(replay->radio_count * sizeof(uint32_t));
+    replay->prev = malloc(replay->frame_size);
+    if (!replay->radio_ids || !replay->prev) {
+        return -1;
+    }
+    if (pread(replay->fd, replay->radio_ids, replay->radio_count * sizeof(uint32_t), sizeof(header))
+        != (ssize_t) (replay->radio_count * sizeof(uint32_t))) {
+        fprintf(stderr, "Error reading radio id table: %s\n", strerror(errno));
+        return -1;
+    }
+    for (i = 0; i < replay->radio_count; i++) {
+        replay->radio_ids[i] = le32toh(replay->radio_ids[i]);
+    }
+    available = (replay->file_size - data_offset) / replay->frame_size;
+    *frame_count = le32toh(header.frame_count);
+    if (!*frame_count) {
+        *frame_count = available;
+    } else if (*frame_count > available) {
+        fprintf(stderr, "RSSI matrix is truncated, playing %lu of %lu frames\n", (unsigned long) available,
+                (unsigned long) *frame_count);
+        *frame_count = available;
+    }
+    *timestep_us = le32toh(header.timestep_us);
+    return 0;
+}
+
+/*
+ * Returns the frame at offset, moving the mapped window forward when the
+ * frame is not completely inside it. Dropping the old window releases the
+ * pages that were already played.
+ */
+static const uint8_t *map_frame(rssi_replay *replay, uint64_t offset) {
+    uint64_t page_size = (uint64_t) sysconf(_SC_PAGESIZE);
+    uint64_t start;
+
+    if (replay->map && offset >= replay->map_offset
+        && offset + replay->frame_size <= replay->map_offset + replay->map_len) {
+        return replay->map + (offset - replay->map_offset);
+    }
+    if (replay->map) {
+        munmap(replay->map, replay->map_len);
+        replay->map = NULL;
+    }
+    start = offset - offset % page_size;
+    replay->map_len = REPLAY_WINDOW;
+    if (replay->map_len < offset - start + replay->frame_size) {
+        replay->map_len = offset - start + replay->frame_size;
+    }
+    if (replay->map_len > replay->file_size - start) {
+        replay->map_len = replay->file_size - start;
+    }
+    replay->map = mmap(NULL, replay->map_len, PROT_READ, MAP_PRIVATE, replay->fd, (off_t) start);
+    if (replay->map == MAP_FAILED) {
+        replay->map = NULL;
+        fprintf(stderr, "Error mapping RSSI matrix: %s\n", strerror(errno));
+        return NULL;
+    }
+    madvise(replay->map, replay->map_len, MADV_SEQUENTIAL);
+    replay->map_offset = start;
+    return replay->map + (offset - start);
+}
+
+static void send_value(rssi_replay *replay, const uint8_t *frame, size_t pos) {
+    hwsim_args op;
+    int32_t rssi;
+
+    if (replay->value_size == 1) {
+        rssi = (int8_t) frame[pos];
+    } else {
+        uint16_t raw;
+        memcpy(&raw, frame + pos, sizeof(raw));
+        rssi = (int16_t) le16toh(raw);
+    }
+    memset(&op, 0, sizeof(op));
+    op.mode = HWSIM_OP_SET_RSSI;
+    op.rssi_radio = replay->radio_ids[pos / replay->value_size];
+    op.rssi_dbm = rssi;
+    replay->changed++;
+    if (submit_request_wait(replay->engine, &op, replay_request_done, replay)) {
+        replay->dropped++;
+    } else {
+        replay->sent++;
+    }
+}
+
+/*
+ * Sends the values of frame that differ from the previous one. Unchanged
+ * blocks are skipped with memcmp(), which libc implements with the widest
+ * vector compare of the machine, so only blocks with changes are walked
+ * value by value.
+ */
+static void play_frame(rssi_replay *replay, const uint8_t *frame, bool full) {
+    size_t block, pos;
+
+    for (block = 0; block < replay->frame_size; block += REPLAY_BLOCK) {
+        size_t end = block + REPLAY_BLOCK < replay->frame_size ? block + REPLAY_BLOCK : replay->frame_size;
+        if (!full && memcmp(frame + block, replay->prev + block, end - block) == 0) {
+            continue;
+        }
+        for (pos = block; pos < end; pos += replay->value_size) {
+            if (full || memcmp(frame + pos, replay->prev + pos, replay->value_size) != 0) {
+                send_value(replay, frame, pos);
+            }
+        }
+    }
+    memcpy(replay->prev, frame, replay->frame_size);
+    replay->frames++;
+}
+
+static void report(rssi_replay *replay, FILE *out, const char *prefix, uint64_t elapsed_us) {
+    double secs = elapsed_us ? elapsed_us / 1000000.0 : 1.0;
+    unsigned long acked = __atomic_load_n(&replay->acked, __ATOMIC_RELAXED);
+    unsigned long failed = __atomic_load_n(&replay->failed, __ATOMIC_RELAXED);
+    fprintf(out, "%s%lu frames (%.0f/s), %lu changed, %lu sent (%.0f/s), %lu acked (%.0f/s), %lu dropped, "
+                 "%lu failed, %lu late\n", prefix,
+            replay->frames, replay->frames / secs, replay->changed, replay->sent, replay->sent / secs, acked,
+            acked / secs, replay->dropped, failed, replay->late);
+}
+
+static int play_file(rssi_replay *replay) {
+    uint64_t frame_count, frame, offset, start, last_report;
+    uint32_t timestep_us;
+
+    if (read_header(replay, &frame_count, &timestep_us)) {
+        return EXIT_FAILURE;
+    }
+    offset = sizeof(hwsim_replay_header) + (uint64_t) replay->radio_count * sizeof(uint32_t);
+    start = last_report = monotonic_ns() / 1000;
+    for (frame = 0; frame < frame_count; frame++, offset += replay->frame_size) {
+        const uint8_t *data = map_frame(replay, offset);
+        if (!data) {
+            break;
+        }
+        if (timestep_us) {
+            uint64_t due = start + frame * timestep_us;
+            uint64_t now = monotonic_ns() / 1000;
+            if (now < due) {
+                sleep_until_us(due);
+            } else if (now - due >= timestep_us) {
+                replay->late++;
+            }
+        }
+        play_frame(replay, data, frame == 0);
+        uint64_t now = monotonic_ns() / 1000;
+        if (now - last_report >= REPLAY_REPORT_MS * 1000) {
+            report(replay, stderr, "replay: ", now - start);
+            last_report = now;
+        }
+    }
+    wait_for_event(replay->engine);
+    report(replay, stdout, "", monotonic_ns() / 1000 - start);
+    return frame == frame_count && !replay->failed && !replay->dropped ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int run_rssi_replay(hwsim_engine *engine, const char *path) {
+    rssi_replay replay;
+    struct stat st;
+    int ret;
+
+    memset(&replay, 0, sizeof(replay));
+    replay.engine = engine;
+    replay.fd = open(path, O_RDONLY);
+    if (replay.fd < 0) {
+        fprintf(stderr, "Cannot open RSSI matrix '%s': %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (fstat(replay.fd, &st) < 0) {
+        fprintf(stderr, "Cannot stat RSSI matrix '%s': %s\n", path, strerror(errno));
+        close(replay.fd);
+        return EXIT_FAILURE;
+    }
+    replay.file_size = (uint64_t) st.st_size;
+    ret = play_file(&replay);
+    if (replay.map) {
+        munmap(replay.map, replay.map_len);
+    }
+    free(replay.radio_ids);
+    free(replay.prev);
+    close(replay.fd);
+    return ret;
+}
@@ -0,0 +1,38 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_REPLAY_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_REPLAY_H
+
+#include "hwsim_mgmt_event.h"
+
+#define HWSIM_REPLAY_MAGIC "HWRSSI01"
+
+/*
+ * Header of an RSSI matrix file, all fields little endian. It is followed
+ * by radio_count uint32 radio ids and then by frames of radio_count signed
+ * RSSI values (dBm) of value_size bytes each, in radio id table order. One
+ * frame is played every timestep_us (0 = as fast as possible); frame_count
+ * 0 plays every complete frame up to the end of the file.
+ */
+typedef struct {
+    char magic[8];
+    uint8_t value_size;
+    uint8_t reserved[3];
+    uint32_t radio_count;
+    uint32_t timestep_us;
+    uint32_t frame_count;
+} hwsim_replay_header;
+
+/*
+ * Plays the RSSI matrix in the file at path. The first frame is sent
+ * completely, later frames only send the values that differ from the frame
+ * before. The file is mapped in windows of bounded size, so traces of any
+ * length are replayed in constant memory. Rates are reported on stderr
+ * every second and as a summary on stdout at the end.
+ */
+int run_rssi_replay(hwsim_engine *engine, const char *path);
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_REPLAY_H
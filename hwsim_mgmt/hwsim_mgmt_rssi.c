@@ -0,0 +1,248 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hwsim_mgmt_rssi.h"
+
+#define RSSI_READ_BUF 65536
+#define RSSI_REPORT_MS 1000
+// mac80211_hwsim hands out ids from 0 up; larger ones are dropped instead of sizing the table for them
+#define RSSI_MAX_RADIO_ID (1u << 20)
+
+typedef struct {
+    int32_t rssi;
+    bool dirty;
+} rssi_slot;
+
+typedef struct {
+    hwsim_engine *engine;
+    uint32_t tick_ms;
+    uint64_t tick;
+    bool have_tick;
+    rssi_slot *slots;
+    uint32_t slot_count;
+    uint32_t *dirty;
+    uint32_t dirty_count;
+    // written by the event thread
+    unsigned long acked;
+    unsigned long failed;
+    // written by the reading thread
+    unsigned long received;
+    unsigned long coalesced;
+    unsigned long dropped;
+    unsigned long sent;
+    unsigned long flushes;
+} rssi_stream;
+
+static void rssi_request_done(const hwsim_request *req, void *arg) {
+    rssi_stream *stream = arg;
+    if (req->error < 0) {
+        __atomic_fetch_add(&stream->failed, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&stream->acked, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static int grow_slots(rssi_stream *stream, uint32_t radio_id) {
+    uint32_t count = stream->slot_count ? stream->slot_count : 64;
+    if (radio_id >= RSSI_MAX_RADIO_ID) {
+        return -1;
+    }
+    while (count <= radio_id) {
+        count *= 2;
+    }
+    rssi_slot *slots = realloc(stream->slots, count * sizeof(rssi_slot));
+    uint32_t *dirty = realloc(stream->dirty, count * sizeof(uint32_t));
+    if (slots) {
+        stream->slots = slots;
+    }
+    if (dirty) {
+        stream->dirty = dirty;
+    }
+    if (!slots || !dirty) {
+        return -1;
+    }
+    memset(&stream->slots[stream->slot_count], 0, (count - stream->slot_count) * sizeof(rssi_slot));
+    stream->slot_count = count;
+    return 0;
+}
+
+static void flush_tick(rssi_stream *stream) {
+    hwsim_args op;
+    uint32_t i;
+
+    memset(&op, 0, sizeof(op));
+    op.mode = HWSIM_OP_SET_RSSI;
+    for (i = 0; i < stream->dirty_count; i++) {
+        rssi_slot *slot = &stream->slots[stream->dirty[i]];
+        op.rssi_radio = stream->dirty[i];
+        op.rssi_dbm = slot->rssi;
+        slot->dirty = false;
+        if (submit_request_wait(stream->engine, &op, rssi_request_done, stream)) {
+            stream->dropped++;
+        } else {
+            stream->sent++;
+        }
+    }
+    if (stream->dirty_count) {
+        stream->flushes++;
+    }
+    stream->dirty_count = 0;
+}
+
+static void add_update(rssi_stream *stream, uint64_t timestamp, uint32_t radio_id, int32_t rssi) {
+    uint64_t tick = timestamp / stream->tick_ms;
+    stream->received++;
+    if (stream->have_tick && tick < stream->tick) {
+        stream->dropped++;
+        return;
+    }
+    if (!stream->have_tick || tick > stream->tick) {
+        flush_tick(stream);
+        stream->tick = tick;
+        stream->have_tick = true;
+    }
+    if (radio_id >= stream->slot_count && grow_slots(stream, radio_id)) {
+        stream->dropped++;
+        return;
+    }
+    rssi_slot *slot = &stream->slots[radio_id];
+    if (slot->dirty) {
+        stream->coalesced++;
+    } else {
+        slot->dirty = true;
+        stream->dirty[stream->dirty_count++] = radio_id;
+    }
+    slot->rssi = rssi;
+}
+
+static int parse_update(rssi_stream *stream, char *line) {
+    char *endptr;
+    unsigned long long timestamp;
+    unsigned long radio_id;
+    long rssi;
+
+    while (*line == ' ' || *line == '\t') {
+        line++;
+    }
+    if (!*line || *line == '#' || *line == '\r') {
+        return 0;
+    }
+    errno = 0;
+    timestamp = strtoull(line, &endptr, 10);
+    if (endptr == line) {
+        return -1;
+    }
+    line = endptr;
+    radio_id = strtoul(line, &endptr, 10);
+    if (endptr == line || radio_id > UINT32_MAX) {
+        return -1;
+    }
+    line = endptr;
+    rssi = strtol(line, &endptr, 10);
+    if (endptr == line || rssi < HWSIM_RSSI_MIN || rssi > -HWSIM_RSSI_MIN || errno == ERANGE) {
+        return -1;
+    }
+    while (*endptr == ' ' || *endptr == '\t') {
+        endptr++;
+    }
+    if (*endptr && *endptr != '#' && *endptr != '\r') {
+        return -1;
+    }
+    // positive values are attenuations like for -k
+    add_update(stream, timestamp, (uint32_t) radio_id, (int32_t) (rssi > 0 ? -rssi : rssi));
+    return 0;
+}
+
+static void report(rssi_stream *stream, FILE *out, const char *prefix, uint64_t elapsed_ms) {
+    double secs = elapsed_ms ? elapsed_ms / 1000.0 : 1.0;
+    unsigned long acked = __atomic_load_n(&stream->acked, __ATOMIC_RELAXED);
+    unsigned long failed = __atomic_load_n(&stream->failed, __ATOMIC_RELAXED);
+    fprintf(out, "%s%lu received (%.0f/s), %lu sent (%.0f/s), %lu acked (%.0f/s), %lu coalesced, %lu dropped, "
+                 "%lu failed, %lu ticks\n", prefix,
+            stream->received, stream->received / secs, stream->sent, stream->sent / secs, acked, acked / secs,
+            stream->coalesced, stream->dropped, failed, stream->flushes);
+}
+
+int run_rssi_stream(hwsim_engine *engine, int fd, uint32_t tick_ms) {
+    rssi_stream stream;
+    struct pollfd pfd = {fd, POLLIN, 0};
+    char *buf = malloc(RSSI_READ_BUF + 1);
+    size_t fill = 0;
+    uint64_t start = monotonic_ns() / 1000000;
+    uint64_t last_report = start;
+    bool eof = false;
+
+    if (!buf) {
+        return EXIT_FAILURE;
+    }
+    memset(&stream, 0, sizeof(stream));
+    stream.engine = engine;
+    stream.tick_ms = tick_ms ? tick_ms : HWSIM_DEFAULT_TICK_MS;
+
+    while (!eof) {
+        int ret = poll(&pfd, 1, (int) stream.tick_ms);
+        if (ret < 0 && errno != EINTR) {
+            fprintf(stderr, "Error polling RSSI stream: %s\n", strerror(errno));
+            break;
+        }
+        if (ret == 0) {
+            // input idle for a whole tick: do not hold back the pending values
+            flush_tick(&stream);
+        } else if (ret > 0) {
+            ssize_t len = read(fd, buf + fill, RSSI_READ_BUF - fill);
+            if (len <= 0) {
+                if (len < 0 && (errno == EINTR || errno == EAGAIN)) {
+                    continue;
+                }
+                eof = true;
+                len = 0;
+                if (fill) {
+                    // terminate a trailing line without newline
+                    buf[fill++] = '\n';
+                }
+            }
+            fill += len;
+            char *line = buf;
+            char *nl;
+            while ((nl = memchr(line, '\n', fill - (line - buf)))) {
+                *nl = '\0';
+                if (parse_update(&stream, line)) {
+                    stream.received++;
+                    stream.dropped++;
+                }
+                line = nl + 1;
+            }
+            fill -= line - buf;
+            if (fill == RSSI_READ_BUF) {
+                // overlong line
+                stream.received++;
+                stream.dropped++;
+                fill = 0;
+            }
+            memmove(buf, line, fill);
+        }
+        uint64_t now = monotonic_ns() / 1000000;
+        if (now - last_report >= RSSI_REPORT_MS) {
+            report(&stream, stderr, "rssi: ", now - start);
+            last_report = now;
+        }
+    }
+    flush_tick(&stream);
+    wait_for_event(engine);
+    report(&stream, stdout, "", monotonic_ns() / 1000000 - start);
+
+    free(buf);
+    free(stream.slots);
+    free(stream.dirty);
+    return stream.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,23 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_RSSI_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_RSSI_H
+
+#include "hwsim_mgmt_event.h"
+
+#define HWSIM_DEFAULT_TICK_MS 10
+
+/*
+ * Streams RSSI updates read from fd, one "<timestamp ms> <radio id> <rssi>"
+ * per line. Updates of the same radio within one tick of tick_ms are
+ * coalesced (the last one wins); when a later tick starts or the input is
+ * idle for a tick, the surviving values are sent back to back. Updates with
+ * a timestamp before the current tick are dropped. Rates are reported on
+ * stderr every second and as a summary on stdout at the end of input.
+ */
+int run_rssi_stream(hwsim_engine *engine, int fd, uint32_t tick_ms);
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_RSSI_H
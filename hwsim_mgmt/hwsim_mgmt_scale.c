@@ -0,0 +1,400 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "hwsim_mgmt_scale.h"
+#include "hwsim_mgmt_radio.h"
+
+#define SCALE_DEFAULT_ROWS 20
+#define SCALE_PROC_LINE 256
+
+typedef struct {
+    uint64_t latency_ns;
+    // radios that existed when the create was sent
+    uint32_t population;
+    int radio_id;
+    int error;
+} scale_op;
+
+typedef struct {
+    uint64_t wall_ns;
+    uint64_t user_us;
+    uint64_t sys_us;
+    long rss_kb;
+    long slab_kb;
+} scale_sample;
+
+typedef struct {
+    unsigned long samples;
+    double base_us;
+    double us_per_radio;
+    double r2;
+    double exponent;
+} scale_fit;
+
+typedef struct {
+    // written by the event threads
+    unsigned long deleted;
+    unsigned long failed;
+} scale_teardown;
+
+static volatile sig_atomic_t scale_stop;
+
+static void stop_cb(int sig) {
+    UNUSED(sig);
+    scale_stop = 1;
+}
+
+static long read_rss_kb() {
+    FILE *f = fopen("/proc/self/statm", "r");
+    unsigned long size, resident;
+    long kb = -1;
+    if (!f) {
+        return -1;
+    }
+    if (fscanf(f, "%lu %lu", &size, &resident) == 2) {
+        kb = (long) resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+    fclose(f);
+    return kb;
+}
+
+// kernel memory of all slab caches, where wiphys, netdevs and their queues are allocated
+static long read_slab_kb() {
+    char line[SCALE_PROC_LINE];
+    long kb = -1;
+    FILE *f = fopen("/proc/meminfo", "r");
+    if (!f) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "Slab: %ld kB", &kb) == 1) {
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+static void take_sample(scale_sample *sample, bool kernel) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    sample->wall_ns = monotonic_ns();
+    sample->user_us = (uint64_t) usage.ru_utime.tv_sec * 1000000 + (uint64_t) usage.ru_utime.tv_usec;
+    sample->sys_us = (uint64_t) usage.ru_stime.tv_sec * 1000000 + (uint64_t) usage.ru_stime.tv_usec;
+    sample->rss_kb = read_rss_kb();
+    sample->slab_kb = kernel ? read_slab_kb() : -1;
+}
+
+static void scale_request_done(const hwsim_request *req, void *arg) {
+    scale_op *op = arg;
+    op->latency_ns = timespec_diff_ns(&req->submitted, &req->replied);
+    op->radio_id = req->radio_id;
+    op->error = req->error;
+}
+
+static int compare_latency(const void *a, const void *b) {
+    uint64_t la = *(const uint64_t *) a;
+    uint64_t lb = *(const uint64_t *) b;
+    return (la > lb) - (la < lb);
+}
+
+static double percentile_us(const uint64_t *sorted, size_t count, double fraction) {
+    size_t rank = (size_t) (count * fraction);
+    return count ? sorted[rank < count ? rank : count - 1] / 1e3 : 0.0;
+}
+
+static void print_header(bool kernel, bool json) {
+    if (!json) {
+        printf("radios,creates,failed,avg_us,p50_us,p99_us,max_us,creates_s,rss_kb,user_us,sys_us%s\n",
+               kernel ? ",slab_kb" : "");
+    }
+}
+
+/*
+ * Prints the row of the creates ops[0..count), which ran between the
+ * samples from and to. CPU times are per create.
+ */
+static void print_row(const scale_op *ops, uint32_t count, uint32_t radios, uint64_t *scratch,
+                      const scale_sample *from, const scale_sample *to, bool json) {
+    uint64_t sum_ns = 0;
+    size_t ok = 0;
+    uint32_t i;
+    double avg_us, rate, user_us, sys_us;
+
+    for (i = 0; i < count; i++) {
+        if (ops[i].error >= 0) {
+            scratch[ok++] = ops[i].latency_ns;
+            sum_ns += ops[i].latency_ns;
+        }
+    }
+    qsort(scratch, ok, sizeof(uint64_t), compare_latency);
+    avg_us = ok ? sum_ns / 1e3 / ok : 0.0;
+    rate = to->wall_ns > from->wall_ns ? count * 1e9 / (to->wall_ns - from->wall_ns) : 0.0;
+    user_us = (double) (to->user_us - from->user_us) / count;
+    sys_us = (double) (to->sys_us - from->sys_us) / count;
+    if (json) {
+        printf("{\"radios\":%u,\"creates\":%u,\"failed\":%lu,\"avg_us\":%.1f,\"p50_us\":%.1f,\"p99_us\":%.1f,"
+               "\"max_us\":%.1f,\"creates_s\":%.1f,\"rss_kb\":%ld,\"user_us\":%.1f,\"sys_us\":%.1f", radios,
+               count, (unsigned long) (count - ok), avg_us, percentile_us(scratch, ok, 0.5),
+               percentile_us(scratch, ok, 0.99), percentile_us(scratch, ok, 1.0), rate, to->rss_kb, user_us,
+               sys_us);
+        if (to->slab_kb >= 0) {
+            printf(",\"slab_kb\":%ld", to->slab_kb);
+        }
+        printf("}\n");
+    } else {
+        printf("%u,%u,%lu,%.1f,%.1f,%.1f,%.1f,%.1f,%ld,%.1f,%.1f", radios, count, (unsigned long) (count - ok),
+               avg_us, percentile_us(scratch, ok, 0.5), percentile_us(scratch, ok, 0.99),
+               percentile_us(scratch, ok, 1.0), rate, to->rss_kb, user_us, sys_us);
+        if (to->slab_kb >= 0) {
+            printf(",%ld", to->slab_kb);
+        }
+        printf("\n");
+    }
+    fflush(stdout);
+}
+
+/*
+ * Least squares fits of the latency of the successful creates against
+ * the population: linear (base + slope * radios) and on log-log scale,
+ * whose slope is the exponent k of latency ~ radios^k. Returns -1 if
+ * the population did not vary.
+ */
+static int fit_curve(const scale_op *ops, uint32_t count, scale_fit *fit) {
+    double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+    double ln = 0, lsx = 0, lsy = 0, lsxx = 0, lsxy = 0;
+    double ss_res = 0, ss_tot = 0, mean;
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        double x = ops[i].population, y = ops[i].latency_ns / 1e3;
+        if (ops[i].error < 0) {
+            continue;
+        }
+        n++;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+        if (y > 0) {
+            // radios + 1, the first create runs with no radio
+            double lx = log(x + 1), ly = log(y);
+            ln++;
+            lsx += lx;
+            lsy += ly;
+            lsxx += lx * lx;
+            lsxy += lx * ly;
+        }
+    }
+    if (n < 2 || n * sxx - sx * sx <= 0) {
+        return -1;
+    }
+    fit->samples = (unsigned long) n;
+    fit->us_per_radio = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+    fit->base_us = (sy - fit->us_per_radio * sx) / n;
+    fit->exponent = ln >= 2 && ln * lsxx - lsx * lsx > 0 ? (ln * lsxy - lsx * lsy) / (ln * lsxx - lsx * lsx) : 0.0;
+    mean = sy / n;
+    for (i = 0; i < count; i++) {
+        double y = ops[i].latency_ns / 1e3;
+        double e = y - (fit->base_us + fit->us_per_radio * ops[i].population);
+        if (ops[i].error < 0) {
+            continue;
+        }
+        ss_res += e * e;
+        ss_tot += (y - mean) * (y - mean);
+    }
+    fit->r2 = ss_tot > 0 ? 1 - ss_res / ss_tot : 1.0;
+    return 0;
+}
+
+static void report_fit(const scale_op *ops, uint32_t count, uint32_t radios, const scale_sample *first,
+                       const scale_sample *last, bool json) {
+    FILE *out = json ? stdout : stderr;
+    uint32_t created = 0, i;
+    double rss_kb, slab_kb;
+    scale_fit fit;
+
+    for (i = 0; i < count; i++) {
+        created += ops[i].error >= 0;
+    }
+    if (fit_curve(ops, count, &fit)) {
+        fprintf(stderr, "fit: not enough successful creates\n");
+        return;
+    }
+    rss_kb = (double) (last->rss_kb - first->rss_kb) / created;
+    slab_kb = (double) (last->slab_kb - first->slab_kb) / created;
+    if (json) {
+        fprintf(out, "{\"fit\":{\"samples\":%lu,\"base_us\":%.1f,\"us_per_radio\":%.4f,\"r2\":%.3f,"
+                     "\"exponent\":%.3f,\"predicted_us\":%.1f,\"radios\":%u,\"rss_kb_per_radio\":%.2f", fit.samples,
+                fit.base_us, fit.us_per_radio, fit.r2, fit.exponent, fit.base_us + fit.us_per_radio * radios,
+                radios, rss_kb);
+        if (last->slab_kb >= 0 && first->slab_kb >= 0) {
+            fprintf(out, ",\"slab_kb_per_radio\":%.2f", slab_kb);
+        }
+        fprintf(out, "}}\n");
+    } else {
+        fprintf(out, "fit: latency = %.1f us %+.4f us per radio (r2 %.3f), grows like radios^%.2f, "
+                     "%.1f us at %u radios\n", fit.base_us, fit.us_per_radio, fit.r2, fit.exponent,
+                fit.base_us + fit.us_per_radio * radios, radios);
+        fprintf(out, "memory: %.2f kB RSS", rss_kb);
+        if (last->slab_kb >= 0 && first->slab_kb >= 0) {
+            fprintf(out, ", %.2f kB kernel slab", slab_kb);
+        }
+        fprintf(out, " per radio\n");
+    }
+}
+
+static void teardown_request_done(const hwsim_request *req, void *arg) {
+    scale_teardown *td = arg;
+    if (req->error < 0) {
+        __atomic_fetch_add(&td->failed, 1, __ATOMIC_RELAXED);
+        fprintf(stderr, "Error deleting radio %d: %s\n", req->target_id, strerror(-req->error));
+    } else {
+        __atomic_fetch_add(&td->deleted, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+ * Deletes the created radios pipelined over all sockets. Returns the
+ * number of radios that could not be deleted.
+ */
+static unsigned long delete_created(hwsim_pool *pool, const scale_op *ops, uint32_t count,
+                                    const scale_sample *first, bool kernel, bool json) {
+    FILE *out = json ? stdout : stderr;
+    scale_teardown td = {0, 0};
+    scale_sample start, end;
+    hwsim_args op;
+    uint64_t elapsed_ns;
+    uint32_t i;
+
+    memset(&op, 0, sizeof(op));
+    op.mode = HWSIM_OP_DELETE_BY_ID;
+    take_sample(&start, false);
+    for (i = 0; i < count; i++) {
+        if (ops[i].error < 0) {
+            continue;
+        }
+        op.del_radio_id = (uint32_t) ops[i].radio_id;
+        if (submit_request_wait(pool_engine(pool, &op), &op, teardown_request_done, &td)) {
+            td.failed++;
+        }
+    }
+    wait_for_pool(pool);
+    take_sample(&end, kernel);
+    elapsed_ns = end.wall_ns - start.wall_ns;
+    if (json) {
+        fprintf(out, "{\"teardown\":{\"deleted\":%lu,\"failed\":%lu,\"elapsed_ms\":%.1f,\"deletes_s\":%.1f",
+                td.deleted, td.failed, elapsed_ns / 1e6, elapsed_ns ? td.deleted * 1e9 / elapsed_ns : 0.0);
+        if (end.slab_kb >= 0 && first->slab_kb >= 0) {
+            fprintf(out, ",\"slab_kb_left\":%ld", end.slab_kb - first->slab_kb);
+        }
+        fprintf(out, "}}\n");
+    } else {
+        fprintf(out, "teardown: %lu deleted, %lu failed in %.1f ms (%.0f/s)", td.deleted, td.failed,
+                elapsed_ns / 1e6, elapsed_ns ? td.deleted * 1e9 / elapsed_ns : 0.0);
+        if (end.slab_kb >= 0 && first->slab_kb >= 0) {
+            // slab memory the kernel did not give back, includes unrelated allocations
+            fprintf(out, ", %+ld kB kernel slab since start", end.slab_kb - first->slab_kb);
+        }
+        fprintf(out, "\n");
+    }
+    return td.failed;
+}
+
+int run_scale(hwsim_pool *pool, const hwsim_args *args) {
+    uint32_t radios = args->scale_radios;
+    uint32_t step = args->scale_step ? args->scale_step : radios / SCALE_DEFAULT_ROWS;
+    uint32_t inflight = args->scale_inflight ? args->scale_inflight : 1;
+    scale_op *ops = calloc(radios, sizeof(scale_op));
+    uint64_t *scratch = malloc(radios * sizeof(uint64_t));
+    scale_sample first, row_start, now;
+    uint32_t existing, created = 0, failed = 0, row_first = 0, sent = 0, round, i;
+    unsigned long undeleted;
+    radio_index index;
+    struct sigaction sa;
+    hwsim_args op;
+    int ret;
+
+    if (radios == 0 || !ops || !scratch) {
+        free(ops);
+        free(scratch);
+        return EXIT_FAILURE;
+    }
+    if (step == 0) {
+        step = 1;
+    }
+    init_radio_index(&index);
+    if ((ret = load_radio_index(&pool->engines[0], &index))) {
+        print_list_error(stderr, ret);
+        free_radio_index(&index);
+        free(ops);
+        free(scratch);
+        return EXIT_FAILURE;
+    }
+    existing = (uint32_t) index.count;
+    free_radio_index(&index);
+
+    // creates stop early, the radios created so far are deleted below
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_cb;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    memset(&op, 0, sizeof(op));
+    op.mode = HWSIM_OP_CREATE;
+    op.c_channels = args->c_channels;
+    op.c_no_vif = args->c_no_vif;
+    op.c_use_chanctx = args->c_use_chanctx;
+    op.c_reg_alpha2 = args->c_reg_alpha2;
+    op.c_reg_custom_reg = args->c_reg_custom_reg;
+
+    print_header(args->scale_kernel, args->json);
+    take_sample(&first, args->scale_kernel);
+    row_start = first;
+    while (sent < radios && !scale_stop) {
+        round = radios - sent < inflight ? radios - sent : inflight;
+        for (i = 0; i < round; i++) {
+            scale_op *sop = &ops[sent + i];
+            sop->population = existing + created + i;
+            if (submit_request_wait(pool_engine(pool, &op), &op, scale_request_done, sop)) {
+                sop->error = -EIO;
+            }
+        }
+        wait_for_pool(pool);
+        for (i = 0; i < round; i++) {
+            if (ops[sent + i].error < 0) {
+                failed++;
+            } else {
+                created++;
+            }
+        }
+        sent += round;
+        if (sent - row_first >= step || sent == radios || scale_stop) {
+            take_sample(&now, args->scale_kernel);
+            print_row(&ops[row_first], sent - row_first, existing + created, scratch, &row_start, &now,
+                      args->json);
+            row_first = sent;
+            row_start = now;
+        }
+    }
+    if (scale_stop) {
+        fprintf(stderr, "Stopped after %u of %u creates\n", sent, radios);
+    }
+    report_fit(ops, sent, existing + created, &first, &row_start, args->json);
+    undeleted = delete_created(pool, ops, sent, &first, args->scale_kernel, args->json);
+    report_pool_overruns(pool, stderr);
+    free(ops);
+    free(scratch);
+    return failed || undeleted ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,24 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_SCALE_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_SCALE_H
+
+#include "hwsim_mgmt_pool.h"
+
+/*
+ * Creates args->scale_radios radios with the create options of args,
+ * args->scale_inflight at a time, and records the latency of every reply
+ * against the number of radios that existed when it was sent. Every
+ * args->scale_step radios a row with the latency percentiles, the create
+ * rate, the RSS and the CPU time per create (plus kernel slab memory if
+ * args->scale_kernel is set) is printed as CSV, or as JSON lines if
+ * args->json is set. Afterwards fits the cost curve, deletes the created
+ * radios again and reports both on stderr (stdout for JSON). SIGINT and
+ * SIGTERM stop the creates early, the radios are still deleted.
+ */
+int run_scale(hwsim_pool *pool, const hwsim_args *args);
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_SCALE_H
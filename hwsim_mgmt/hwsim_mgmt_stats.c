@@ -0,0 +1,166 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#include <string.h>
+
+#include "hwsim_mgmt_stats.h"
+#include "hwsim_mgmt_batch.h"
+#include "hwsim_mgmt_radio.h"
+
+#define HIST_BAR_WIDTH 40
+
+void init_op_stats(op_stats *stats) {
+    memset(stats->ops, 0, sizeof(stats->ops));
+    pthread_mutex_init(&stats->lock, NULL);
+}
+
+void free_op_stats(op_stats *stats) {
+    pthread_mutex_destroy(&stats->lock);
+}
+
+static size_t bucket_of(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    size_t bucket = 0;
+    while (us > 1 && bucket < HWSIM_HIST_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+void record_latency(latency_hist *hist, uint64_t ns, bool failed) {
+    hist->count++;
+    hist->failed += failed;
+    hist->sum_ns += ns;
+    if (ns > hist->max_ns) {
+        hist->max_ns = ns;
+    }
+    hist->buckets[bucket_of(ns)]++;
+}
+
+void record_request(op_stats *stats, const hwsim_request *req) {
+    if ((size_t) req->mode >= sizeof(stats->ops) / sizeof(stats->ops[0])) {
+        return;
+    }
+    pthread_mutex_lock(&stats->lock);
+    record_latency(&stats->ops[req->mode], timespec_diff_ns(&req->submitted, &req->replied), req->error < 0);
+    pthread_mutex_unlock(&stats->lock);
+}
+
+// upper bound in us of the bucket holding the given fraction of requests
+static uint64_t percentile_us(const latency_hist *hist, double fraction) {
+    unsigned long rank = (unsigned long) (hist->count * fraction);
+    unsigned long seen = 0;
+    size_t i;
+    for (i = 0; i < HWSIM_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen > rank) {
+            break;
+        }
+    }
+    return 2ull << (i < HWSIM_HIST_BUCKETS ? i : HWSIM_HIST_BUCKETS - 1);
+}
+
+static void print_hist_text(const char *name, const latency_hist *hist, FILE *out) {
+    unsigned long peak = 0;
+    size_t i;
+    fprintf(out, "%s: %lu ops, %lu failed, avg %.1f us, p50 < %llu us, p99 < %llu us, max %.1f us\n", name,
+            hist->count, hist->failed, hist->sum_ns / 1e3 / hist->count,
+            (unsigned long long) percentile_us(hist, 0.5), (unsigned long long) percentile_us(hist, 0.99),
+            hist->max_ns / 1e3);
+    for (i = 0; i < HWSIM_HIST_BUCKETS; i++) {
+        if (hist->buckets[i] > peak) {
+            peak = hist->buckets[i];
+        }
+    }
+    for (i = 0; i < HWSIM_HIST_BUCKETS; i++) {
+        if (!hist->buckets[i]) {
+            continue;
+        }
+        int width = (int) ((hist->buckets[i] * HIST_BAR_WIDTH + peak - 1) / peak);
+        fprintf(out, "  < %9llu us %-*.*s %lu\n", 2ull << i, HIST_BAR_WIDTH, width,
+                "########################################", hist->buckets[i]);
+    }
+}
+
+static void print_hist_json(const char *name, const latency_hist *hist, FILE *out) {
+    bool first = true;
+    size_t i;
+    fprintf(out, "\"%s\":{\"count\":%lu,\"failed\":%lu,\"avg_us\":%.1f,\"p50_us\":%llu,\"p99_us\":%llu,"
+                 "\"max_us\":%.1f,\"buckets\":[", name, hist->count, hist->failed, hist->sum_ns / 1e3 / hist->count,
+            (unsigned long long) percentile_us(hist, 0.5), (unsigned long long) percentile_us(hist, 0.99),
+            hist->max_ns / 1e3);
+    for (i = 0; i < HWSIM_HIST_BUCKETS; i++) {
+        if (hist->buckets[i]) {
+            fprintf(out, "%s[%llu,%lu]", first ? "" : ",", 2ull << i, hist->buckets[i]);
+            first = false;
+        }
+    }
+    fprintf(out, "]}");
+}
+
+void print_op_stats(op_stats *stats, FILE *out, bool json) {
+    bool first = true;
+    size_t mode;
+    pthread_mutex_lock(&stats->lock);
+    if (json) {
+        fprintf(out, "{\"summary\":{");
+    }
+    for (mode = 0; mode < sizeof(stats->ops) / sizeof(stats->ops[0]); mode++) {
+        const latency_hist *hist = &stats->ops[mode];
+        if (!hist->count) {
+            continue;
+        }
+        if (json) {
+            fprintf(out, "%s", first ? "" : ",");
+            print_hist_json(op_name((enum op_mode) mode), hist, out);
+        } else {
+            print_hist_text(op_name((enum op_mode) mode), hist, out);
+        }
+        first = false;
+    }
+    if (json) {
+        fprintf(out, "}}\n");
+    }
+    pthread_mutex_unlock(&stats->lock);
+}
+
+void print_request_json(FILE *out, unsigned long line_no, const hwsim_request *req) {
+    int id = req->radio_id >= 0 ? req->radio_id : req->target_id;
+    flockfile(out);
+    fputc('{', out);
+    if (line_no) {
+        fprintf(out, "\"line\":%lu,", line_no);
+    }
+    fprintf(out, "\"op\":\"%s\",\"id\":", op_name(req->mode));
+    if (id >= 0) {
+        fprintf(out, "%d", id);
+    } else {
+        fprintf(out, "null");
+    }
+    fprintf(out, ",\"name\":");
+    if (req->name[0]) {
+        print_json_string(out, req->name);
+    } else {
+        fprintf(out, "null");
+    }
+    fprintf(out, ",\"error\":%d,\"send_us\":%.1f,\"ack_us\":%.1f,\"total_us\":%.1f}\n", req->error < 0 ? req->error : 0,
+            timespec_diff_ns(&req->submitted, &req->sent) / 1e3, timespec_diff_ns(&req->sent, &req->replied) / 1e3,
+            timespec_diff_ns(&req->submitted, &req->replied) / 1e3);
+    funlockfile(out);
+}
+
+void print_latency_hist(const char *name, const latency_hist *hist, FILE *out, bool json) {
+    if (!hist->count) {
+        return;
+    }
+    if (json) {
+        fputc('{', out);
+        print_hist_json(name, hist, out);
+        fprintf(out, "}\n");
+    } else {
+        print_hist_text(name, hist, out);
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_STATS_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_STATS_H
+
+#include <stdio.h>
+#include "hwsim_mgmt_event.h"
+
+#define HWSIM_HIST_BUCKETS 32
+
+/*
+ * Log2 histogram of end-to-end request latency: bucket i counts
+ * latencies below 2^(i+1) us (and at least 2^i us for i > 0).
+ */
+typedef struct {
+    unsigned long count;
+    unsigned long failed;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    unsigned long buckets[HWSIM_HIST_BUCKETS];
+} latency_hist;
+
+/*
+ * One histogram per operation, filled from completion callbacks of any
+ * thread.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    latency_hist ops[HWSIM_OP_RENAME + 1];
+} op_stats;
+
+void init_op_stats(op_stats *stats);
+
+void free_op_stats(op_stats *stats);
+
+void record_request(op_stats *stats, const hwsim_request *req);
+
+/*
+ * Adds one sample to hist, for latencies that are not a request's.
+ */
+void record_latency(latency_hist *hist, uint64_t ns, bool failed);
+
+/*
+ * Prints count, failures, average, p50/p99 upper bounds, maximum and the
+ * non-empty buckets of every operation that ran; a single
+ * {"summary":{...}} line if json is set.
+ */
+void print_op_stats(op_stats *stats, FILE *out, bool json);
+
+/*
+ * Prints hist like one operation of print_op_stats(), as a single
+ * {"<name>":{...}} line if json is set.
+ */
+void print_latency_hist(const char *name, const latency_hist *hist, FILE *out, bool json);
+
+/*
+ * Prints req as one JSON object line: operation, radio id and name,
+ * error, and send/ack/total times in us. line_no 0 is omitted.
+ */
+void print_request_json(FILE *out, unsigned long line_no, const hwsim_request *req);
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_STATS_H
@@ -0,0 +1,142 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#include <errno.h>
+#include <fnmatch.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hwsim_mgmt_teardown.h"
+#include "hwsim_mgmt_radio.h"
+
+#define TEARDOWN_REPORT_MS 1000
+
+typedef struct {
+    enum teardown_match match;
+    const char *pattern;
+    size_t pattern_len;
+    regex_t re;
+    // written by the submitting thread
+    unsigned long matched;
+    // written by the event threads
+    uint64_t last_report_ms;
+    unsigned long deleted;
+    unsigned long gone;
+    unsigned long failed;
+} teardown;
+
+static bool radio_selected(const teardown *td, const hwsim_radio *radio) {
+    switch (td->match) {
+        case TEARDOWN_ALL:
+            return true;
+        case TEARDOWN_GLOB:
+            return fnmatch(td->pattern, radio->name, 0) == 0;
+        case TEARDOWN_REGEX:
+            return regexec(&td->re, radio->name, 0, NULL, 0) == 0;
+        case TEARDOWN_SESSION:
+            return strncmp(radio->name, td->pattern, td->pattern_len) == 0 && radio->name[td->pattern_len] == '-';
+    }
+    return false;
+}
+
+/*
+ * Progress follows the completions, so it keeps coming while the last
+ * window of deletes drains. Of several event threads only the one that
+ * claims the interval prints.
+ */
+static void report_progress(teardown *td) {
+    uint64_t now = monotonic_ns() / 1000000;
+    uint64_t last = __atomic_load_n(&td->last_report_ms, __ATOMIC_RELAXED);
+    if (now - last < TEARDOWN_REPORT_MS
+        || !__atomic_compare_exchange_n(&td->last_report_ms, &last, now, false, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED)) {
+        return;
+    }
+    fprintf(stderr, "teardown: %lu/%lu deleted\n", __atomic_load_n(&td->deleted, __ATOMIC_RELAXED),
+            __atomic_load_n(&td->matched, __ATOMIC_RELAXED));
+}
+
+static void teardown_request_done(const hwsim_request *req, void *arg) {
+    teardown *td = arg;
+    if (req->error == -ENODEV) {
+        __atomic_fetch_add(&td->gone, 1, __ATOMIC_RELAXED);
+    } else if (req->error < 0) {
+        __atomic_fetch_add(&td->failed, 1, __ATOMIC_RELAXED);
+        fprintf(stderr, "Error deleting radio %d: %s\n", req->target_id, strerror(-req->error));
+    } else {
+        __atomic_fetch_add(&td->deleted, 1, __ATOMIC_RELAXED);
+    }
+    report_progress(td);
+}
+
+static void report(teardown *td, FILE *out, unsigned long matched, uint64_t elapsed_ms, bool json) {
+    unsigned long deleted = __atomic_load_n(&td->deleted, __ATOMIC_RELAXED);
+    unsigned long gone = __atomic_load_n(&td->gone, __ATOMIC_RELAXED);
+    unsigned long failed = __atomic_load_n(&td->failed, __ATOMIC_RELAXED);
+    if (json) {
+        fprintf(out, "{\"matched\":%lu,\"deleted\":%lu,\"gone\":%lu,\"failed\":%lu,\"elapsed_ms\":%lu}\n", matched,
+                deleted, gone, failed, (unsigned long) elapsed_ms);
+    } else {
+        fprintf(out, "teardown: %lu matched, %lu deleted, %lu already gone, %lu failed in %lu ms\n", matched,
+                deleted, gone, failed, (unsigned long) elapsed_ms);
+    }
+}
+
+static int delete_selected(hwsim_pool *pool, teardown *td, const radio_index *index, bool json) {
+    hwsim_args op;
+    unsigned long dropped = 0;
+    uint64_t start;
+    size_t i;
+
+    memset(&op, 0, sizeof(op));
+    op.mode = HWSIM_OP_DELETE_BY_ID;
+    start = td->last_report_ms = monotonic_ns() / 1000000;
+    for (i = 0; i < index->count; i++) {
+        if (!radio_selected(td, &index->radios[i])) {
+            continue;
+        }
+        __atomic_fetch_add(&td->matched, 1, __ATOMIC_RELAXED);
+        op.del_radio_id = index->radios[i].id;
+        if (submit_request_wait(pool_engine(pool, &op), &op, teardown_request_done, td)) {
+            dropped++;
+        }
+    }
+    wait_for_pool(pool);
+    td->failed += dropped;
+    report(td, stdout, td->matched, monotonic_ns() / 1000000 - start, json);
+    report_pool_overruns(pool, stderr);
+    return td->failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int run_teardown(hwsim_pool *pool, enum teardown_match match, const char *pattern, bool json) {
+    teardown td;
+    radio_index index;
+    int ret;
+
+    memset(&td, 0, sizeof(td));
+    td.match = match;
+    td.pattern = pattern;
+    td.pattern_len = pattern ? strlen(pattern) : 0;
+    if (match == TEARDOWN_REGEX && (ret = regcomp(&td.re, pattern, REG_EXTENDED | REG_NOSUB))) {
+        char err[128];
+        regerror(ret, &td.re, err, sizeof(err));
+        fprintf(stderr, "Invalid regular expression '%s': %s\n", pattern, err);
+        return EXIT_FAILURE;
+    }
+    init_radio_index(&index);
+    if ((ret = load_radio_index(&pool->engines[0], &index))) {
+        print_list_error(stderr, ret);
+        ret = EXIT_FAILURE;
+    } else {
+        ret = delete_selected(pool, &td, &index, json);
+    }
+    free_radio_index(&index);
+    if (match == TEARDOWN_REGEX) {
+        regfree(&td.re);
+    }
+    return ret;
+}
@@ -0,0 +1,29 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_TEARDOWN_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_TEARDOWN_H
+
+#include "hwsim_mgmt_pool.h"
+
+enum teardown_match {
+    TEARDOWN_ALL,
+    // shell pattern on the radio name (fnmatch)
+    TEARDOWN_GLOB,
+    // POSIX extended regular expression on the radio name
+    TEARDOWN_REGEX,
+    // radios named "<pattern>-..."
+    TEARDOWN_SESSION
+};
+
+/*
+ * Dumps the radios, picks those matching pattern and deletes them by id,
+ * pipelined over pool. Progress is reported on stderr every second and a
+ * summary on stdout (one JSON object with json). Radios that are gone by
+ * the time their delete arrives are counted, but not as failures.
+ */
+int run_teardown(hwsim_pool *pool, enum teardown_match match, const char *pattern, bool json);
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_TEARDOWN_H
@@ -0,0 +1,250 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hwsim_mgmt_topology.h"
+#include "hwsim_mgmt_batch.h"
+#include "hwsim_mgmt_radio.h"
+
+#define TOPOLOGY_DELIM " \t\r\n"
+
+typedef struct {
+    char *line;
+    hwsim_args op;
+    bool has_rssi;
+    int32_t rssi;
+    bool exists;
+    int radio_id;
+} topology_radio;
+
+typedef struct {
+    topology_radio *radios;
+    size_t count;
+    size_t cap;
+} topology;
+
+typedef struct {
+    const char *name;
+    topology_radio *radio;
+    unsigned long *failed;
+} topology_request;
+
+static int parse_topology_line(topology_radio *radio) {
+    char *saveptr = NULL;
+    char *token;
+
+    memset(&radio->op, 0, sizeof(radio->op));
+    radio->op.mode = HWSIM_OP_NONE;
+    char *cmd = strtok_r(radio->line, TOPOLOGY_DELIM, &saveptr);
+    if (!cmd || cmd[0] == '#') {
+        return 0;
+    }
+    if (strcmp(cmd, "radio") != 0) {
+        return -1;
+    }
+    radio->op.mode = HWSIM_OP_CREATE;
+    while ((token = strtok_r(NULL, TOPOLOGY_DELIM, &saveptr))) {
+        if (!strncmp(token, "rssi=", 5)) {
+            if (parse_rssi(token + 5, &radio->rssi)) {
+                return -1;
+            }
+            radio->has_rssi = true;
+        } else if (parse_create_option(token, &radio->op)) {
+            return -1;
+        }
+    }
+    return radio->op.c_hwname ? 0 : -1;
+}
+
+static int read_topology(FILE *in, topology *topo) {
+    char *line = NULL;
+    size_t line_cap = 0;
+    unsigned long line_no = 0;
+
+    while (getline(&line, &line_cap, in) != -1) {
+        line_no++;
+        if (topo->count == topo->cap) {
+            size_t cap = topo->cap ? topo->cap * 2 : 64;
+            topology_radio *radios = realloc(topo->radios, cap * sizeof(topology_radio));
+            if (!radios) {
+                free(line);
+                return -1;
+            }
+            topo->radios = radios;
+            topo->cap = cap;
+        }
+        topology_radio *radio = &topo->radios[topo->count];
+        memset(radio, 0, sizeof(*radio));
+        radio->line = line;
+        if (parse_topology_line(radio)) {
+            fprintf(stderr, "Invalid topology line %lu\n", line_no);
+            free(line);
+            return -1;
+        }
+        if (radio->op.mode == HWSIM_OP_NONE) {
+            continue;
+        }
+        // the parsed strings point into the line, which stays with the radio
+        topo->count++;
+        line = NULL;
+        line_cap = 0;
+    }
+    free(line);
+    return 0;
+}
+
+static void free_topology(topology *topo) {
+    size_t i;
+    for (i = 0; i < topo->count; i++) {
+        free(topo->radios[i].line);
+    }
+    free(topo->radios);
+}
+
+static bool radio_matches(const hwsim_radio *radio, const hwsim_args *op) {
+    if (op->c_channels && radio->channels != op->c_channels) {
+        return false;
+    }
+    /*
+     * mac80211_hwsim enables chanctx on its own for multi-channel radios,
+     * so without a channel count only an explicit chanctx is checked.
+     */
+    if (op->c_channels ? radio->use_chanctx != (op->c_use_chanctx || op->c_channels > 1)
+                       : op->c_use_chanctx && !radio->use_chanctx) {
+        return false;
+    }
+    if (strcmp(radio->reg_alpha2, op->c_reg_alpha2 ? op->c_reg_alpha2 : "") != 0) {
+        return false;
+    }
+    return radio->reg_custom_reg == op->c_reg_custom_reg;
+}
+
+static void topology_request_done(const hwsim_request *req, void *arg) {
+    topology_request *treq = arg;
+    if (req->error < 0) {
+        printf("%s %s err %d %s\n", op_name(req->mode), treq->name, req->error, strerror(abs(req->error)));
+        __atomic_fetch_add(treq->failed, 1, __ATOMIC_RELAXED);
+    } else {
+        if (req->mode == HWSIM_OP_CREATE && treq->radio) {
+            treq->radio->radio_id = req->radio_id;
+            treq->radio->exists = true;
+        }
+        printf("%s %s ok %d\n", op_name(req->mode), treq->name, req->radio_id);
+    }
+    free(treq);
+}
+
+static int submit_topology_op(hwsim_engine *engine, const hwsim_args *op, const char *name,
+                              topology_radio *radio, unsigned long *failed) {
+    topology_request *treq = malloc(sizeof(topology_request));
+    if (!treq) {
+        __atomic_fetch_add(failed, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    treq->name = name;
+    treq->radio = radio;
+    treq->failed = failed;
+    if (submit_request_wait(engine, op, topology_request_done, treq)) {
+        printf("%s %s err %d %s\n", op_name(op->mode), name, -EIO, strerror(EIO));
+        free(treq);
+        __atomic_fetch_add(failed, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    return 0;
+}
+
+int apply_topology(hwsim_engine *engine, FILE *in) {
+    topology topo = {NULL, 0, 0};
+    radio_index index;
+    hwsim_args op;
+    unsigned long failed = 0, deleted = 0, created = 0, unchanged = 0, rssi_set = 0;
+    bool *listed = NULL;
+    size_t i;
+    int ret;
+
+    init_radio_index(&index);
+    if (read_topology(in, &topo)) {
+        free_topology(&topo);
+        return EXIT_FAILURE;
+    }
+    if ((ret = load_radio_index(engine, &index))) {
+        print_list_error(stderr, ret);
+        free_topology(&topo);
+        free_radio_index(&index);
+        return EXIT_FAILURE;
+    }
+    if (index.count && !(listed = calloc(index.count, sizeof(bool)))) {
+        free_topology(&topo);
+        free_radio_index(&index);
+        return EXIT_FAILURE;
+    }
+
+    // phase 1: delete unlisted radios and radios that need to be recreated
+    memset(&op, 0, sizeof(op));
+    op.mode = HWSIM_OP_DELETE_BY_ID;
+    for (i = 0; i < topo.count; i++) {
+        topology_radio *radio = &topo.radios[i];
+        const hwsim_radio *existing = find_radio_by_name(&index, radio->op.c_hwname);
+        if (!existing) {
+            continue;
+        }
+        listed[existing - index.radios] = true;
+        if (radio_matches(existing, &radio->op)) {
+            radio->exists = true;
+            radio->radio_id = (int) existing->id;
+            unchanged++;
+        } else {
+            op.del_radio_id = existing->id;
+            if (!submit_topology_op(engine, &op, radio->op.c_hwname, NULL, &failed)) {
+                deleted++;
+            }
+        }
+    }
+    for (i = 0; i < index.count; i++) {
+        if (listed[i]) {
+            continue;
+        }
+        op.del_radio_id = index.radios[i].id;
+        if (!submit_topology_op(engine, &op, index.radios[i].name, NULL, &failed)) {
+            deleted++;
+        }
+    }
+    wait_for_event(engine);
+
+    // phase 2: create missing radios
+    for (i = 0; i < topo.count; i++) {
+        topology_radio *radio = &topo.radios[i];
+        if (!radio->exists && !submit_topology_op(engine, &radio->op, radio->op.c_hwname, radio, &failed)) {
+            created++;
+        }
+    }
+    wait_for_event(engine);
+
+    // phase 3: initial RSSI
+    memset(&op, 0, sizeof(op));
+    op.mode = HWSIM_OP_SET_RSSI;
+    for (i = 0; i < topo.count; i++) {
+        topology_radio *radio = &topo.radios[i];
+        if (!radio->exists || !radio->has_rssi) {
+            continue;
+        }
+        op.rssi_radio = (uint32_t) radio->radio_id;
+        op.rssi_dbm = radio->rssi;
+        if (!submit_topology_op(engine, &op, radio->op.c_hwname, NULL, &failed)) {
+            rssi_set++;
+        }
+    }
+    wait_for_event(engine);
+
+    printf("apply: %lu unchanged, %lu deleted, %lu created, %lu rssi set, %lu failed\n", unchanged, deleted,
+           created, rssi_set, failed);
+    free(listed);
+    free_topology(&topo);
+    free_radio_index(&index);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,27 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_TOPOLOGY_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_TOPOLOGY_H
+
+#include <stdio.h>
+#include "hwsim_mgmt_event.h"
+
+/*
+ * Topology lines describe the desired radios, one per line:
+ *   radio name=NAME [channels=NUM] [novif] [chanctx] [alphareg=STR] [customreg=REG] [rssi=NUM]
+ * Empty lines and lines starting with '#' are ignored.
+ *
+ * Applying a topology dumps the existing radios and then, each phase
+ * pipelined: deletes radios that are not listed or whose channels,
+ * chanctx or regulatory settings differ, creates the missing ones and
+ * sets the RSSI of every radio that has one. channels=0 (or omitted)
+ * accepts any channel count, and any chanctx setting unless chanctx is
+ * given; novif cannot be read back from the kernel and is only used on
+ * creation.
+ */
+int apply_topology(hwsim_engine *engine, FILE *in);
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_TOPOLOGY_H
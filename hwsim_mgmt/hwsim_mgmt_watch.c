@@ -0,0 +1,128 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#include <netlink/netlink.h>
+#include <netlink/genl/genl.h>
+#include <errno.h>
+
+#include "hwsim_mgmt_watch.h"
+
+/*
+ * Called with the lock held. Radios missing from the dump were deleted and
+ * radios missing from the table were created while notifications were lost.
+ */
+static void replace_index(radio_watch *watch) {
+    radio_index old = watch->index;
+    size_t i;
+
+    watch->index = watch->resync;
+    watch->resync = old;
+    if (watch->cb) {
+        for (i = 0; i < old.count; i++) {
+            if (!find_radio_by_id(&watch->index, old.radios[i].id)) {
+                watch->cb(HWSIM_CMD_DEL_RADIO, &old.radios[i], watch->cb_arg);
+            }
+        }
+        for (i = 0; i < watch->index.count; i++) {
+            if (!find_radio_by_id(&old, watch->index.radios[i].id)) {
+                watch->cb(HWSIM_CMD_NEW_RADIO, &watch->index.radios[i], watch->cb_arg);
+            }
+        }
+    }
+    clear_radio_index(&watch->resync);
+}
+
+static void resync_message(radio_watch *watch, struct nl_msg *msg) {
+    struct nlmsghdr *nlh = nlmsg_hdr(msg);
+    hwsim_radio radio;
+
+    pthread_mutex_lock(&watch->lock);
+    // a new dump supersedes an unfinished one
+    if (nlh->nlmsg_seq != watch->resync_seq) {
+        clear_radio_index(&watch->resync);
+        watch->resync_seq = nlh->nlmsg_seq;
+    }
+    if (nlh->nlmsg_type == NLMSG_DONE) {
+        replace_index(watch);
+        watch->resync_seq = 0;
+    } else if (!parse_radio(msg, &radio)) {
+        put_radio(&watch->resync, &radio);
+    }
+    pthread_mutex_unlock(&watch->lock);
+}
+
+static void radio_notify(struct nl_msg *msg, void *arg) {
+    radio_watch *watch = arg;
+    uint8_t cmd;
+    hwsim_radio radio;
+
+    if (nlmsg_hdr(msg)->nlmsg_seq) {
+        resync_message(watch, msg);
+        return;
+    }
+    cmd = ((struct genlmsghdr *) nlmsg_data(nlmsg_hdr(msg)))->cmd;
+    if ((cmd != HWSIM_CMD_NEW_RADIO && cmd != HWSIM_CMD_DEL_RADIO) || parse_radio(msg, &radio)) {
+        return;
+    }
+    pthread_mutex_lock(&watch->lock);
+    if (cmd == HWSIM_CMD_NEW_RADIO) {
+        put_radio(&watch->index, &radio);
+    } else {
+        remove_radio(&watch->index, radio.id);
+    }
+    // notifications racing with a resync dump are newer than it
+    if (watch->resync_seq && cmd == HWSIM_CMD_NEW_RADIO) {
+        put_radio(&watch->resync, &radio);
+    } else if (watch->resync_seq) {
+        remove_radio(&watch->resync, radio.id);
+    }
+    if (watch->cb) {
+        watch->cb(cmd, &radio, watch->cb_arg);
+    }
+    pthread_mutex_unlock(&watch->lock);
+}
+
+int start_radio_watch(radio_watch *watch, hwsim_engine *engine, radio_event_cb cb, void *cb_arg) {
+    radio_index dump;
+    size_t i;
+    int ret;
+
+    watch->engine = engine;
+    watch->cb = cb;
+    watch->cb_arg = cb_arg;
+    pthread_mutex_init(&watch->lock, NULL);
+    init_radio_index(&watch->index);
+    init_radio_index(&watch->resync);
+    watch->resync_seq = 0;
+    watch->live = !join_config_group(engine->nl_ctx);
+    if (watch->live) {
+        set_notify_handler(engine, radio_notify, watch);
+    }
+
+    init_radio_index(&dump);
+    if ((ret = load_radio_index(engine, &dump))) {
+        set_notify_handler(engine, NULL, NULL);
+        free_radio_index(&dump);
+        free_radio_index(&watch->resync);
+        pthread_mutex_destroy(&watch->lock);
+        return ret;
+    }
+    pthread_mutex_lock(&watch->lock);
+    // radios announced while the dump ran are newer than the dump
+    for (i = 0; i < watch->index.count; i++) {
+        put_radio(&dump, &watch->index.radios[i]);
+    }
+    free_radio_index(&watch->index);
+    watch->index = dump;
+    pthread_mutex_unlock(&watch->lock);
+    return 0;
+}
+
+void stop_radio_watch(radio_watch *watch) {
+    set_notify_handler(watch->engine, NULL, NULL);
+    free_radio_index(&watch->index);
+    free_radio_index(&watch->resync);
+    pthread_mutex_destroy(&watch->lock);
+}
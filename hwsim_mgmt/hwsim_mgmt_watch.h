@@ -0,0 +1,49 @@
+/*
+ * mac80211_hwsim_mgmt - management tool for mac80211_hwsim kernel module
+ * Copyright (c) 2016, Patrick Grosse <patrick.grosse@uni-muenster.de>
+ */
+
+#ifndef MAC80211_HWSIM_MGMT_HWSIM_MGMT_WATCH_H
+#define MAC80211_HWSIM_MGMT_HWSIM_MGMT_WATCH_H
+
+#include "hwsim_mgmt_radio.h"
+
+/*
+ * Called with the cache lock held after radio was added (cmd
+ * HWSIM_CMD_NEW_RADIO) or removed (HWSIM_CMD_DEL_RADIO).
+ */
+typedef void (*radio_event_cb)(uint8_t cmd, const hwsim_radio *radio, void *arg);
+
+/*
+ * Radio table kept up to date from the "config" multicast group, so
+ * changes made by other processes are seen without asking the kernel.
+ * Readers take lock; notifications are applied from the thread that
+ * receives on the engine's socket.
+ */
+typedef struct {
+    hwsim_engine *engine;
+    pthread_mutex_t lock;
+    radio_index index;
+    radio_event_cb cb;
+    void *cb_arg;
+    bool live;
+    // radio dump of an engine resync, replaces index once complete
+    radio_index resync;
+    uint32_t resync_seq;
+} radio_watch;
+
+/*
+ * Joins the multicast group and then fills the table with a radio dump.
+ * Notifications that race with the dump are applied on top of it, except
+ * that a radio deleted during the dump may linger until the next event
+ * naming it. If the group cannot be joined (kernels before 4.1 have
+ * none), live stays false and the table only holds the dump. After a
+ * receive overrun lost notifications, the table is rebuilt from the
+ * engine's resync dump and the differences are passed to cb. Returns 0
+ * or a negative errno value.
+ */
+int start_radio_watch(radio_watch *watch, hwsim_engine *engine, radio_event_cb cb, void *cb_arg);
+
+void stop_radio_watch(radio_watch *watch);
+
+#endif //MAC80211_HWSIM_MGMT_HWSIM_MGMT_WATCH_H